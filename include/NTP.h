@@ -1,128 +1,304 @@
 /*
-   ESP8266 NeoPixel NTP Clock Program
+    NTP.h - Asynchronous NTP client and the system clock
 
-    NTP.h - Network Time Protocol Functions
+    The node keeps its own clock in microseconds since the epoch, run
+    from micros(). Every NTP_POLL_INTERVAL a request goes to each of the
+    NTP_SERVERS at once, over the raw lwIP UDP API: the names are
+    resolved asynchronously, the requests are sent from the DNS
+    callbacks and the replies are timestamped in the receive callback,
+    so nothing ever waits for the network. When every server has
+    answered or NTP_REPLY_TIMEOUT has passed, the reply with the
+    shortest round trip gives the offset, since its path delay is the
+    least uncertain.
 
-    Portions of this code were extracted from the
-    Time library examples by Michael Margolis and
-    Paul Stoffregen. Other portions from the NTPClient
-    example program from the Arduino ESP8266 package.
+    The first offset, and any larger than NTP_STEP_THRESHOLD, steps the
+    clock. Smaller ones are slewed out: the clock runs up to
+    NTP_SLEW_RATE faster or slower until the offset is gone, so it never
+    jumps and never runs backwards.
 
-    Concept, Design and Implementation by: Craig A. Lindley
-    Version: 2.0
-    Last Update: 06/10/2016
+    TimeLib keeps providing now() and the calendar functions for the rest
+    of the firmware. NtpTick() sets it on every second boundary of the
+    clock, which keeps it within a loop pass of the NTP time.
+
+    NtpTick() also has to run at least once every 71 minutes, the wrap
+    of micros().
 */
 
 #ifndef NTP_H
 #define NTP_H
 
 #include <Arduino.h>
-#include <ESP8266WiFi.h>
 #include <TimeLib.h>
-#include <WiFiUdp.h>
+#include <lwip/udp.h>
+#include <lwip/dns.h>
 
-#define LOCALPORT     2390 // Local port to listen for UDP packets
-#define NTP_PACKET_SIZE 48 // NTP time stamp is in the first 48 bytes of the message
+#define NTP_PORT 123
+#define NTP_PACKET_SIZE 48
+#define NTP_UNIX_OFFSET 2208988800UL    //  s from 1900 to 1970
 
-// A UDP instance to let us send and receive packets over UDP
-WiFiUDP udp;
+#define NTP_POLL_INTERVAL 3600000       //  ms
+#define NTP_RETRY_INTERVAL 60000        //  ms, until the first reply
+#define NTP_REPLY_TIMEOUT 2000          //  ms
+#define NTP_STEP_THRESHOLD 500000       //  us
+#define NTP_SLEW_RATE 2000              //  1 us of correction per this many us, 500 ppm
 
-byte packetBuffer[NTP_PACKET_SIZE]; // Buffer to hold incoming and outgoing packets
+#define NTP_SERVER_IDLE 0
+#define NTP_SERVER_RESOLVING 1
+#define NTP_SERVER_WAITING 2
+#define NTP_SERVER_DONE 3
 
-// Don't hardwire the IP address or we won't get the benefits of the time server pool.
-IPAddress timeServerIP;
 #ifdef __debugSettings
-const char *ntpServerName = "192.168.1.3";
+const char* ntpServers[] = { "192.168.1.3" };
 #else
-const char *ntpServerName = "time.nist.gov";
-//const char *ntpServerName = "nl.pool.ntp.org";
+const char* ntpServers[] = { "time.nist.gov", "pool.ntp.org", "time.google.com" };
 #endif
 
-// Send an NTP request to the time server at the given address
-unsigned long sendNTPpacket(IPAddress& address) {
-
-  // Set all bytes in the buffer to 0
-  memset(packetBuffer, 0, NTP_PACKET_SIZE);
-
-  // Initialize values needed to form NTP request
-  packetBuffer[0] = 0b11100011;   // LI, Version, Mode
-  packetBuffer[1] = 0;     // Stratum, or type of clock
-  packetBuffer[2] = 6;     // Polling Interval
-  packetBuffer[3] = 0xEC;  // Peer Clock Precision
-  // 8 bytes of zero for Root Delay & Root Dispersion
-  packetBuffer[12]  = 49;
-  packetBuffer[13]  = 0x4E;
-  packetBuffer[14]  = 49;
-  packetBuffer[15]  = 52;
-
-  // All NTP fields have been given values, now
-  // you can send a packet requesting a timestamp:
-  udp.beginPacket(address, 123); // NTP requests are to port 123
-  udp.write(packetBuffer, NTP_PACKET_SIZE);
-  udp.endPacket();
-  return 0;
-}
+#define NTP_SERVER_COUNT (sizeof(ntpServers) / sizeof(ntpServers[0]))
+
+//  The Internet probe resolves the first server
+const char* ntpServerName = ntpServers[0];
+
+struct ntpServer{
+  uint8_t state;
+  ip_addr_t address;
+  uint64_t sent;          //  our clock at the request, us
+  bool replied;
+  int64_t offset;         //  us the server is ahead of us
+  uint32_t delay;         //  us round trip
+};
+
+struct ntpClient{
+  udp_pcb* pcb;
+  uint8_t round;          //  tells the callbacks of an old round apart
+  bool polling;
+  uint32_t roundStarted;  //  millis()
+  uint32_t lastPoll;
+  ntpServer servers[NTP_SERVER_COUNT];
+
+  //  The clock
+  bool set;
+  uint64_t epoch;         //  us since 1970 at reference
+  uint32_t reference;     //  micros()
+  int64_t slew;           //  us still to be corrected
+  time_t fedSecond;       //  last second given to TimeLib
+
+  //  Last result
+  const char* server;
+  int64_t offset;
+  uint32_t delay;
+  uint32_t steps;
+  uint32_t updates;
+};
 
-// NTP Time Provider Code
-time_t getNTPTime() {
+ntpClient ntp;
 
-  int attempts = 40;
+//  The clock in us since 1970, slewing as it goes. 0 until the first reply.
+uint64_t NtpMicros(){
+  if (!ntp.set) return 0;
 
-  // Try multiple attempts to return the NTP time
-  while (attempts--) {
+  uint32_t t = micros();
+  uint32_t elapsed = t - ntp.reference;
+  ntp.reference = t;
+  ntp.epoch += elapsed;
 
-    // Get a server from the pool
-    WiFi.hostByName(ntpServerName, timeServerIP);
-    Serial.print("Trying time server: ");
-    Serial.println(timeServerIP);
+  if (ntp.slew){
+    int64_t step = elapsed / NTP_SLEW_RATE;
+    if (step > (ntp.slew > 0 ? ntp.slew : -ntp.slew)) step = ntp.slew > 0 ? ntp.slew : -ntp.slew;
+    if (ntp.slew < 0) step = -step;
+    ntp.epoch += step;
+    ntp.slew -= step;
+  }
 
-    while (udp.parsePacket() > 0); // Discard any previously received packets
+  return ntp.epoch;
+}
 
-    Serial.println("Transmitted NTP Request.");
-    sendNTPpacket(timeServerIP);
+uint32_t ReadNtp32(const uint8_t* p){
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
 
-    uint32_t beginWait = millis();
-    while (millis() - beginWait < 1500) {
-      int size = udp.parsePacket();
-      if (size >= NTP_PACKET_SIZE) {
-        Serial.println("Received NTP Response.");
-        udp.read(packetBuffer, NTP_PACKET_SIZE);  // Read packet into the buffer
-        unsigned long secsSince1900;
+//  64 bit NTP timestamp to us since 1970
+int64_t NtpToMicros(const uint8_t* p){
+  uint32_t seconds = ReadNtp32(p);
+  uint32_t fraction = ReadNtp32(p + 4);
+  return (int64_t)(seconds - NTP_UNIX_OFFSET) * 1000000 + (((uint64_t)fraction * 1000000 + 0x80000000) >> 32);
+}
 
-        // Convert four bytes starting at location 40 to a long integer
-        secsSince1900 =  (unsigned long) packetBuffer[40] << 24;
-        secsSince1900 |= (unsigned long) packetBuffer[41] << 16;
-        secsSince1900 |= (unsigned long) packetBuffer[42] << 8;
-        secsSince1900 |= (unsigned long) packetBuffer[43];
+void WriteNtpTimestamp(uint8_t* p, uint64_t us){
+  uint32_t seconds = us / 1000000 + NTP_UNIX_OFFSET;
+  uint32_t fraction = ((us % 1000000) << 32) / 1000000;
+  for (uint8_t i = 0; i < 4; i++) {
+    p[i] = seconds >> (24 - 8 * i);
+    p[4 + i] = fraction >> (24 - 8 * i);
+  }
+}
 
-        Serial.println("Got the time.");
+//  Before the clock is set the requests are timed from micros() alone
+uint64_t NtpLocalMicros(){
+  return ntp.set ? NtpMicros() : micros();
+}
 
-        return secsSince1900 - 2208988800UL;
-      }
-      delay(10);
+void NtpReceive(void* arg, udp_pcb* pcb, pbuf* p, const ip_addr_t* addr, u16_t port){
+  uint64_t received = NtpLocalMicros();
+  const uint8_t* d = (const uint8_t*)p->payload;
+
+  if (ntp.polling && p->len >= NTP_PACKET_SIZE && (d[0] & 0x07) == 4 && d[1] != 0){   //  server mode, not a kiss of death
+    for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+      ntpServer& s = ntp.servers[i];
+      if (s.state != NTP_SERVER_WAITING || s.address.addr != addr->addr) continue;
+
+      //  The originate timestamp is our transmit timestamp echoed back
+      uint8_t sent[8];
+      WriteNtpTimestamp(sent, s.sent);
+      if (memcmp(sent, d + 24, 8) != 0) continue;
+
+      int64_t t2 = NtpToMicros(d + 32);
+      int64_t t3 = NtpToMicros(d + 40);
+      int64_t t1 = s.sent;
+      int64_t t4 = received;
+      if (t4 < t1) break;     //  micros() wrapped before the clock was set
+
+      int64_t delay = (t4 - t1) - (t3 - t2);
+      s.delay = delay > 0 ? delay : 0;
+      s.offset = ((t2 - t1) + (t3 - t4)) / 2;
+      s.replied = true;
+      s.state = NTP_SERVER_DONE;
+      break;
     }
-    Serial.println("Retrying NTP request...");
-    delay(4000);
   }
-  Serial.println("No NTP response.");
-  return 0;
+
+  pbuf_free(p);
 }
 
-// Assign NTP as the time sync provider
-void initNTP() {
+void NtpSend(ntpServer& s){
+  pbuf* p = pbuf_alloc(PBUF_TRANSPORT, NTP_PACKET_SIZE, PBUF_RAM);
+  if (!p){
+    s.state = NTP_SERVER_DONE;
+    return;
+  }
+
+  uint8_t* d = (uint8_t*)p->payload;
+  memset(d, 0, NTP_PACKET_SIZE);
+  d[0] = 0b00100011;    //  no leap warning, version 4, client mode
 
-  // Login suceeded so set UDP local port
-  udp.begin(LOCALPORT);
+  s.sent = NtpLocalMicros();
+  WriteNtpTimestamp(d + 40, s.sent);
 
-  // Set the time provider to NTP
-  setSyncProvider(getNTPTime);
-  setSyncInterval(NTP_REFRESH_INTERVAL);
+  s.state = udp_sendto(ntp.pcb, p, &s.address, NTP_PORT) == ERR_OK ? NTP_SERVER_WAITING : NTP_SERVER_DONE;
+  pbuf_free(p);
 }
 
-// Check for Internet connectivity
-boolean checkInternetConnection() {
-  int result = WiFi.hostByName(ntpServerName, timeServerIP);
-  return (result == 1);
+//  The server index and the round are packed in the argument
+void NtpDnsFound(const char* name, const ip_addr_t* address, void* arg){
+  uint8_t i = (uintptr_t)arg & 0xFF;
+  if (!ntp.polling || ((uintptr_t)arg >> 8) != ntp.round || i >= NTP_SERVER_COUNT) return;
+
+  ntpServer& s = ntp.servers[i];
+  if (s.state != NTP_SERVER_RESOLVING) return;
+
+  if (!address){
+    s.state = NTP_SERVER_DONE;
+    return;
+  }
+  s.address = *address;
+  NtpSend(s);
+}
+
+void NtpStartRound(){
+  ntp.round++;
+  ntp.polling = true;
+  ntp.roundStarted = millis();
+  ntp.lastPoll = ntp.roundStarted;
+
+  for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+    ntpServer& s = ntp.servers[i];
+    s.replied = false;
+    s.state = NTP_SERVER_RESOLVING;
+
+    err_t err = dns_gethostbyname(ntpServers[i], &s.address, NtpDnsFound, (void*)(((uintptr_t)ntp.round << 8) | i));
+    if (err == ERR_OK) NtpSend(s);
+    else if (err != ERR_INPROGRESS) s.state = NTP_SERVER_DONE;
+  }
+}
+
+//  Applies the best reply of the round, true if the clock was stepped
+bool NtpEndRound(){
+  ntp.polling = false;
+
+  int8_t best = -1;
+  for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) {
+    if (ntp.servers[i].replied && (best < 0 || ntp.servers[i].delay < ntp.servers[best].delay)) best = i;
+  }
+  if (best < 0) return false;
+
+  const ntpServer& s = ntp.servers[best];
+  ntp.server = ntpServers[best];
+  ntp.offset = s.offset;
+  ntp.delay = s.delay;
+  ntp.updates++;
+
+  if (!ntp.set){
+    //  The requests were timed from micros(), so the offset is the epoch at that reference
+    ntp.reference = micros();
+    ntp.epoch = ntp.reference + s.offset;
+    ntp.slew = 0;
+    ntp.set = true;
+    ntp.steps++;
+    return true;
+  }
+
+  NtpMicros();
+  if (s.offset > NTP_STEP_THRESHOLD || s.offset < -NTP_STEP_THRESHOLD){
+    ntp.epoch += s.offset;
+    ntp.slew = 0;
+    ntp.steps++;
+    return true;
+  }
+
+  ntp.slew = s.offset;
+  return false;
+}
+
+bool NtpBegin(){
+  if (!ntp.pcb){
+    ntp.pcb = udp_new();
+    if (!ntp.pcb) return false;
+    if (udp_bind(ntp.pcb, IP_ADDR_ANY, 0) != ERR_OK){
+      udp_remove(ntp.pcb);
+      ntp.pcb = NULL;
+      return false;
+    }
+    udp_recv(ntp.pcb, NtpReceive, NULL);
+  }
+
+  NtpStartRound();
+  return true;
+}
+
+//  Runs the rounds and keeps TimeLib on the clock. True when the clock
+//  was stepped, so whatever was planned on it has to be planned again.
+bool NtpTick(){
+  bool stepped = false;
+
+  if (ntp.polling){
+    bool done = millis() - ntp.roundStarted >= NTP_REPLY_TIMEOUT;
+    if (!done){
+      done = true;
+      for (uint8_t i = 0; i < NTP_SERVER_COUNT; i++) if (ntp.servers[i].state != NTP_SERVER_DONE) done = false;
+    }
+    if (done) stepped = NtpEndRound();
+  }
+  else if (ntp.pcb && millis() - ntp.lastPoll >= (ntp.set ? NTP_POLL_INTERVAL : NTP_RETRY_INTERVAL)){
+    NtpStartRound();
+  }
+
+  if (!ntp.set) return false;
+
+  time_t second = NtpMicros() / 1000000;
+  if (stepped || second != ntp.fedSecond){
+    setTime(second);
+    ntp.fedSecond = second;
+  }
+  return stepped;
 }
 
 #endif
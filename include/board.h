@@ -0,0 +1,163 @@
+/*
+    board.h - LED channel layout of the board the firmware is built for
+
+    The light engine always works in RGBW. The board is selected at
+    compile time with one of the build flags below (see the envs in
+    platformio.ini) and decides how many PWM channels there are, on which
+    GPIOs, and how the engine colour is mapped onto them:
+
+      BOARD_MONO    1 channel   single colour, shows the brightness
+      BOARD_CCT     2 channels  warm and cold white
+      BOARD_RGB     3 channels  the white component is mixed from RGB,
+                                along the white point it was extracted with
+      BOARD_RGBW    4 channels  (default)
+      BOARD_RGBCCT  5 channels  RGB plus warm and cold white
+      BOARD_PIXEL_RGB   WS2812 pixel strip
+      BOARD_PIXEL_RGBW  SK6812 RGBW pixel strip
+
+    The pixel strip boards drive the strip through I2S DMA (pixelstrip.h)
+    instead of PWM. Their outputs are 8 bit, so the output stage dithers
+    to 8 bits instead of the PWM resolution.
+
+    On the boards with warm and cold white LEDs the white component is
+    split between them so that their mix is at the white temperature set
+    on the custom colour page.
+
+    Every table and loop is sized by LIGHT_CHANNEL_COUNT, a constant, so
+    the compiler can unroll them and a variant keeps no state for
+    channels it does not have.
+
+    The layout is a table of macros rather than a template over a list of
+    channel descriptors because the preprocessor needs it as well:
+    PWM_OUTPUT_BITS has to be set before calibration.h derives its limits
+    from it, LIGHT_PIXEL_STRIP decides whether pixelstrip.h and the I2S
+    output path are compiled at all, and LIGHT_CHANNEL_COUNT sizes plain
+    globals and structs (pwmOutputs, the realtime values, the jitter
+    buffer frames) in headers that know nothing of the board type.
+*/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <Arduino.h>
+
+//  What a channel shows
+#define CHANNEL_RED 0
+#define CHANNEL_GREEN 1
+#define CHANNEL_BLUE 2
+#define CHANNEL_WHITE 3
+#define CHANNEL_WARM_WHITE 4
+#define CHANNEL_COLD_WHITE 5
+#define CHANNEL_MONO 6
+
+//  The white LEDs of the CCT boards
+#define BOARD_WARM_WHITE_KELVIN 2700
+#define BOARD_COLD_WHITE_KELVIN 6500
+
+#if defined(BOARD_MONO)
+  #define LIGHT_CHANNEL_COUNT 1
+  #define LIGHT_CHANNELS { {12, "White", 0} }
+  #define LIGHT_CHANNEL_ROLES { CHANNEL_MONO }
+  #define LIGHT_HAS_RGB 0
+  #define LIGHT_HAS_WHITE 1
+#elif defined(BOARD_CCT)
+  #define LIGHT_CHANNEL_COUNT 2
+  #define LIGHT_CHANNELS { {12, "Warm white", 0}, {13, "Cold white", 0} }
+  #define LIGHT_CHANNEL_ROLES { CHANNEL_WARM_WHITE, CHANNEL_COLD_WHITE }
+  #define LIGHT_HAS_RGB 0
+  #define LIGHT_HAS_WHITE 1
+#elif defined(BOARD_RGB)
+  #define LIGHT_CHANNEL_COUNT 3
+  #define LIGHT_CHANNELS { {16, "Red", 0}, {12, "Green", 0}, {13, "Blue", 0} }
+  #define LIGHT_CHANNEL_ROLES { CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE }
+  #define LIGHT_HAS_RGB 1
+  #define LIGHT_HAS_WHITE 0
+#elif defined(BOARD_RGBCCT)
+  #define LIGHT_CHANNEL_COUNT 5
+  #define LIGHT_CHANNELS { {16, "Red", 0}, {12, "Green", 0}, {13, "Blue", 0}, {2, "Warm white", 0}, {14, "Cold white", 0} }
+  #define LIGHT_CHANNEL_ROLES { CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE, CHANNEL_WARM_WHITE, CHANNEL_COLD_WHITE }
+  #define LIGHT_HAS_RGB 1
+  #define LIGHT_HAS_WHITE 1
+#elif defined(BOARD_PIXEL_RGB)
+  #define LIGHT_CHANNEL_COUNT 3
+  #define LIGHT_CHANNELS { {3, "Red", 0}, {3, "Green", 0}, {3, "Blue", 0} }
+  #define LIGHT_CHANNEL_ROLES { CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE }
+  #define LIGHT_HAS_RGB 1
+  #define LIGHT_HAS_WHITE 0
+  #define LIGHT_PIXEL_STRIP
+  #define PWM_OUTPUT_BITS 8
+#elif defined(BOARD_PIXEL_RGBW)
+  #define LIGHT_CHANNEL_COUNT 4
+  #define LIGHT_CHANNELS { {3, "Red", 0}, {3, "Green", 0}, {3, "Blue", 0}, {3, "White", 0} }
+  #define LIGHT_CHANNEL_ROLES { CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE, CHANNEL_WHITE }
+  #define LIGHT_HAS_RGB 1
+  #define LIGHT_HAS_WHITE 1
+  #define LIGHT_PIXEL_STRIP
+  #define PWM_OUTPUT_BITS 8
+#else   //  BOARD_RGBW
+  #define LIGHT_CHANNEL_COUNT 4
+  #define LIGHT_CHANNELS { {16, "Red", 0}, {12, "Green", 0}, {13, "Blue", 0}, {2, "White", 0} }
+  #define LIGHT_CHANNEL_ROLES { CHANNEL_RED, CHANNEL_GREEN, CHANNEL_BLUE, CHANNEL_WHITE }
+  #define LIGHT_HAS_RGB 1
+  #define LIGHT_HAS_WHITE 1
+#endif
+
+const uint8_t LightChannelRoles[LIGHT_CHANNEL_COUNT] = LIGHT_CHANNEL_ROLES;
+
+//  Share of the cold white LED in a white of kelvin, Q16
+uint16_t ColdWhiteShare(uint16_t kelvin){
+  if (kelvin <= BOARD_WARM_WHITE_KELVIN) return 0;
+  if (kelvin >= BOARD_COLD_WHITE_KELVIN) return 65535;
+  return ((uint32_t)(kelvin - BOARD_WARM_WHITE_KELVIN) << 16) / (BOARD_COLD_WHITE_KELVIN - BOARD_WARM_WHITE_KELVIN);
+}
+
+//  The RGB mix the white of the engine is shown with on a board without a
+//  white LED, Q16 per channel. SetWhitePoint() (rgbw.h) sets it to the white
+//  point the white was extracted along.
+uint32_t whiteMix[3] = { 65536, 65536, 65536 };
+
+//  The share of the white mixed into an RGB channel, none when there is a white LED
+int32_t MixedWhite(int32_t white, uint8_t channel){
+  return LIGHT_HAS_WHITE ? 0 : ((int64_t)white * whiteMix[channel]) >> 16;
+}
+
+//  Engine colour (R, G, B, W) to the channels of the board, clamped to 0..max.
+//  A board without RGB LEDs shows the brightness of the colour.
+void MapLightChannels(const int32_t in[4], int32_t out[LIGHT_CHANNEL_COUNT], uint16_t coldShare, int32_t max){
+  int32_t white = in[3];
+  if (!LIGHT_HAS_RGB) white += ((int64_t)in[0] * 54 + (int64_t)in[1] * 183 + (int64_t)in[2] * 19) >> 8;
+
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    int32_t v;
+    switch (LightChannelRoles[i]){
+      case CHANNEL_RED:   v = in[0] + MixedWhite(in[3], 0); break;
+      case CHANNEL_GREEN: v = in[1] + MixedWhite(in[3], 1); break;
+      case CHANNEL_BLUE:  v = in[2] + MixedWhite(in[3], 2); break;
+      case CHANNEL_WARM_WHITE: v = ((int64_t)white * (65536 - coldShare)) >> 16; break;
+      case CHANNEL_COLD_WHITE: v = ((int64_t)white * coldShare) >> 16; break;
+      default: v = white; break;
+    }
+
+    if (v < 0) v = 0;
+    if (v > max) v = max;
+    out[i] = v;
+  }
+}
+
+//  Channel values of the board back to an engine colour, the whites summed up
+void UnmapLightChannels(const int32_t in[LIGHT_CHANNEL_COUNT], int32_t out[4], int32_t max){
+  out[0] = out[1] = out[2] = out[3] = 0;
+
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    switch (LightChannelRoles[i]){
+      case CHANNEL_RED:   out[0] = in[i]; break;
+      case CHANNEL_GREEN: out[1] = in[i]; break;
+      case CHANNEL_BLUE:  out[2] = in[i]; break;
+      default: out[3] += in[i]; break;
+    }
+  }
+
+  if (out[3] > max) out[3] = max;
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+    calibration.h - Per channel colour correction in the output stage
+
+    Every output value is the dot product of a row of a 4x4 matrix with
+    the (R, G, B, W) values coming from the light engine, then scaled by
+    a global brightness and a fine dimming level. The matrix is in Q12
+    (4096 = 1.0), so a row can both trim its own channel and compensate
+    cross-talk from the others. Integer multiply-accumulate only.
+
+    The PWM runs at PWM_OUTPUT_BITS, more than the 10 bits of the light
+    engine, and the result keeps CALIBRATION_FRACTION_BITS below that.
+    Those are dithered away in the output stage, so slow fades of the
+    dimming level do not step at low brightness.
+*/
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <Arduino.h>
+#include "board.h"
+
+#define CALIBRATION_CHANNELS 4
+#define CALIBRATION_UNITY 4096
+#define MASTER_BRIGHTNESS_MAX 255
+#define OUTPUT_LEVEL_MAX 65535
+
+//  The ESP8266 waveform generator times pulses in CPU cycles, 12 bits at
+//  the default 1 kHz still leaves about 20 cycles per step. Pixel strip
+//  boards set their own in board.h.
+#ifndef PWM_OUTPUT_BITS
+#define PWM_OUTPUT_BITS 12
+#endif
+#define PWM_OUTPUT_MAX ((1 << PWM_OUTPUT_BITS) - 1)
+#define CALIBRATION_FRACTION_BITS 8
+#define CALIBRATION_MAX_OUTPUT ((int32_t)PWM_OUTPUT_MAX << CALIBRATION_FRACTION_BITS)
+
+void CalibrationIdentity(int16_t matrix[CALIBRATION_CHANNELS][CALIBRATION_CHANNELS]){
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS; i++)
+    for (uint8_t j = 0; j < CALIBRATION_CHANNELS; j++)
+      matrix[i][j] = (i == j) ? CALIBRATION_UNITY : 0;
+}
+
+//  in is 0..1023, level is Q16, out is in PWM steps with CALIBRATION_FRACTION_BITS fraction bits
+void ApplyCalibration(const int16_t matrix[CALIBRATION_CHANNELS][CALIBRATION_CHANNELS], uint8_t brightness, uint16_t level, const uint16_t in[CALIBRATION_CHANNELS], int32_t out[CALIBRATION_CHANNELS]){
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS; i++) {
+    int32_t acc = 0;
+    for (uint8_t j = 0; j < CALIBRATION_CHANNELS; j++) acc += (int32_t)matrix[i][j] * in[j];
+
+    //  Q12 times 10 bits to PWM_OUTPUT_BITS plus the fraction
+    acc >>= 12 - (PWM_OUTPUT_BITS - 10) - CALIBRATION_FRACTION_BITS;
+
+    //  Full brightness and level must pass full scale through untouched, zero must be dark
+    acc = ((int64_t)acc * (brightness + (brightness >> 7)) * ((uint32_t)level + (level >> 15))) >> 24;
+
+    if (acc < 0) acc = 0;
+    if (acc > CALIBRATION_MAX_OUTPUT) acc = CALIBRATION_MAX_OUTPUT;
+    out[i] = acc;
+  }
+}
+
+//  Error diffusion over time for the fraction bits of the output stage:
+//  what is rounded away in one tick is added to the next one. Works on
+//  the channels of the board, after MapLightChannels.
+struct outputDither{
+  int32_t error[LIGHT_CHANNEL_COUNT];
+};
+
+void DitherOutputs(outputDither& d, const int32_t in[LIGHT_CHANNEL_COUNT], uint16_t out[LIGHT_CHANNEL_COUNT]){
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    int32_t v = in[i] + d.error[i];
+    int32_t steps = v >> CALIBRATION_FRACTION_BITS;
+    if (steps > PWM_OUTPUT_MAX) steps = PWM_OUTPUT_MAX;
+    if (steps < 0) steps = 0;
+    d.error[i] = v - (steps << CALIBRATION_FRACTION_BITS);
+    out[i] = steps;
+  }
+}
+
+//  Rounds without carrying the error, for outputs that are held between slow ticks
+void RoundOutputs(const int32_t in[LIGHT_CHANNEL_COUNT], uint16_t out[LIGHT_CHANNEL_COUNT]){
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    int32_t steps = (in[i] + (1 << (CALIBRATION_FRACTION_BITS - 1))) >> CALIBRATION_FRACTION_BITS;
+    if (steps > PWM_OUTPUT_MAX) steps = PWM_OUTPUT_MAX;
+    if (steps < 0) steps = 0;
+    out[i] = steps;
+  }
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+    circadian.h - Circadian lighting program
+
+    The light follows a 24 hour curve of colour temperature and
+    brightness stored in appConfig.circadianCurve: up to CIRCADIAN_POINTS
+    points sorted by time of day, joined by straight lines and wrapping
+    around midnight. Every tick finds the segment for the local time of
+    day with a binary search and interpolates it in Q16, then renders the
+    colour temperature through the white point table of rgbw.h.
+*/
+
+#ifndef CIRCADIAN_H
+#define CIRCADIAN_H
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include "rgbw.h"
+
+#define CIRCADIAN_MINUTES_PER_DAY 1440
+
+//  Warm and dim in the morning and evening, cool and bright at midday
+const circadianPoint DefaultCircadianCurve[] PROGMEM = {
+  {  360, 2700,  40 },
+  {  480, 3500, 160 },
+  {  660, 5500, 255 },
+  {  900, 5000, 230 },
+  { 1080, 3500, 160 },
+  { 1260, 2700,  60 },
+  { 1380, 2200,  20 }
+};
+
+void CircadianDefaults(circadianPoint curve[], uint8_t& count){
+  count = sizeof(DefaultCircadianCurve) / sizeof(DefaultCircadianCurve[0]);
+  memcpy_P(curve, DefaultCircadianCurve, sizeof(DefaultCircadianCurve));
+}
+
+//  Insertion sort by time of day, the curve is only a few points long
+void SortCircadianCurve(circadianPoint curve[], uint8_t count){
+  for (uint8_t i = 1; i < count; i++) {
+    circadianPoint p = curve[i];
+    int8_t j = i - 1;
+    while (j >= 0 && curve[j].minute > p.minute){
+      curve[j + 1] = curve[j];
+      j--;
+    }
+    curve[j + 1] = p;
+  }
+}
+
+//  Index of the last point at or before second of the day, the last point if
+//  the time is before the first one (the segment that wraps around midnight)
+uint8_t FindCircadianSegment(const circadianPoint curve[], uint8_t count, uint32_t second){
+  uint8_t lo = 0, hi = count;
+  while (lo < hi){
+    uint8_t mid = (lo + hi) / 2;
+    if ((uint32_t)curve[mid].minute * 60 <= second) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo ? lo - 1 : count - 1;
+}
+
+//  Colour temperature and level 0..255 at a second of the day
+void EvaluateCircadianCurve(const circadianPoint curve[], uint8_t count, uint32_t second, uint16_t& kelvin, uint8_t& level){
+  uint8_t i = FindCircadianSegment(curve, count, second);
+  const circadianPoint& from = curve[i];
+  const circadianPoint& to = curve[(i + 1) % count];
+
+  uint32_t start = (uint32_t)from.minute * 60;
+  uint32_t span = (((uint32_t)to.minute + CIRCADIAN_MINUTES_PER_DAY - from.minute - 1) % CIRCADIAN_MINUTES_PER_DAY + 1) * 60;
+  uint32_t elapsed = (second + SECS_PER_DAY - start) % SECS_PER_DAY;
+
+  uint16_t t = elapsed >= span ? 65535 : ((uint64_t)elapsed << 16) / span;
+
+  kelvin = lerp16(from.kelvin, to.kelvin, t);
+  level = lerp16(from.level, to.level, t);
+}
+
+class CircadianEffect{
+  public:
+    static const char Name[];
+
+    static void Init(effectState& state, const effectParams& params){
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      if (appConfig.circadianPointCount == 0){
+        out = state.base;
+        return;
+      }
+
+      time_t localTime = ToLocalTime(appConfig.timeZone, now());
+
+      uint16_t kelvin;
+      uint8_t level;
+      EvaluateCircadianCurve(appConfig.circadianCurve, appConfig.circadianPointCount, numberOfSecondsSinceMidnight(localTime), kelvin, level);
+
+      out = KelvinToRgbw(kelvin, GammaLevel(level));
+    }
+};
+const char CircadianEffect::Name[] PROGMEM = "Circadian";
+
+#endif
@@ -0,0 +1,277 @@
+/*
+    colourspace.h - Fixed point colour space conversions
+
+    All colours handled here are linear light values in the range of the
+    PWM outputs (0..COLOUR_MAX). The ESP8266 has no FPU, so everything is
+    done in integer arithmetic:
+
+      - HSV:   hue 0..HUE_MAX-1 (six 256-step sectors), saturation and
+               value 0..255
+      - OKLab: L, a and b in Q12 (4096 = 1.0), see
+               https://bottosson.github.io/posts/oklab/
+
+    The cube root needed by OKLab is table-assisted: the argument is
+    normalised into [1/8, 1) in steps of 8 and looked up with linear
+    interpolation.
+*/
+
+#ifndef COLOURSPACE_H
+#define COLOURSPACE_H
+
+#include <Arduino.h>
+
+#define COLOUR_MAX 1023
+#define HUE_MAX 1536
+
+#define COLOUR_INTERPOLATION_HUE 0
+#define COLOUR_INTERPOLATION_OKLAB 1
+
+struct rgbColour{
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
+};
+
+struct hsvColour{
+  uint16_t h;
+  uint8_t s;
+  uint8_t v;
+};
+
+struct oklabColour{
+  int32_t L;
+  int32_t a;
+  int32_t b;
+};
+
+//  cbrt(x) for x = 0.125 .. 1.0 in 1/64 steps, Q12
+const uint16_t CbrtTable[57] PROGMEM = {
+  2048, 2130, 2206, 2277, 2344, 2408, 2468, 2525, 2580, 2633, 2684, 2732,
+  2780, 2825, 2869, 2912, 2954, 2994, 3034, 3072, 3109, 3146, 3182, 3217,
+  3251, 3285, 3317, 3350, 3381, 3412, 3443, 3473, 3502, 3531, 3559, 3587,
+  3615, 3642, 3669, 3695, 3721, 3747, 3772, 3797, 3822, 3846, 3870, 3894,
+  3918, 3941, 3964, 3986, 4009, 4031, 4053, 4075, 4096 };
+
+//  OKLab matrices, Q14
+const int32_t OklabM1[3][3] PROGMEM = {
+  {  6754,   8787,    843 },
+  {  3472,  11153,   1760 },
+  {  1447,   4616,  10322 } };
+
+const int32_t OklabM2[3][3] PROGMEM = {
+  {  3448,  13003,    -67 },
+  { 32408, -39790,   7383 },
+  {   424,  12825, -13249 } };
+
+const int32_t OklabM2Inv[3][3] PROGMEM = {
+  { 16384,   6494,   3536 },
+  { 16384,  -1730,  -1046 },
+  { 16384,  -1466, -21160 } };
+
+const int32_t OklabM1Inv[3][3] PROGMEM = {
+  {  66793, -54194,   3784 },
+  { -20782,  42758,  -5592 },
+  {    -69, -11525,  27978 } };
+
+inline uint16_t clampColour(int32_t v){
+  if (v < 0) return 0;
+  if (v > COLOUR_MAX) return COLOUR_MAX;
+  return v;
+}
+
+//  Cube root of a Q12 value (0 .. 4096), result in Q12
+int32_t cbrtQ12(int32_t x){
+  if (x <= 0) return 0;
+  if (x >= 4096) return 4096;
+
+  uint8_t shift = 0;
+  while (x < 512){
+    x <<= 3;
+    shift++;
+  }
+
+  uint16_t index = (x - 512) >> 6;
+  int32_t frac = (x - 512) & 63;
+  int32_t lo = pgm_read_word(&CbrtTable[index]);
+  int32_t hi = (index < 56) ? pgm_read_word(&CbrtTable[index + 1]) : lo;
+
+  return (lo + (((hi - lo) * frac) >> 6)) >> shift;
+}
+
+void multiplyQ14(const int32_t m[3][3], const int32_t in[3], int32_t out[3]){
+  for (uint8_t i = 0; i < 3; i++) {
+    out[i] = ( (int32_t)pgm_read_dword(&m[i][0]) * in[0] +
+               (int32_t)pgm_read_dword(&m[i][1]) * in[1] +
+               (int32_t)pgm_read_dword(&m[i][2]) * in[2] ) >> 14;
+  }
+}
+
+hsvColour RgbToHsv(rgbColour c){
+  hsvColour hsv;
+
+  uint16_t max = c.r > c.g ? (c.r > c.b ? c.r : c.b) : (c.g > c.b ? c.g : c.b);
+  uint16_t min = c.r < c.g ? (c.r < c.b ? c.r : c.b) : (c.g < c.b ? c.g : c.b);
+  uint16_t delta = max - min;
+
+  hsv.v = ((uint32_t)max * 255) / COLOUR_MAX;
+
+  if (max == 0 || delta == 0){
+    hsv.h = 0;
+    hsv.s = 0;
+    return hsv;
+  }
+
+  hsv.s = ((uint32_t)delta * 255) / max;
+
+  int32_t h;
+  if (max == c.r)
+    h = ((int32_t)(c.g - c.b) * 256) / delta;
+  else if (max == c.g)
+    h = 512 + ((int32_t)(c.b - c.r) * 256) / delta;
+  else
+    h = 1024 + ((int32_t)(c.r - c.g) * 256) / delta;
+
+  if (h < 0) h += HUE_MAX;
+  hsv.h = h % HUE_MAX;
+
+  return hsv;
+}
+
+rgbColour HsvToRgb(hsvColour hsv){
+  rgbColour c;
+
+  uint16_t h = hsv.h % HUE_MAX;
+  uint8_t sector = h >> 8;
+  uint32_t frac = h & 0xFF;
+
+  uint32_t v = ((uint32_t)hsv.v * COLOUR_MAX) / 255;
+  uint32_t p = (v * (255 - hsv.s)) / 255;
+  uint32_t q = (v * (65025 - hsv.s * frac)) / 65025;
+  uint32_t t = (v * (65025 - hsv.s * (255 - frac))) / 65025;
+
+  switch (sector) {
+    case 0:  c.r = v; c.g = t; c.b = p; break;
+    case 1:  c.r = q; c.g = v; c.b = p; break;
+    case 2:  c.r = p; c.g = v; c.b = t; break;
+    case 3:  c.r = p; c.g = q; c.b = v; break;
+    case 4:  c.r = t; c.g = p; c.b = v; break;
+    default: c.r = v; c.g = p; c.b = q; break;
+  }
+
+  return c;
+}
+
+oklabColour RgbToOklab(rgbColour c){
+  //  10 bit linear to Q12
+  int32_t rgb[3] = { (int32_t)c.r * 4096 / COLOUR_MAX, (int32_t)c.g * 4096 / COLOUR_MAX, (int32_t)c.b * 4096 / COLOUR_MAX };
+  int32_t lms[3], lab[3];
+
+  multiplyQ14(OklabM1, rgb, lms);
+  for (uint8_t i = 0; i < 3; i++) lms[i] = cbrtQ12(lms[i]);
+  multiplyQ14(OklabM2, lms, lab);
+
+  oklabColour o = { lab[0], lab[1], lab[2] };
+  return o;
+}
+
+rgbColour OklabToRgb(oklabColour o){
+  int32_t lab[3] = { o.L, o.a, o.b };
+  int32_t lms[3], rgb[3];
+
+  multiplyQ14(OklabM2Inv, lab, lms);
+  for (uint8_t i = 0; i < 3; i++){
+    if (lms[i] < 0) lms[i] = 0;
+    lms[i] = ((lms[i] * lms[i]) >> 12) * lms[i] >> 12;
+  }
+  multiplyQ14(OklabM1Inv, lms, rgb);
+
+  rgbColour c = {
+    clampColour((rgb[0] * COLOUR_MAX + 2048) >> 12),
+    clampColour((rgb[1] * COLOUR_MAX + 2048) >> 12),
+    clampColour((rgb[2] * COLOUR_MAX + 2048) >> 12) };
+  return c;
+}
+
+//  Linear interpolation between a and b, t = 0..65535
+inline int32_t lerp16(int32_t a, int32_t b, uint16_t t){
+  return a + (((b - a) * (int32_t)t) >> 16);
+}
+
+//  Interpolates along the shorter arc of the hue wheel
+hsvColour HsvLerp(hsvColour from, hsvColour to, uint16_t t){
+  int32_t dh = (int32_t)to.h - from.h;
+  if (dh > HUE_MAX / 2) dh -= HUE_MAX;
+  if (dh < -HUE_MAX / 2) dh += HUE_MAX;
+
+  //  A grey end point has no hue of its own, so borrow the other one
+  if (from.s == 0) dh = 0, from.h = to.h;
+  if (to.s == 0) dh = 0;
+
+  int32_t h = from.h + ((dh * (int32_t)t) >> 16);
+  if (h < 0) h += HUE_MAX;
+
+  hsvColour c;
+  c.h = h % HUE_MAX;
+  c.s = lerp16(from.s, to.s, t);
+  c.v = lerp16(from.v, to.v, t);
+  return c;
+}
+
+oklabColour OklabLerp(oklabColour from, oklabColour to, uint16_t t){
+  oklabColour c = { lerp16(from.L, to.L, t), lerp16(from.a, to.a, t), lerp16(from.b, to.b, t) };
+  return c;
+}
+
+//  A fade between two colours, advanced once per light engine tick
+struct colourFade{
+  rgbColour from;
+  rgbColour to;
+  hsvColour fromHsv;
+  hsvColour toHsv;
+  oklabColour fromLab;
+  oklabColour toLab;
+  uint8_t mode;
+  uint16_t position;
+  uint16_t steps;
+  bool active;
+};
+
+void ColourFadeStart(colourFade& fade, rgbColour from, rgbColour to, uint16_t steps, uint8_t mode){
+  fade.from = from;
+  fade.to = to;
+  fade.mode = mode;
+  fade.position = 0;
+  fade.steps = steps ? steps : 1;
+  fade.active = true;
+
+  if (mode == COLOUR_INTERPOLATION_OKLAB){
+    fade.fromLab = RgbToOklab(from);
+    fade.toLab = RgbToOklab(to);
+  }
+  else{
+    fade.fromHsv = RgbToHsv(from);
+    fade.toHsv = RgbToHsv(to);
+  }
+}
+
+//  Returns false once the fade has reached its target
+bool ColourFadeStep(colourFade& fade, rgbColour& out){
+  if (!fade.active) return false;
+
+  if (++fade.position >= fade.steps){
+    fade.active = false;
+    out = fade.to;
+    return false;
+  }
+
+  uint16_t t = ((uint32_t)fade.position << 16) / fade.steps;
+
+  if (fade.mode == COLOUR_INTERPOLATION_OKLAB)
+    out = OklabToRgb(OklabLerp(fade.fromLab, fade.toLab, t));
+  else
+    out = HsvToRgb(HsvLerp(fade.fromHsv, fade.toHsv, t));
+
+  return true;
+}
+
+#endif
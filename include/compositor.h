@@ -0,0 +1,136 @@
+/*
+    compositor.h - Blends light sources into the output colour
+
+    Two program layers: while a transition runs, the outgoing and the
+    incoming program are both rendered every tick and crossfaded over the
+    transition time. A new transition started while one is still running
+    freezes the current mix into a fixed colour and fades from there, so
+    the output never jumps.
+
+    On top of that sits an overlay layer, e.g. a notification flash, that
+    is blended over whatever the programs render and removes itself when
+    it is done.
+
+    Blending is done on linear channel values with a Q16 mix factor.
+*/
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <Arduino.h>
+#include "effects.h"
+
+struct compositorLayer{
+  uint8_t program;
+  effectParams params;
+  effectState state;
+};
+
+struct compositor{
+  compositorLayer layers[2];
+  uint8_t incoming;             //  index of the layer being faded in, the other one is outgoing
+  uint32_t transitionTime;      //  ms
+  uint32_t transitionElapsed;   //  ms
+  bool transitioning;
+  rgbwColour output;            //  last composited colour
+
+  rgbwColour overlayColour;
+  uint8_t overlayAlpha;         //  0..255
+  uint16_t overlayPeriod;       //  ms, one flash is half a period on and half off
+  uint16_t overlayCount;        //  flashes left, 0 when there is no overlay
+  uint32_t overlayElapsed;      //  ms within the current period
+};
+
+//  Mixes b over a, t = 0..65535
+rgbwColour BlendRgbw(rgbwColour a, rgbwColour b, uint16_t t){
+  rgbwColour out = {
+    (uint16_t)lerp16(a.r, b.r, t),
+    (uint16_t)lerp16(a.g, b.g, t),
+    (uint16_t)lerp16(a.b, b.b, t),
+    (uint16_t)lerp16(a.w, b.w, t) };
+  return out;
+}
+
+void CompositorInitLayer(compositorLayer& layer, uint8_t program, const effectParams& params, rgbwColour base, uint16_t tickMs){
+  layer.program = program;
+  layer.params = params;
+  EffectInit(program, layer.state, params, base, tickMs);
+}
+
+//  Starts a program without a transition
+void CompositorStart(compositor& c, uint8_t program, const effectParams& params, rgbwColour base, uint16_t tickMs){
+  c.incoming = 0;
+  c.transitioning = false;
+  c.overlayCount = 0;
+  c.output = base;
+  CompositorInitLayer(c.layers[0], program, params, base, tickMs);
+}
+
+//  Crossfades from whatever is showing now to a program
+void CompositorTransition(compositor& c, uint8_t program, const effectParams& params, rgbwColour base, uint16_t tickMs, uint32_t durationMs){
+  if (c.transitioning){
+    //  Freeze the current mix, the old outgoing layer is dropped
+    effectParams none = { 0, 0, 0 };
+    CompositorInitLayer(c.layers[c.incoming], 0, none, c.output, tickMs);
+  }
+
+  c.incoming ^= 1;
+  CompositorInitLayer(c.layers[c.incoming], program, params, base, tickMs);
+
+  c.transitionTime = durationMs;
+  c.transitionElapsed = 0;
+  c.transitioning = durationMs >= tickMs;
+
+  //  A transition shorter than a tick is a cut
+}
+
+//  Lets the running program follow a new base colour without restarting it
+void CompositorSetBase(compositor& c, rgbwColour base){
+  c.layers[c.incoming].state.base = base;
+}
+
+void CompositorFlash(compositor& c, rgbwColour colour, uint8_t alpha, uint16_t count, uint16_t periodMs){
+  c.overlayColour = colour;
+  c.overlayAlpha = alpha;
+  c.overlayCount = count;
+  c.overlayPeriod = periodMs ? periodMs : 1;
+  c.overlayElapsed = 0;
+}
+
+uint8_t CompositorProgram(const compositor& c){
+  return c.layers[c.incoming].program;
+}
+
+void CompositorTick(compositor& c, rgbwColour& out){
+  compositorLayer& in = c.layers[c.incoming];
+  EffectTick(in.program, in.state, in.params, out);
+
+  if (c.transitioning){
+    compositorLayer& old = c.layers[c.incoming ^ 1];
+    rgbwColour previous;
+    EffectTick(old.program, old.state, old.params, previous);
+
+    c.transitionElapsed += in.state.tickMs;
+    if (c.transitionElapsed >= c.transitionTime){
+      c.transitioning = false;
+    }
+    else{
+      out = BlendRgbw(previous, out, ((uint64_t)c.transitionElapsed << 16) / c.transitionTime);
+    }
+  }
+
+  c.output = out;
+
+  if (c.overlayCount){
+    if (c.overlayElapsed < c.overlayPeriod / 2)
+      out = BlendRgbw(out, c.overlayColour, ((uint32_t)c.overlayAlpha << 8) | c.overlayAlpha);
+
+    c.overlayElapsed += in.state.tickMs;
+    if (c.overlayElapsed >= c.overlayPeriod){
+      c.overlayElapsed = 0;
+      c.overlayCount--;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,218 @@
+/*
+    connectivity.h - Asynchronous reachability probes
+
+    Two things are tracked separately once the WiFi is up:
+
+      - the Internet, probed by resolving a name (the NTP server) through
+        DNS,
+      - the MQTT broker, probed by opening a TCP connection to it, after
+        resolving its name if it is not an address. While the MQTT
+        client is connected that already proves it, so nothing is sent.
+
+    A probe is started with the lwIP raw API and returns at once; the
+    result comes in through the lwIP callbacks. Probes run every
+    CONNECTIVITY_PROBE_INTERVAL, or after CONNECTIVITY_RETRY_INTERVAL
+    while the target is down, and one that gets no answer within
+    CONNECTIVITY_PROBE_TIMEOUT counts as down. A result is only trusted
+    for CONNECTIVITY_PROBE_TTL, after that the state is unknown again.
+
+    Nothing on the LAN waits for the Internet: a node with a local
+    broker and no Internet works fully, it just never sets its clock.
+
+    lwIP caches DNS answers for their TTL, so the Internet probe can come
+    back from the cache and does not always leave the LAN.
+*/
+
+#ifndef CONNECTIVITY_H
+#define CONNECTIVITY_H
+
+#include <Arduino.h>
+#include <lwip/dns.h>
+#include <lwip/tcp.h>
+
+#define REACHABILITY_UNKNOWN 0
+#define REACHABILITY_UP 1
+#define REACHABILITY_DOWN 2
+
+#define PROBE_IDLE 0
+#define PROBE_RESOLVING 1
+#define PROBE_CONNECTING 2
+
+struct reachabilityProbe{
+  uint8_t result;         //  REACHABILITY_...
+  uint8_t stage;          //  PROBE_...
+  uint8_t generation;     //  tells the callbacks of a timed out probe apart
+  bool connect;           //  TCP probe, after the name is resolved
+  uint16_t port;
+  ip_addr_t address;
+  tcp_pcb* pcb;
+  uint32_t started;       //  millis() of the probe running
+  uint32_t checked;       //  millis() of the last result
+  uint32_t latency;       //  ms the last successful probe took
+  uint32_t failures;      //  in a row
+};
+
+reachabilityProbe internetProbe;
+reachabilityProbe brokerProbe;
+
+void FinishProbe(reachabilityProbe& p, bool up){
+  p.stage = PROBE_IDLE;
+  p.generation++;
+  p.result = up ? REACHABILITY_UP : REACHABILITY_DOWN;
+  p.checked = millis();
+  if (up){
+    p.latency = p.checked - p.started;
+    p.failures = 0;
+  }
+  else p.failures++;
+}
+
+//  The result, unknown once it is older than the TTL
+uint8_t Reachability(const reachabilityProbe& p){
+  if (p.result == REACHABILITY_UNKNOWN || millis() - p.checked > CONNECTIVITY_PROBE_TTL) return REACHABILITY_UNKNOWN;
+  return p.result;
+}
+
+//  The callbacks get the probe and its generation packed in their argument
+void* ProbeArgument(reachabilityProbe& p){
+  return (void*)(((uintptr_t)(&p == &brokerProbe) << 8) | p.generation);
+}
+
+reachabilityProbe* ProbeFromArgument(void* arg){
+  reachabilityProbe* p = ((uintptr_t)arg >> 8) ? &brokerProbe : &internetProbe;
+  return p->stage != PROBE_IDLE && p->generation == (uint8_t)(uintptr_t)arg ? p : NULL;
+}
+
+err_t ProbeConnected(void* arg, tcp_pcb* pcb, err_t err){
+  reachabilityProbe* p = ProbeFromArgument(arg);
+  tcp_arg(pcb, NULL);
+  tcp_err(pcb, NULL);
+  tcp_abort(pcb);
+  if (p){
+    p->pcb = NULL;
+    FinishProbe(*p, true);
+  }
+  return ERR_ABRT;
+}
+
+//  Refused, reset or unreachable, lwIP has already freed the pcb
+void ProbeError(void* arg, err_t err){
+  reachabilityProbe* p = ProbeFromArgument(arg);
+  if (!p) return;
+  p->pcb = NULL;
+  FinishProbe(*p, false);
+}
+
+void ConnectProbe(reachabilityProbe& p){
+  p.stage = PROBE_CONNECTING;
+  p.pcb = tcp_new();
+  if (!p.pcb){
+    FinishProbe(p, false);
+    return;
+  }
+
+  tcp_arg(p.pcb, ProbeArgument(p));
+  tcp_err(p.pcb, ProbeError);
+  if (tcp_connect(p.pcb, &p.address, p.port, ProbeConnected) != ERR_OK){
+    tcp_arg(p.pcb, NULL);
+    tcp_err(p.pcb, NULL);
+    tcp_abort(p.pcb);
+    p.pcb = NULL;
+    FinishProbe(p, false);
+  }
+}
+
+void ProbeResolved(reachabilityProbe& p, bool found){
+  if (!found) FinishProbe(p, false);
+  else if (p.connect) ConnectProbe(p);
+  else FinishProbe(p, true);
+}
+
+void ProbeDnsFound(const char* name, const ip_addr_t* address, void* arg){
+  reachabilityProbe* p = ProbeFromArgument(arg);
+  if (!p) return;
+  if (address) p->address = *address;
+  ProbeResolved(*p, address != NULL);
+}
+
+//  Resolves host, then connects to port if it is not 0
+void StartProbe(reachabilityProbe& p, const char* host, uint16_t port){
+  p.started = millis();
+  p.generation++;
+  p.connect = port != 0;
+  p.port = port;
+
+  if (p.connect && ipaddr_aton(host, &p.address)){
+    ConnectProbe(p);
+    return;
+  }
+
+  p.stage = PROBE_RESOLVING;
+  err_t err = dns_gethostbyname(host, &p.address, ProbeDnsFound, ProbeArgument(p));
+  if (err == ERR_OK) ProbeResolved(p, true);
+  else if (err != ERR_INPROGRESS) FinishProbe(p, false);
+}
+
+void AbortProbe(reachabilityProbe& p){
+  if (p.pcb){
+    tcp_arg(p.pcb, NULL);
+    tcp_err(p.pcb, NULL);
+    tcp_abort(p.pcb);
+    p.pcb = NULL;
+  }
+  p.stage = PROBE_IDLE;
+  p.generation++;
+}
+
+//  For a user of the target that found it down, it is probed again after the retry interval
+void ReportUnreachable(reachabilityProbe& p){
+  AbortProbe(p);
+  FinishProbe(p, false);
+}
+
+//  Times the running probe out, or starts a new one when it is due
+void PollProbe(reachabilityProbe& p, const char* host, uint16_t port){
+  uint32_t now = millis();
+
+  if (p.stage != PROBE_IDLE){
+    if (now - p.started >= CONNECTIVITY_PROBE_TIMEOUT){
+      AbortProbe(p);
+      FinishProbe(p, false);
+    }
+    return;
+  }
+
+  uint32_t interval = p.result == REACHABILITY_UP ? CONNECTIVITY_PROBE_INTERVAL : CONNECTIVITY_RETRY_INTERVAL;
+  if (p.result == REACHABILITY_UNKNOWN || now - p.checked >= interval) StartProbe(p, host, port);
+}
+
+//  Called regularly while the WiFi is up. brokerConnected saves the broker probe.
+void PollConnectivity(const char* internetHost, const char* broker, uint16_t brokerPort, bool brokerConnected){
+  PollProbe(internetProbe, internetHost, 0);
+
+  if (brokerConnected){
+    AbortProbe(brokerProbe);
+    brokerProbe.result = REACHABILITY_UP;
+    brokerProbe.checked = millis();
+    brokerProbe.failures = 0;
+  }
+  else PollProbe(brokerProbe, broker, brokerPort);
+}
+
+//  The WiFi dropped, nothing is known any more
+void ResetConnectivity(){
+  AbortProbe(internetProbe);
+  AbortProbe(brokerProbe);
+  internetProbe.result = REACHABILITY_UNKNOWN;
+  brokerProbe.result = REACHABILITY_UNKNOWN;
+}
+
+String ReachabilityToString(const reachabilityProbe& p){
+  switch (Reachability(p)){
+    case REACHABILITY_UP: return "Reachable (" + String(p.latency) + " ms, checked " + String((millis() - p.checked) / 1000) + " s ago)";
+    case REACHABILITY_DOWN: return "Unreachable (" + String(p.failures) + " failed probes)";
+    default: return "Unknown";
+  }
+}
+
+#endif
@@ -23,8 +23,14 @@
 #define DEBUG_MQTT_SERVER "192.168.1.99"
 
 
-#define WIFI_CONNECTION_TIMEOUT 60
+#define WIFI_CONNECTION_TIMEOUT 60   //  s
+#define WIFI_REUSE_LEASE false        //  reuse the DHCP lease kept in RTC memory once after a reset
 #define ACCESS_POINT_TIMEOUT 300000
+#define CONNECTIVITY_TASK_PERIOD 500000   //  us
+#define CONNECTIVITY_PROBE_INTERVAL 60000   //  ms
+#define CONNECTIVITY_RETRY_INTERVAL 10000   //  ms, while down
+#define CONNECTIVITY_PROBE_TIMEOUT 5000     //  ms
+#define CONNECTIVITY_PROBE_TTL 180000       //  ms a result is trusted for
 
 #define OTA_BLINKING_RATE 3
 
@@ -32,11 +38,10 @@
 #define DEFAULT_MQTT_SERVER "test.mosquitto.org"
 #define DEFAULT_MQTT_PORT 1883
 #define DEFAULT_MQTT_TOPIC  "vnode"
+#define DEFAULT_SYSLOG_PORT 514
 #define DEFAULT_HEARTBEAT_INTERVAL 300
 #define NODE_DEFAULT_FRIENDLY_NAME "vNode"
 
-#define NTP_REFRESH_INTERVAL 2592000
-
 #define BUTTON_DEBOUNCE_DELAY  500         //  ms delay for button press
 #define BUTTON_LONG_PRESS_TRESHOLD 2000   //  ms after which button press is considered LONG_PRESS
 
@@ -44,15 +49,54 @@
 #define  ST_TIMEZONE_OFFSET 2    // Standard Time offset
 
 
-#define JSON_SETTINGS_SIZE (JSON_OBJECT_SIZE(11) + 220)
-#define JSON_MQTT_COMMAND_SIZE 300
+#define JSON_CIRCADIAN_SIZE (JSON_ARRAY_SIZE(CIRCADIAN_POINTS) + CIRCADIAN_POINTS * JSON_ARRAY_SIZE(3))
+#define JSON_SETTINGS_SIZE (JSON_OBJECT_SIZE(40) + JSON_ARRAY_SIZE(16) + (ACTIVATION_RULE_COUNT + 1) * JSON_ARRAY_SIZE(4) + JSON_CIRCADIAN_SIZE + 680)
+#define CONFIG_FILE_MAX_SIZE 3072
+#define JSON_LATENCY_SIZE (JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(LATENCY_BUCKETS))
+#define JSON_INSTRUMENTATION_SIZE (JSON_OBJECT_SIZE(7) + JSON_ARRAY_SIZE(LATENCY_BUCKETS) + 2 * JSON_LATENCY_SIZE + JSON_ARRAY_SIZE(TASK_COUNT) + \
+  TASK_COUNT * JSON_OBJECT_SIZE(6) + JSON_ARRAY_SIZE(LATENCY_SECTIONS) + LATENCY_SECTIONS * JSON_OBJECT_SIZE(6) + JSON_OBJECT_SIZE(4))
+#define JSON_MQTT_COMMAND_SIZE (JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(16) + JSON_CIRCADIAN_SIZE + 100)
 
 #define DEFAULT_PWM_ADJUSTMENT_SPEED 4
 #define DEFAULT_PWM_CHANGE_SPEED 10
+#define POWER_IDLE_AFTER 5000      //  ms the light has to be still before going idle
+#define POWER_IDLE_TICK 250        //  ms between light engine ticks while idle
+#define POWER_IDLE_DELAY 25        //  ms a loop pass may sleep while idle
+#define LIGHT_ENGINE_MAX_CATCH_UP 16     //  ticks run at once after a late loop, the rest are skipped
+#define DEFAULT_PROGRAM_SATURATION 255
+#define DEFAULT_PROGRAM_BRIGHTNESS 255
+#define PROGRAM_FADE_STEPS 1024
+
+#define DEFAULT_EFFECT_SPEED 127
+#define DEFAULT_EFFECT_INTENSITY 191
+#define DEFAULT_EFFECT_PALETTE 0
+#define DEFAULT_TRANSITION_TIME 1000
+#define DEFAULT_SEQUENCE_MODE 1
+
+#define DEFAULT_FOLLOW_DAY_MIN_TEMPERATURE 2200
+#define DEFAULT_FOLLOW_DAY_MAX_TEMPERATURE 6500
+#define DEFAULT_FOLLOW_DAY_BRIGHTNESS 255
+#define DEFAULT_FOLLOW_DAY_NIGHT_BRIGHTNESS 0
+
+#define ACTIVATION_RULE_COUNT 4
+
+#define CIRCADIAN_POINTS 8
+
+#define DEFAULT_WAKEUP_DURATION 30
+#define DEFAULT_WAKEUP_TEMPERATURE 3000
+#define DEFAULT_WAKEUP_BRIGHTNESS 255
+
+#define DEFAULT_REALTIME_UNIVERSE 1
+#define DEFAULT_REALTIME_ADDRESS 1
+#define DEFAULT_REALTIME_TIMEOUT 2500
+#define DEFAULT_REALTIME_PLAYOUT_DELAY 80
+
+#define DEFAULT_WHITE_TEMPERATURE 4000
 
 #define CONNECTION_STATUS_LED_GPIO 0
 
 #define IR_RECEIVE_GPIO 5
+#define IR_PRESET_ADDRESS 0x00  //  NEC address of the remote that recalls presets
 #define IR_SEND_GPIO -1
 
 #define ACTIVITY_LED_GPIO 4
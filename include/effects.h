@@ -0,0 +1,323 @@
+/*
+    effects.h - Light effects
+
+    Every effect is a small class with a static Init() and Tick() and a
+    PROGMEM name. Effects are registered at compile time in the Effects[]
+    table below, the index in the table is the program number stored in
+    appConfig.selectedProgram. To add an effect, write its class and add
+    one REGISTER_EFFECT() line to the table; the web pages and the light
+    engine pick it up from there.
+
+    Tick() is called once per light engine tick and renders one RGBW
+    colour. Effects keep their working data in the effectState they are
+    given (never in globals and never on the heap), so any number of
+    instances can run side by side.
+*/
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <Arduino.h>
+#include "colourspace.h"
+#include "rgbw.h"
+
+extern config appConfig;
+
+#define EFFECT_STATE_WORDS 16
+
+//  Parameters shared by all effects, 0..255 each
+struct effectParams{
+  uint8_t speed;
+  uint8_t intensity;
+  uint8_t palette;
+};
+
+struct effectState{
+  uint32_t time;      //  ms since the effect was started
+  uint16_t tickMs;    //  length of one light engine tick
+  rgbwColour base;    //  the manually set colour when the effect was started
+  uint32_t data[EFFECT_STATE_WORDS];
+};
+
+typedef void (*effectInitFunction)(effectState& state, const effectParams& params);
+typedef void (*effectTickFunction)(effectState& state, const effectParams& params, rgbwColour& out);
+
+struct effectDescriptor{
+  const char* name;
+  effectInitFunction init;
+  effectTickFunction tick;
+};
+
+//  Gives an effect typed access to its scratch area in effectState
+template <typename T> T& EffectData(effectState& state){
+  static_assert(sizeof(T) <= sizeof(state.data), "Effect state does not fit in effectState");
+  return *reinterpret_cast<T*>(state.data);
+}
+
+//  Palettes - a section of the hue wheel
+struct palette{
+  const char* name;
+  uint16_t hueStart;
+  uint16_t hueSpan;
+};
+
+const char PaletteBaseName[] PROGMEM = "Custom colour";
+const char PaletteRainbowName[] PROGMEM = "Rainbow";
+const char PaletteWarmName[] PROGMEM = "Warm";
+const char PaletteCoolName[] PROGMEM = "Cool";
+const char PaletteForestName[] PROGMEM = "Forest";
+
+const palette Palettes[] PROGMEM = {
+  { PaletteBaseName,       0,    0 },
+  { PaletteRainbowName,    0, 1536 },
+  { PaletteWarmName,    1408,  384 },
+  { PaletteCoolName,     640,  512 },
+  { PaletteForestName,   256,  448 }
+};
+
+#define PALETTE_COUNT (sizeof(Palettes)/sizeof(Palettes[0]))
+
+//  Hue at position 0..65535 within a palette. The custom colour palette
+//  is the hue of the base colour, or the whole wheel when it has none.
+uint16_t PaletteHue(const effectState& state, uint8_t index, uint16_t position){
+  palette p;
+  memcpy_P(&p, &Palettes[index < PALETTE_COUNT ? index : 0], sizeof(p));
+
+  if (p.hueSpan == 0){
+    hsvColour base = RgbToHsv(RgbwToRgb(state.base));
+    if (base.s == 0) return ((uint32_t)position * HUE_MAX) >> 16;
+    return base.h;
+  }
+
+  return (p.hueStart + (((uint32_t)position * p.hueSpan) >> 16)) % HUE_MAX;
+}
+
+//  Colour of the effect at full level, either the base colour or the middle of the palette
+rgbwColour PaletteColour(const effectState& state, uint8_t index){
+  if (index == 0 || index >= PALETTE_COUNT) return state.base;
+  hsvColour c = { PaletteHue(state, index, 32768), 255, 255 };
+  return RgbToRgbw(HsvToRgb(c));
+}
+
+//  level is 0..COLOUR_MAX
+rgbwColour ScaleRgbw(rgbwColour c, uint16_t level){
+  rgbwColour out = {
+    (uint16_t)(((uint32_t)c.r * level) / COLOUR_MAX),
+    (uint16_t)(((uint32_t)c.g * level) / COLOUR_MAX),
+    (uint16_t)(((uint32_t)c.b * level) / COLOUR_MAX),
+    (uint16_t)(((uint32_t)c.w * level) / COLOUR_MAX) };
+  return out;
+}
+
+//  Perceptual 0..255 to linear 0..COLOUR_MAX
+inline uint16_t GammaLevel(uint8_t level){
+  return LedPwmValues[level];
+}
+
+//  Period in ms for a speed of 0..255, slowest first
+inline uint32_t EffectPeriod(uint8_t speed, uint32_t slowest, uint32_t fastest){
+  return slowest - ((slowest - fastest) * speed) / 255;
+}
+
+//  Random colour: a random hue is picked every pwmChangeSpeed seconds
+//  and faded to around the colour wheel or through OKLab
+class RandomColourEffect{
+  public:
+    static const char Name[];
+
+    struct State{
+      colourFade fade;
+      uint32_t nextChange;
+      rgbColour current;
+    };
+
+    static void Init(effectState& state, const effectParams& params){
+      State& s = EffectData<State>(state);
+      s.fade.active = false;
+      s.nextChange = 0;
+      s.current = RgbwToRgb(state.base);
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      State& s = EffectData<State>(state);
+
+      if (state.time >= s.nextChange){
+        //  The custom colour palette makes no sense here, use the whole wheel
+        uint8_t p = params.palette ? params.palette : 1;
+        hsvColour target = { PaletteHue(state, p, rand() & 0xFFFF), appConfig.programSaturation, appConfig.programBrightness };
+        ColourFadeStart(s.fade, s.current, HsvToRgb(target), PROGRAM_FADE_STEPS, appConfig.colourInterpolation);
+        s.nextChange = state.time + appConfig.pwmChangeSpeed * 1000UL;
+      }
+
+      ColourFadeStep(s.fade, s.current);
+      out = RgbToRgbw(s.current);
+    }
+};
+const char RandomColourEffect::Name[] PROGMEM = "Slowly changing colours";
+
+//  Breathe: the colour swells and fades, intensity sets the depth
+class BreatheEffect{
+  public:
+    static const char Name[];
+
+    static void Init(effectState& state, const effectParams& params){
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      uint32_t period = EffectPeriod(params.speed, 12000, 1000);
+      uint32_t phase = ((state.time % period) << 16) / period;
+
+      //  Triangle wave smoothed with smoothstep, close enough to a sine
+      uint32_t t = phase < 32768 ? phase * 2 : (65535 - phase) * 2;
+      uint32_t smooth = (((t * t) >> 16) * (196608 - 2 * t)) >> 16;
+
+      uint8_t minimum = 255 - params.intensity;
+      uint8_t level = minimum + (((255 - minimum) * smooth) >> 16);
+
+      out = ScaleRgbw(PaletteColour(state, params.palette), GammaLevel(level));
+    }
+};
+const char BreatheEffect::Name[] PROGMEM = "Breathe";
+
+//  Candle: a warm low-pass filtered random flicker
+class CandleEffect{
+  public:
+    static const char Name[];
+
+    struct State{
+      uint16_t level;
+      uint16_t target;
+      uint32_t nextTarget;
+    };
+
+    static void Init(effectState& state, const effectParams& params){
+      State& s = EffectData<State>(state);
+      s.level = COLOUR_MAX;
+      s.target = COLOUR_MAX;
+      s.nextTarget = 0;
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      State& s = EffectData<State>(state);
+
+      if (state.time >= s.nextTarget){
+        uint16_t depth = ((uint32_t)params.intensity * (COLOUR_MAX / 2)) / 255;
+        s.target = COLOUR_MAX - (rand() % (depth + 1));
+        s.nextTarget = state.time + EffectPeriod(params.speed, 400, 20) / 2 + rand() % EffectPeriod(params.speed, 400, 20);
+      }
+
+      s.level += ((int32_t)s.target - s.level) / 4;
+
+      rgbwColour flame = params.palette ? PaletteColour(state, params.palette) : KelvinToRgbw(1900, COLOUR_MAX);
+      out = ScaleRgbw(flame, s.level);
+    }
+};
+const char CandleEffect::Name[] PROGMEM = "Candle";
+
+//  Rainbow: walks the hues of the palette, intensity sets the brightness
+class RainbowEffect{
+  public:
+    static const char Name[];
+
+    static void Init(effectState& state, const effectParams& params){
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      uint32_t period = EffectPeriod(params.speed, 120000, 2000);
+      uint32_t position = ((state.time % period) << 16) / period;
+
+      //  Partial palettes go back and forth so there is no jump at the end
+      palette p;
+      memcpy_P(&p, &Palettes[params.palette < PALETTE_COUNT ? params.palette : 0], sizeof(p));
+      if (p.hueSpan != HUE_MAX) position = position < 32768 ? position * 2 : (65535 - position) * 2;
+
+      uint8_t pal = params.palette ? params.palette : 1;
+      hsvColour c = { PaletteHue(state, pal, position), 255, params.intensity };
+      out = RgbToRgbw(HsvToRgb(c));
+    }
+};
+const char RainbowEffect::Name[] PROGMEM = "Rainbow";
+
+//  Strobe: short flashes, intensity sets the length of the flash
+class StrobeEffect{
+  public:
+    static const char Name[];
+
+    static void Init(effectState& state, const effectParams& params){
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      uint32_t period = EffectPeriod(params.speed, 2000, 60);
+      uint32_t onTime = max((uint32_t)state.tickMs, (period * (params.intensity + 1)) / 512);
+
+      if (state.time % period < onTime)
+        out = PaletteColour(state, params.palette);
+      else
+        out = { 0, 0, 0, 0 };
+    }
+};
+const char StrobeEffect::Name[] PROGMEM = "Strobe";
+
+//  Fixed colour: the manually set colour, program 0
+class FixedColourEffect{
+  public:
+    static const char Name[];
+
+    static void Init(effectState& state, const effectParams& params){
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      out = state.base;
+    }
+};
+const char FixedColourEffect::Name[] PROGMEM = "Fixed colour";
+
+//  Effects that live in their own files
+#include "sequencer.h"
+#include "sun.h"
+#include "circadian.h"
+
+#define REGISTER_EFFECT(e) { e::Name, e::Init, e::Tick }
+
+const effectDescriptor Effects[] PROGMEM = {
+  REGISTER_EFFECT(FixedColourEffect),
+  REGISTER_EFFECT(RandomColourEffect),
+  REGISTER_EFFECT(BreatheEffect),
+  REGISTER_EFFECT(CandleEffect),
+  REGISTER_EFFECT(RainbowEffect),
+  REGISTER_EFFECT(StrobeEffect),
+  REGISTER_EFFECT(SequenceEffect),
+  REGISTER_EFFECT(FollowDayEffect),
+  REGISTER_EFFECT(CircadianEffect)
+};
+
+#define EFFECT_COUNT (sizeof(Effects)/sizeof(Effects[0]))
+
+effectDescriptor GetEffect(uint8_t index){
+  effectDescriptor e;
+  memcpy_P(&e, &Effects[index < EFFECT_COUNT ? index : 0], sizeof(e));
+  return e;
+}
+
+//  Program number of an effect, -1 if it is not registered
+int FindEffect(effectTickFunction tick){
+  for (uint8_t i = 0; i < EFFECT_COUNT; i++)
+    if (GetEffect(i).tick == tick) return i;
+  return -1;
+}
+
+void EffectInit(uint8_t index, effectState& state, const effectParams& params, rgbwColour base, uint16_t tickMs){
+  state.time = 0;
+  state.tickMs = tickMs;
+  state.base = base;
+
+  effectDescriptor e = GetEffect(index);
+  if (e.init) e.init(state, params);
+}
+
+void EffectTick(uint8_t index, effectState& state, const effectParams& params, rgbwColour& out){
+  GetEffect(index).tick(state, params, out);
+  state.time += state.tickMs;
+}
+
+#endif
@@ -0,0 +1,214 @@
+/*
+    eventlog.h - Event log in a RAM ring buffer, forwarded to the log sinks
+
+    Every event goes into the ring first, whether anything is connected or
+    not, so the events of the boot and of a lost connection are still
+    there when a sink comes up. The ring holds variable length records,
+    a header and the title and data as two strings, and makes room for a
+    new record by dropping the oldest ones.
+
+    Every record has a sequence number. A sink (syslog, MQTT...) keeps the
+    sequence number of the next record it has to send and is fed from the
+    ring whenever it is ready, at most LOG_FORWARD_BATCH records at a time,
+    so a sink that comes up replays the history it missed in order and
+    without blocking the loop. A record that was dropped from the ring
+    before a sink got it is counted as lost for that sink.
+
+    Debug records, above LOG_RING_MAX_SEVERITY, are not kept: with two of
+    them for every page served they would push the boot and connection
+    events out of the ring within minutes. They go live to the sinks that
+    are ready and have nothing older waiting, and are lost to the others.
+
+    The records carry the uptime, and the UTC time when the clock was set.
+    A record from before the clock was set can be dated later from its
+    uptime with LogRecordTime().
+*/
+
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <Arduino.h>
+
+#define LOG_BUFFER_SIZE 4096      //  bytes, power of two
+#define LOG_TITLE_SIZE 48
+#define LOG_DATA_SIZE 96
+#define LOG_FORWARD_BATCH 4       //  records a sink is sent per call
+
+//  Syslog severities
+#define LOG_SEVERITY_ERROR 3
+#define LOG_SEVERITY_WARNING 4
+#define LOG_SEVERITY_NOTICE 5
+#define LOG_SEVERITY_INFO 6
+#define LOG_SEVERITY_DEBUG 7
+
+#define LOG_RING_MAX_SEVERITY LOG_SEVERITY_INFO    //  the records above are only sent live
+
+static_assert((LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1)) == 0, "The log buffer size must be a power of two");
+
+struct logRecordHeader{
+  uint16_t length;        //  of the whole record, header included
+  uint8_t severity;
+  uint8_t category;
+  uint16_t id;
+  uint32_t uptime;        //  millis()
+  uint32_t time;          //  UTC, 0 when the clock was not set
+};
+
+struct logRecord{
+  uint32_t sequence;
+  logRecordHeader header;
+  char title[LOG_TITLE_SIZE];
+  char data[LOG_DATA_SIZE];
+};
+
+//  Where a sink is in the ring; the offset holds while the record is in it
+struct logCursor{
+  uint32_t sequence;
+  uint32_t offset;
+};
+
+struct logSink{
+  const char* name;
+  bool (*ready)();
+  bool (*send)(const logRecord& record);
+
+  logCursor next;
+  uint32_t sent;
+  uint32_t lost;
+};
+
+struct eventLog{
+  uint8_t bytes[LOG_BUFFER_SIZE];
+  uint32_t head;            //  offsets, running freely
+  uint32_t tail;
+  uint32_t firstSequence;   //  of the record at the tail
+  uint32_t nextSequence;
+  uint32_t dropped;
+};
+
+eventLog eventLogBuffer;
+
+void LogRingWrite(uint32_t offset, const void* data, size_t length){
+  for (size_t i = 0; i < length; i++) eventLogBuffer.bytes[(offset + i) & (LOG_BUFFER_SIZE - 1)] = ((const uint8_t*)data)[i];
+}
+
+void LogRingRead(uint32_t offset, void* data, size_t length){
+  for (size_t i = 0; i < length; i++) ((uint8_t*)data)[i] = eventLogBuffer.bytes[(offset + i) & (LOG_BUFFER_SIZE - 1)];
+}
+
+void AppendLogRecord(uint8_t severity, uint8_t category, uint16_t id, uint32_t time, const char* title, const char* data){
+  eventLog& l = eventLogBuffer;
+
+  size_t titleLength = strnlen(title, LOG_TITLE_SIZE - 1);
+  size_t dataLength = strnlen(data, LOG_DATA_SIZE - 1);
+  logRecordHeader h = { (uint16_t)(sizeof(logRecordHeader) + titleLength + 1 + dataLength + 1), severity, category, id, (uint32_t)millis(), time };
+
+  while (l.head - l.tail + h.length > LOG_BUFFER_SIZE){
+    logRecordHeader oldest;
+    LogRingRead(l.tail, &oldest, sizeof(oldest));
+    l.tail += oldest.length;
+    l.firstSequence++;
+    l.dropped++;
+  }
+
+  const uint8_t zero = 0;
+  uint32_t offset = l.head;
+  LogRingWrite(offset, &h, sizeof(h));
+  offset += sizeof(h);
+  LogRingWrite(offset, title, titleLength);
+  LogRingWrite(offset + titleLength, &zero, 1);
+  offset += titleLength + 1;
+  LogRingWrite(offset, data, dataLength);
+  LogRingWrite(offset + dataLength, &zero, 1);
+
+  l.head += h.length;
+  l.nextSequence++;
+}
+
+//  Moves a cursor that fell out of the ring to the oldest record, returns the records it missed
+uint32_t ClampLogCursor(logCursor& c){
+  if ((int32_t)(c.sequence - eventLogBuffer.firstSequence) >= 0) return 0;
+
+  uint32_t missed = eventLogBuffer.firstSequence - c.sequence;
+  c.sequence = eventLogBuffer.firstSequence;
+  c.offset = eventLogBuffer.tail;
+  return missed;
+}
+
+//  Reads the record at the cursor and moves it on, false at the end of the ring
+bool ReadLogRecord(logCursor& c, logRecord& r){
+  ClampLogCursor(c);
+  if (c.sequence == eventLogBuffer.nextSequence) return false;
+
+  r.sequence = c.sequence;
+  LogRingRead(c.offset, &r.header, sizeof(r.header));
+
+  uint32_t offset = c.offset + sizeof(r.header);
+  size_t titleLength = 0;
+  while (titleLength < LOG_TITLE_SIZE - 1 && eventLogBuffer.bytes[(offset + titleLength) & (LOG_BUFFER_SIZE - 1)]) titleLength++;
+  LogRingRead(offset, r.title, titleLength);
+  r.title[titleLength] = 0;
+
+  offset += titleLength + 1;
+  size_t dataLength = c.offset + r.header.length - offset - 1;
+  LogRingRead(offset, r.data, dataLength);
+  r.data[dataLength] = 0;
+
+  c.sequence++;
+  c.offset += r.header.length;
+  return true;
+}
+
+//  Feeds every ready sink from the ring
+void ForwardLog(logSink sinks[], uint8_t count){
+  for (uint8_t i = 0; i < count; i++) {
+    logSink& s = sinks[i];
+    s.lost += ClampLogCursor(s.next);
+    if (s.next.sequence == eventLogBuffer.nextSequence || !s.ready()) continue;
+
+    for (uint8_t n = 0; n < LOG_FORWARD_BATCH; n++) {
+      logCursor c = s.next;
+      logRecord r;
+      if (!ReadLogRecord(c, r)) break;
+      if (!s.send(r)) break;      //  tried again on the next call
+      s.next = c;
+      s.sent++;
+    }
+  }
+}
+
+//  Sends a record that is not kept in the ring to the sinks that are caught
+//  up. It carries the sequence number of the next record kept.
+void ForwardLogLive(logSink sinks[], uint8_t count, uint8_t severity, uint8_t category, uint16_t id, uint32_t time, const char* title, const char* data){
+  logRecord r;
+  r.sequence = eventLogBuffer.nextSequence;
+  snprintf(r.title, LOG_TITLE_SIZE, "%s", title);
+  snprintf(r.data, LOG_DATA_SIZE, "%s", data);
+  r.header = { (uint16_t)(sizeof(logRecordHeader) + strlen(r.title) + 1 + strlen(r.data) + 1), severity, category, id, (uint32_t)millis(), time };
+
+  for (uint8_t i = 0; i < count; i++) {
+    logSink& s = sinks[i];
+    if (s.next.sequence != eventLogBuffer.nextSequence || !s.ready()) continue;
+    if (s.send(r)) s.sent++;
+  }
+}
+
+//  Logs an event: kept in the ring and forwarded to the sinks that are up, or
+//  above LOG_RING_MAX_SEVERITY only sent live to the sinks that are caught up
+void LogRecordEvent(logSink sinks[], uint8_t count, uint8_t severity, uint8_t category, uint16_t id, uint32_t time, const char* title, const char* data){
+  if (severity > LOG_RING_MAX_SEVERITY){
+    ForwardLogLive(sinks, count, severity, category, id, time, title, data);
+    return;
+  }
+
+  AppendLogRecord(severity, category, id, time, title, data);
+  ForwardLog(sinks, count);
+}
+
+//  The UTC time of a record, worked out from its uptime when it was logged before the clock was set
+time_t LogRecordTime(const logRecord& r, time_t utcNow){
+  if (r.header.time || !utcNow) return r.header.time;
+  return utcNow - (millis() - r.header.uptime) / 1000;
+}
+
+#endif
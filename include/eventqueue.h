@@ -0,0 +1,106 @@
+/*
+    eventqueue.h - Lock-free event ring from timer context to the main loop
+
+    The os_timer callbacks post timestamped events to a single producer,
+    single consumer ring; the main loop drains it. Nothing is merged: a
+    light engine tick that loop() has not taken yet is still in the ring,
+    so the engine can run every tick it missed, and the time an event
+    waited tells how far the loop falls behind.
+
+    The producer only writes head and the consumer only writes tail, so
+    neither needs to lock. The indices run freely and are masked on use,
+    which is why the size has to be a power of two. A compiler barrier
+    keeps the event written before head moves; the ESP8266 has a single
+    core, so that is all the ordering needed.
+
+    When the ring is full the event is dropped and counted per type, the
+    consumer picks the count up and can still account for it.
+
+    One ring serves one producer context. All os_timer callbacks run in
+    the same SDK task and never preempt each other; a GPIO interrupt,
+    which can preempt them, needs a ring of its own.
+*/
+
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <Arduino.h>
+
+#define EVENT_QUEUE_SIZE 32     //  power of two
+
+#define EVENT_LIGHT_TICK 0
+#define EVENT_HEARTBEAT 1
+#define EVENT_ACTIVATION 2
+#define EVENT_TYPES 3
+
+static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0, "The event queue size must be a power of two");
+
+struct loopEvent{
+  uint8_t type;
+  uint32_t time;          //  micros() when posted
+};
+
+struct eventQueue{
+  loopEvent events[EVENT_QUEUE_SIZE];
+  volatile uint32_t head;                     //  written by the producer
+  volatile uint32_t tail;                     //  written by the consumer
+  volatile uint32_t dropped[EVENT_TYPES];     //  written by the producer
+
+  //  Consumer side
+  uint32_t droppedSeen[EVENT_TYPES];
+  uint32_t taken;
+  uint32_t maxDepth;
+  uint32_t maxLatency;    //  us
+};
+
+eventQueue loopEvents;
+
+#define EVENT_QUEUE_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+bool IRAM_ATTR PostEvent(eventQueue& q, uint8_t type){
+  uint32_t head = q.head;
+  if (head - q.tail >= EVENT_QUEUE_SIZE){
+    q.dropped[type]++;
+    return false;
+  }
+
+  loopEvent& e = q.events[head & (EVENT_QUEUE_SIZE - 1)];
+  e.type = type;
+  e.time = micros();
+  EVENT_QUEUE_BARRIER();
+  q.head = head + 1;
+  return true;
+}
+
+bool TakeEvent(eventQueue& q, loopEvent& e){
+  uint32_t tail = q.tail;
+  uint32_t depth = q.head - tail;
+  if (!depth) return false;
+  if (depth > q.maxDepth) q.maxDepth = depth;
+
+  EVENT_QUEUE_BARRIER();
+  e = q.events[tail & (EVENT_QUEUE_SIZE - 1)];
+  EVENT_QUEUE_BARRIER();
+  q.tail = tail + 1;
+
+  uint32_t latency = micros() - e.time;
+  if (latency > q.maxLatency) q.maxLatency = latency;
+  q.taken++;
+  return true;
+}
+
+//  Events of a type dropped since the last call
+uint32_t TakeDroppedEvents(eventQueue& q, uint8_t type){
+  uint32_t dropped = q.dropped[type];
+  uint32_t count = dropped - q.droppedSeen[type];
+  q.droppedSeen[type] = dropped;
+  return count;
+}
+
+uint32_t DroppedEvents(const eventQueue& q){
+  uint32_t count = 0;
+  for (uint8_t i = 0; i < EVENT_TYPES; i++) count += q.dropped[i];
+  return count;
+}
+
+#endif
@@ -37,12 +37,36 @@
 #include <Time.h>
 #include <Timezone.h>
 #include "NTP.h"
+#include "localclock.h"
+#include "wifilink.h"
+#include "connectivity.h"
+#include "eventlog.h"
+#include "syslogclient.h"
 
+#include "board.h"
+#include "calibration.h"
 #include "structs.h"
 #include <TimeChangeRules.h>
 
 #include "user_interface.h"
 
 #include "ledgamma.h"
+#include "colourspace.h"
+#include "rgbw.h"
+#include "effects.h"
+#include "compositor.h"
+#include "scheduler.h"
+#include "wakeup.h"
+#include "presets.h"
+#include "realtime.h"
+#include "tasks.h"
+#include "eventqueue.h"
+#include "power.h"
+#include "instrumentation.h"
+#include "metrics.h"
+
+#ifdef LIGHT_PIXEL_STRIP
+#include "pixelstrip.h"
+#endif
 
 #endif
\ No newline at end of file
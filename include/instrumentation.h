@@ -0,0 +1,143 @@
+/*
+    instrumentation.h - Loop latency, jitter and heap instrumentation
+
+    Always on and cheap enough to stay so: a loop pass costs two reads of
+    the CPU cycle counter and an increment.
+
+      - loopLatency: how long the work of each loop() pass took, the
+        sleep of the power manager left out,
+      - tickLateness: how long a light engine tick waited in the event
+        ring before loop() took it, the jitter of the light engine,
+      - the tagged sections: the calls known to hold the loop up
+        (handleClient, PSclient.loop, PSclient.connect, scanNetworks...)
+        are timed by tag, so the slowest of them can be named when a
+        stutter is reported,
+      - the lowest free heap seen; the fragmentation and the largest free
+        block walk the heap, so they are only read when published.
+
+    The per task time accounting is in tasks.h.
+
+    The histograms have LATENCY_BUCKETS power of two buckets: the first
+    counts everything under LATENCY_FIRST_BUCKET us, each next one up to
+    twice as long, and the last everything longer. The cycle counter
+    wraps after 26 s at 160 MHz, far longer than anything measured here.
+*/
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <Arduino.h>
+
+#define LATENCY_BUCKETS 16
+#define LATENCY_FIRST_BUCKET_BITS 6     //  the first bucket is under 64 us, the last from 1 s
+#define LATENCY_SECTIONS 8
+
+struct latencyHistogram{
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t maxTime;       //  us
+  uint64_t totalTime;
+};
+
+struct latencySection{
+  const char* tag;
+  uint32_t calls;
+  uint32_t lastTime;      //  us
+  uint32_t maxTime;
+  uint32_t maxAt;         //  millis() of the slowest call
+  uint64_t totalTime;
+};
+
+latencyHistogram loopLatency;
+latencyHistogram tickLateness;
+latencySection latencySections[LATENCY_SECTIONS];
+uint32_t minFreeHeap = UINT32_MAX;
+
+uint32_t LatencyStart(){
+  return ESP.getCycleCount();
+}
+
+//  us since LatencyStart()
+uint32_t LatencyElapsed(uint32_t start){
+  return (ESP.getCycleCount() - start) / ESP.getCpuFreqMHz();
+}
+
+uint8_t LatencyBucket(uint32_t us){
+  if (us < (1UL << LATENCY_FIRST_BUCKET_BITS)) return 0;
+  uint8_t bucket = 32 - __builtin_clz(us) - LATENCY_FIRST_BUCKET_BITS;
+  return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+//  Upper bound of a bucket in us, 0 for the last one
+uint32_t LatencyBucketLimit(uint8_t bucket){
+  return bucket < LATENCY_BUCKETS - 1 ? 1UL << (bucket + LATENCY_FIRST_BUCKET_BITS) : 0;
+}
+
+void RecordLatency(latencyHistogram& h, uint32_t us){
+  h.buckets[LatencyBucket(us)]++;
+  h.count++;
+  h.totalTime += us;
+  if (us > h.maxTime) h.maxTime = us;
+}
+
+//  The time under which the given share of the samples fall, in us. Bucket
+//  resolution: the upper bound of the bucket, the maximum for the last one.
+uint32_t LatencyPercentile(const latencyHistogram& h, uint8_t percent){
+  if (!h.count) return 0;
+
+  uint64_t target = ((uint64_t)h.count * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += h.buckets[i];
+    if (seen >= target){
+      uint32_t limit = LatencyBucketLimit(i);
+      return limit && limit < h.maxTime ? limit : h.maxTime;
+    }
+  }
+  return h.maxTime;
+}
+
+//  Times a tagged call: start = LatencyStart() before it, then this. The tag
+//  is compared by address, so it has to be a literal. When the table is full
+//  the section with the smallest maximum makes room.
+void EndLatencySection(const char* tag, uint32_t start){
+  uint32_t us = LatencyElapsed(start);
+
+  latencySection* s = NULL;
+  for (uint8_t i = 0; i < LATENCY_SECTIONS && !s; i++) {
+    if (latencySections[i].tag == tag || !latencySections[i].tag) s = &latencySections[i];
+  }
+  if (!s){
+    s = &latencySections[0];
+    for (uint8_t i = 1; i < LATENCY_SECTIONS; i++) {
+      if (latencySections[i].maxTime < s->maxTime) s = &latencySections[i];
+    }
+    if (us <= s->maxTime) return;
+    memset(s, 0, sizeof(latencySection));
+  }
+
+  s->tag = tag;
+  s->calls++;
+  s->lastTime = us;
+  s->totalTime += us;
+  if (us >= s->maxTime){
+    s->maxTime = us;
+    s->maxAt = millis();
+  }
+}
+
+//  The section with the slowest call, NULL before any
+const latencySection* WorstLatencySection(){
+  const latencySection* worst = NULL;
+  for (uint8_t i = 0; i < LATENCY_SECTIONS; i++) {
+    if (latencySections[i].tag && (!worst || latencySections[i].maxTime > worst->maxTime)) worst = &latencySections[i];
+  }
+  return worst;
+}
+
+void UpdateHeapWatermark(){
+  uint32_t free = ESP.getFreeHeap();
+  if (free < minFreeHeap) minFreeHeap = free;
+}
+
+#endif
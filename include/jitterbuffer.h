@@ -0,0 +1,189 @@
+/*
+    jitterbuffer.h - Playout buffer for streamed realtime frames
+
+    Frames sent over WiFi arrive with tens of milliseconds of jitter and
+    now and then out of order. Shown as they come, motion stutters and
+    the light jumps back. The jitter buffer keeps the last few frames
+    sorted by sequence number and plays them out on a steady timeline,
+    playoutDelay behind the stream, interpolating between the two frames
+    around the playout time on every light engine tick.
+
+    The sender does not timestamp its frames, so the timeline is built
+    from the sequence numbers: the frame interval is the average spacing
+    of the arrivals over the last few hundred frames, and the timeline is
+    pulled back to the earliest arrivals (the least delayed packets) and
+    follows later ones only slowly, to track clock drift. A frame is due
+    its timeline time plus the playout delay; one that arrives after its
+    successor has been played is dropped as late.
+
+    All times are micros(), compared as signed differences so they may
+    wrap.
+*/
+
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <Arduino.h>
+
+#define JITTER_BUFFER_SIZE 8
+#define JITTER_MIN_INTERVAL 5000        //  us, 200 fps
+#define JITTER_MAX_INTERVAL 1000000     //  us, 1 fps
+
+struct jitterFrame{
+  uint32_t sequence;      //  unwrapped
+  uint32_t arrival;
+  uint32_t due;
+  uint8_t values[LIGHT_CHANNEL_COUNT];
+};
+
+struct jitterBuffer{
+  jitterFrame frames[JITTER_BUFFER_SIZE];   //  oldest first
+  uint8_t count;
+
+  bool started;
+  uint32_t newest;        //  sequence of the newest frame received
+  uint8_t newestSequence; //  as it came in the packet
+  uint32_t newestArrival;
+  uint32_t played;        //  sequence of the frame being played from
+  uint32_t base;          //  timeline time of the newest frame
+  uint32_t interval;      //  us between frames
+  uint32_t anchor;        //  arrival and sequence the interval is measured from
+  uint32_t anchorSequence;
+  bool underrun;
+
+  //  Metrics
+  uint32_t underruns;
+  uint32_t late;
+  uint32_t overflows;
+};
+
+void JitterReset(jitterBuffer& jb){
+  jb.count = 0;
+  jb.started = false;
+  jb.underrun = false;
+  jb.interval = 0;
+}
+
+//  How far the 8 bit sequence number to is ahead of from, negative when behind.
+//  Art-Net counts from 1 to 255 and back to 1, 0 meaning unsequenced.
+int16_t SequenceDistance(uint8_t from, uint8_t to, bool skipsZero){
+  if (!skipsZero) return (int8_t)(to - from);
+
+  int16_t d = ((int16_t)to - from) % 255;
+  if (d > 127) d -= 255;
+  if (d < -127) d += 255;
+  return d;
+}
+
+void JitterPush(jitterBuffer& jb, bool sequenced, uint8_t sequence, bool skipsZero, uint32_t arrival, const uint8_t values[LIGHT_CHANNEL_COUNT], uint32_t playoutDelay){
+  //  Unwrap the 8 bit sequence number around the newest one, number unsequenced frames as they come
+  uint32_t s;
+  if (!jb.started) s = 0x10000;
+  else if (sequenced) s = jb.newest + SequenceDistance(jb.newestSequence, sequence, skipsZero);
+  else s = jb.newest + 1;
+
+  if (!jb.started){
+    jb.started = true;
+    jb.newest = s;
+    jb.newestSequence = sequence;
+    jb.newestArrival = arrival;
+    jb.played = s - 1;
+    jb.base = arrival;
+    jb.anchor = arrival;
+    jb.anchorSequence = s;
+  }
+
+  if ((int32_t)(s - jb.played) <= 0){
+    jb.late++;
+    return;
+  }
+
+  int32_t ahead = s - jb.newest;
+  uint32_t timeline;
+
+  if (ahead > 0){
+    //  The jitter of one arrival is spread over the whole span. Once the span
+    //  is long, the anchor moves up half of it along the estimate.
+    uint32_t span = s - jb.anchorSequence;
+    uint32_t spacing = 0;
+    if (span >= 8) spacing = (arrival - jb.anchor) / span;
+    else if (!jb.interval && ahead <= 4) spacing = (arrival - jb.newestArrival) / ahead;
+
+    if (spacing){
+      if (spacing < JITTER_MIN_INTERVAL) spacing = JITTER_MIN_INTERVAL;
+      if (spacing > JITTER_MAX_INTERVAL) spacing = JITTER_MAX_INTERVAL;
+      jb.interval = spacing;
+    }
+
+    if (span >= 256){
+      jb.anchor += (span / 2) * jb.interval;
+      jb.anchorSequence += span / 2;
+    }
+
+    //  Early frames pull the timeline back at once, late ones push it forward
+    //  slowly, a bit faster while the interval is still settling
+    timeline = jb.base + ahead * jb.interval;
+    int32_t error = arrival - timeline;
+    timeline += error < 0 ? error : error >> (span < 64 ? 2 : 6);
+
+    jb.base = timeline;
+    jb.newest = s;
+    jb.newestSequence = sequence;
+    jb.newestArrival = arrival;
+  }
+  else timeline = jb.base + ahead * (int32_t)jb.interval;
+
+  //  Insert sorted, dropping duplicates and, when full, the oldest frame
+  uint8_t i = jb.count;
+  while (i > 0 && (int32_t)(jb.frames[i - 1].sequence - s) > 0) i--;
+  if (i > 0 && jb.frames[i - 1].sequence == s) return;
+
+  if (jb.count == JITTER_BUFFER_SIZE){
+    jb.overflows++;
+    if (i == 0) return;
+    memmove(&jb.frames[0], &jb.frames[1], (i - 1) * sizeof(jitterFrame));
+    i--;
+  }
+  else{
+    memmove(&jb.frames[i + 1], &jb.frames[i], (jb.count - i) * sizeof(jitterFrame));
+    jb.count++;
+  }
+
+  jb.frames[i].sequence = s;
+  jb.frames[i].arrival = arrival;
+  jb.frames[i].due = timeline + playoutDelay;
+  memcpy(jb.frames[i].values, values, LIGHT_CHANNEL_COUNT);
+}
+
+//  Channel values at now, 0..max. False while nothing is due yet.
+bool JitterPlayout(jitterBuffer& jb, uint32_t now, int32_t out[LIGHT_CHANNEL_COUNT], int32_t max){
+  while (jb.count >= 2 && (int32_t)(now - jb.frames[1].due) >= 0){
+    memmove(&jb.frames[0], &jb.frames[1], (jb.count - 1) * sizeof(jitterFrame));
+    jb.count--;
+  }
+
+  if (jb.count == 0 || (int32_t)(now - jb.frames[0].due) < 0) return false;
+
+  const jitterFrame& a = jb.frames[0];
+  jb.played = a.sequence;
+
+  //  Nothing to move towards, hold the last frame
+  if (jb.count == 1){
+    if (!jb.underrun) jb.underruns++;
+    jb.underrun = true;
+    for (uint8_t c = 0; c < LIGHT_CHANNEL_COUNT; c++) out[c] = ((uint32_t)a.values[c] * max + 127) / 255;
+    return true;
+  }
+
+  const jitterFrame& b = jb.frames[1];
+  jb.underrun = false;
+
+  uint32_t t = ((uint64_t)(now - a.due) << 16) / (b.due - a.due);
+  for (uint8_t c = 0; c < LIGHT_CHANNEL_COUNT; c++) {
+    int32_t v = ((int32_t)a.values[c] << 16) + ((int32_t)b.values[c] - a.values[c]) * (int32_t)t;
+    out[c] = ((int64_t)v * max + (255 << 15)) / (255 << 16);
+  }
+  return true;
+}
+
+#endif
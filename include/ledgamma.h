@@ -1,4 +1,4 @@
-#include <ESP8266WiFi.h>
+#include <Arduino.h>
 
 const unsigned int LedPwmValues[256] PROGMEM = {
   0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
@@ -0,0 +1,100 @@
+/*
+    localclock.h - Cached UTC to local time conversion and time formatting
+
+    Timezone::toLocal() works out the DST rules of the year on every call.
+    The local offset only changes at a DST transition, so it is cached
+    together with the UTC instant of the next transition: until then a
+    conversion is an add and two compares. The cache follows the current
+    time and is rebuilt when the clock passes the transition, jumps back
+    or the timezone is changed.
+
+    The next transition is found by stepping a week at a time through the
+    coming year until the offset changes, then bisecting that week down
+    to the second. That takes about 80 conversions, twice a year. A zone
+    without DST is checked again after a year.
+
+    The formatters write into a buffer of the caller and allocate nothing.
+*/
+
+#ifndef LOCALCLOCK_H
+#define LOCALCLOCK_H
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <Timezone.h>
+
+#define DATETIME_STRING_SIZE 20     //  2106-12-31 23:59:59
+#define INTERVAL_STRING_SIZE 16     //  1193046:59:59
+
+#define LOCAL_CLOCK_SEARCH_WEEKS 54
+
+struct localClockCache{
+  int16_t zone;       //  index in timezones[], -1 before the first conversion
+  time_t from;        //  UTC range the offset holds for
+  time_t until;       //  the next transition
+  int32_t offset;     //  s
+};
+
+localClockCache localClock = { -1, 0, 0, 0 };
+
+int32_t LocalOffset(Timezone& tz, time_t utc){
+  return tz.toLocal(utc) - utc;
+}
+
+void RefreshLocalClock(int16_t zone, time_t utc){
+  Timezone& tz = *timezones[zone];
+  int32_t offset = LocalOffset(tz, utc);
+
+  time_t low = utc;
+  time_t high = 0;
+  for (uint8_t w = 1; w <= LOCAL_CLOCK_SEARCH_WEEKS; w++) {
+    time_t t = utc + w * SECS_PER_WEEK;
+    if (LocalOffset(tz, t) != offset){
+      high = t;
+      break;
+    }
+    low = t;
+  }
+
+  if (high){
+    //  low has the offset, high does not
+    while (high - low > 1){
+      time_t middle = low + (high - low) / 2;
+      if (LocalOffset(tz, middle) == offset) low = middle;
+      else high = middle;
+    }
+  }
+  else high = low;
+
+  localClock.zone = zone;
+  localClock.from = utc;
+  localClock.until = high;
+  localClock.offset = offset;
+}
+
+time_t ToLocalTime(int16_t zone, time_t utc){
+  if (localClock.zone == zone && utc >= localClock.from && utc < localClock.until) return utc + localClock.offset;
+
+  //  The cache follows the current time, other times are converted directly
+  time_t t = now();
+  if (localClock.zone != zone || t < localClock.from || t >= localClock.until) RefreshLocalClock(zone, t);
+  if (utc >= localClock.from && utc < localClock.until) return utc + localClock.offset;
+
+  return timezones[zone]->toLocal(utc);
+}
+
+//  Y-M-D h:mm:ss
+char* FormatDateTime(char* s, time_t time){
+  tmElements_t tm;
+  breakTime(time, tm);
+  snprintf(s, DATETIME_STRING_SIZE, "%d-%d-%d %d:%02d:%02d", tmYearToCalendar(tm.Year), tm.Month, tm.Day, tm.Hour, tm.Minute, tm.Second);
+  return s;
+}
+
+//  h:mm:ss, the hours are not limited to a day
+char* FormatTimeInterval(char* s, uint32_t seconds){
+  snprintf(s, INTERVAL_STRING_SIZE, "%lu:%02u:%02u", (unsigned long)(seconds / 3600), (unsigned)(seconds / 60 % 60), (unsigned)(seconds % 60));
+  return s;
+}
+
+#endif
@@ -0,0 +1,159 @@
+/*
+    metrics.h - Prometheus text exposition, streamed in fixed size chunks
+
+    /metrics is written straight from the counters into one chunk buffer
+    on the stack, which goes out as an HTTP chunk whenever the next line
+    does not fit. Nothing is allocated and nothing is built in a String,
+    so a scrape costs about as much as sending the bytes.
+
+    The counters that only /metrics needs live here as well:
+
+      - the MQTT messages in and out and the connects to the broker,
+      - the HTTP responses by route and status class. meteredWebServer
+        learns the routes as they are registered with on() and counts
+        every send() by the registered route, or "other" for the
+        requests that end up in the not found handler. It hides the
+        methods of ESP8266WebServer rather than overriding them, so the
+        server has to be used through its own type.
+
+    Times are in seconds and ratios from 0 to 1, as Prometheus expects;
+    they are formatted from integers, without floating point.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <ESP8266WebServer.h>
+#include <stdarg.h>
+
+#define METRICS_CHUNK_SIZE 512
+#define HTTP_ROUTES 24                  //  the first one is "other"
+#define HTTP_STATUS_CLASSES 5           //  1xx to 5xx
+
+struct metricsWriter{
+  char chunk[METRICS_CHUNK_SIZE];
+  size_t length;
+  void (*send)(const char* data, size_t length);
+};
+
+struct mqttCounters{
+  uint32_t received;
+  uint32_t published;
+  uint32_t publishFailed;
+  uint32_t connects;
+};
+
+struct httpRouteStats{
+  const char* path;
+  uint32_t responses[HTTP_STATUS_CLASSES];
+};
+
+mqttCounters mqttStats;
+httpRouteStats httpRoutes[HTTP_ROUTES] = { { "other", { 0 } } };
+uint8_t httpRouteCount = 1;
+
+void AddHttpRoute(const char* path){
+  for (uint8_t i = 1; i < httpRouteCount; i++) {
+    if (strcmp(httpRoutes[i].path, path) == 0) return;
+  }
+  if (httpRouteCount < HTTP_ROUTES) httpRoutes[httpRouteCount++].path = path;
+}
+
+void CountHttpResponse(const char* uri, int code){
+  uint8_t route = 0;
+  for (uint8_t i = 1; i < httpRouteCount && !route; i++) {
+    if (strcmp(httpRoutes[i].path, uri) == 0) route = i;
+  }
+
+  int statusClass = code / 100 - 1;
+  if (statusClass < 0) statusClass = 0;
+  if (statusClass >= HTTP_STATUS_CLASSES) statusClass = HTTP_STATUS_CLASSES - 1;
+  httpRoutes[route].responses[statusClass]++;
+}
+
+class meteredWebServer : public ESP8266WebServer{
+public:
+  meteredWebServer(int port) : ESP8266WebServer(port) {}
+
+  //  The path has to be a literal, the table keeps the pointer
+  template<typename... Args> decltype(auto) on(const char* path, Args&&... args){
+    AddHttpRoute(path);
+    return ESP8266WebServer::on(path, std::forward<Args>(args)...);
+  }
+
+  template<typename... Args> void send(int code, Args&&... args){
+    CountHttpResponse(uri().c_str(), code);
+    ESP8266WebServer::send(code, std::forward<Args>(args)...);
+  }
+};
+
+void MetricsFlush(metricsWriter& w){
+  if (!w.length) return;
+  w.send(w.chunk, w.length);
+  w.length = 0;
+}
+
+//  Appends a line, sending the chunk first when it does not fit. A line
+//  longer than a whole chunk is dropped.
+void MetricsPrintf(metricsWriter& w, const char* format, ...){
+  for (uint8_t attempt = 0; attempt < 2; attempt++) {
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(w.chunk + w.length, METRICS_CHUNK_SIZE - w.length, format, args);
+    va_end(args);
+
+    if (n < 0) return;
+    if (w.length + n < METRICS_CHUNK_SIZE){
+      w.length += n;
+      return;
+    }
+    MetricsFlush(w);
+  }
+}
+
+void MetricsHeader(metricsWriter& w, const char* name, const char* type, const char* help){
+  MetricsPrintf(w, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+//  name{labels} value; labels may be empty
+void MetricsValue(metricsWriter& w, const char* name, const char* labels, uint32_t value){
+  MetricsPrintf(w, "%s%s%s%s %lu\n", name, *labels ? "{" : "", labels, *labels ? "}" : "", (unsigned long)value);
+}
+
+void MetricsSignedValue(metricsWriter& w, const char* name, const char* labels, int32_t value){
+  MetricsPrintf(w, "%s%s%s%s %ld\n", name, *labels ? "{" : "", labels, *labels ? "}" : "", (long)value);
+}
+
+//  A time in us, written in seconds
+void MetricsSeconds(metricsWriter& w, const char* name, const char* labels, uint64_t us){
+  MetricsPrintf(w, "%s%s%s%s %lu.%06lu\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+    (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+}
+
+//  value / max, with four decimals
+void MetricsRatio(metricsWriter& w, const char* name, const char* labels, uint32_t value, uint32_t max){
+  uint32_t ratio = max ? (uint64_t)(value < max ? value : max) * 10000 / max : 0;
+  MetricsPrintf(w, "%s%s%s%s %lu.%04lu\n", name, *labels ? "{" : "", labels, *labels ? "}" : "",
+    (unsigned long)(ratio / 10000), (unsigned long)(ratio % 10000));
+}
+
+//  A latencyHistogram (see instrumentation.h) as a Prometheus histogram in seconds
+void MetricsHistogram(metricsWriter& w, const char* name, const char* help, const latencyHistogram& h){
+  MetricsHeader(w, name, "histogram", help);
+
+  uint32_t count = 0;
+  for (uint8_t i = 0; i < LATENCY_BUCKETS - 1; i++) {
+    count += h.buckets[i];
+    uint32_t limit = LatencyBucketLimit(i);
+    MetricsPrintf(w, "%s_bucket{le=\"%lu.%06lu\"} %lu\n", name, (unsigned long)(limit / 1000000), (unsigned long)(limit % 1000000), (unsigned long)count);
+  }
+  MetricsPrintf(w, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)h.count);
+
+  char sum[48];
+  snprintf(sum, sizeof(sum), "%s_sum", name);
+  MetricsSeconds(w, sum, "", h.totalTime);
+  MetricsPrintf(w, "%s_count %lu\n", name, (unsigned long)h.count);
+}
+
+#endif
@@ -0,0 +1,38 @@
+/*
+    pixelencoder.h - WS2812/SK6812 bit stream for the I2S output
+
+    The I2S bit clock runs at four times the 800 kHz of the strip, so
+    every data bit is sent as four I2S bits, 1110 for a one and 1000 for
+    a zero, and each colour byte is one 32 bit DMA word. The strip takes
+    the colour bytes in G, R, B(, W) order, most significant bit first.
+*/
+
+#ifndef PIXELENCODER_H
+#define PIXELENCODER_H
+
+#include <Arduino.h>
+#include "board.h"
+
+//  Four I2S bits per data bit, most significant bit first
+const uint16_t PixelNibblePatterns[16] = {
+  0b1000100010001000, 0b1000100010001110, 0b1000100011101000, 0b1000100011101110,
+  0b1000111010001000, 0b1000111010001110, 0b1000111011101000, 0b1000111011101110,
+  0b1110100010001000, 0b1110100010001110, 0b1110100011101000, 0b1110100011101110,
+  0b1110111010001000, 0b1110111010001110, 0b1110111011101000, 0b1110111011101110
+};
+
+//  One colour byte as a DMA word. I2S sends the upper half word first.
+inline uint32_t EncodePixelByte(uint8_t b){
+  return ((uint32_t)PixelNibblePatterns[b >> 4] << 16) | PixelNibblePatterns[b & 0x0F];
+}
+
+//  Pixels in R, G, B(, W) order to the bit stream, in the G, R, B(, W) order of the strip
+void EncodePixels(const uint8_t pixels[][LIGHT_CHANNEL_COUNT], uint16_t count, uint32_t* out){
+  for (uint16_t i = 0; i < count; i++) {
+    *out++ = EncodePixelByte(pixels[i][1]);
+    *out++ = EncodePixelByte(pixels[i][0]);
+    for (uint8_t c = 2; c < LIGHT_CHANNEL_COUNT; c++) *out++ = EncodePixelByte(pixels[i][c]);
+  }
+}
+
+#endif
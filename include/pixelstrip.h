@@ -0,0 +1,201 @@
+/*
+    pixelstrip.h - WS2812/SK6812 pixel strip output over I2S DMA
+
+    The strip is driven from the I2S data pin (GPIO3, the serial RX pin)
+    by the DMA engine, so the CPU neither bit-bangs the timing nor turns
+    interrupts off while a frame goes out. The I2S bit clock runs at
+    3.2 MHz, four times the 800 kHz of the strip, see pixelencoder.h for
+    the bit stream.
+
+    There are two encoded frame buffers, each with its own chain of DMA
+    descriptors, and a pair of descriptors pointing at a block of zeros.
+    Between frames the DMA loops over the zeros, which holds the line low
+    and latches the strip. A new frame is encoded into the buffer that is
+    not on the wire, then queued; the end of frame interrupt hooks the
+    queued chain into the loop, so the next frame is rendered while the
+    previous one is still being sent.
+
+    A frame of 300 RGBW pixels takes 4.8 kB per buffer and 12 ms on the
+    wire, well within the 16 ms of 60 fps.
+*/
+
+#ifndef PIXELSTRIP_H
+#define PIXELSTRIP_H
+
+#include <Arduino.h>
+extern "C" {
+#include "i2s_reg.h"
+#include "slc_register.h"
+#include "esp8266_peri.h"
+}
+#include "pixelencoder.h"
+
+#ifndef PIXEL_STRIP_LENGTH
+#define PIXEL_STRIP_LENGTH 150
+#endif
+
+#define PIXEL_STRIP_GPIO 3
+#define PIXEL_STRIP_CLOCK_DIV 5         //  160 MHz / 5 / 10 = 3.2 MHz
+#define PIXEL_STRIP_BASE_CLOCK_DIV 10
+#define PIXEL_STRIP_LATCH_BYTES 128     //  320 us low, SK6812 and new WS2812B need 80-280 us
+#define PIXEL_STRIP_DMA_BLOCK 4092      //  largest multiple of 4 a descriptor can hold
+#define PIXEL_STRIP_FRAME_MS 16         //  60 fps for the pixel mapped effects
+
+#define PIXEL_STRIP_FRAME_BYTES (PIXEL_STRIP_LENGTH * LIGHT_CHANNEL_COUNT * 4)
+#define PIXEL_STRIP_DESCRIPTORS ((PIXEL_STRIP_FRAME_BYTES + PIXEL_STRIP_DMA_BLOCK - 1) / PIXEL_STRIP_DMA_BLOCK)
+
+#define PIXEL_STRIP_IDLE 0
+#define PIXEL_STRIP_PENDING 1
+#define PIXEL_STRIP_SENDING 2
+
+//  SLC DMA descriptor
+struct slcDescriptor{
+  uint32_t blocksize : 12;
+  uint32_t datalen : 12;
+  uint32_t unused : 5;
+  uint32_t sub_sof : 1;
+  uint32_t eof : 1;
+  uint32_t owner : 1;
+  uint32_t buf_ptr;
+  uint32_t next_link_ptr;
+};
+
+struct pixelStrip{
+  uint8_t pixels[PIXEL_STRIP_LENGTH][LIGHT_CHANNEL_COUNT];    //  R, G, B(, W)
+  uint32_t* frames[2];
+  slcDescriptor chains[2][PIXEL_STRIP_DESCRIPTORS];
+  slcDescriptor latch[2];
+  uint32_t zeros[PIXEL_STRIP_LATCH_BYTES / 4];
+  uint8_t back;                                   //  the frame buffer that is not on the wire
+  volatile uint8_t state;
+  volatile uint32_t pending;                      //  first descriptor of the queued frame
+};
+
+pixelStrip strip;
+
+//  End of a latch block: start a queued frame, or keep looping over the zeros
+void IRAM_ATTR PixelStripInterrupt(void* arg){
+  ETS_SLC_INTR_DISABLE();
+  uint32_t status = SLCIS;
+  SLCIC = 0xFFFFFFFF;
+
+  if (status & SLCIRXEOF){
+    slcDescriptor* finished = (slcDescriptor*)SLCRXEDA;
+
+    if (strip.state == PIXEL_STRIP_PENDING){
+      (finished + 1)->next_link_ptr = strip.pending;
+      strip.state = PIXEL_STRIP_SENDING;
+    }
+    else if (strip.state == PIXEL_STRIP_SENDING){
+      (finished + 1)->next_link_ptr = (uint32_t)finished;
+      strip.state = PIXEL_STRIP_IDLE;
+    }
+  }
+
+  ETS_SLC_INTR_ENABLE();
+}
+
+void SetSlcDescriptor(slcDescriptor& d, const void* buffer, uint16_t length, const slcDescriptor* next){
+  d.owner = 1;
+  d.eof = 0;
+  d.sub_sof = 0;
+  d.unused = 0;
+  d.datalen = length;
+  d.blocksize = length;
+  d.buf_ptr = (uint32_t)buffer;
+  d.next_link_ptr = (uint32_t)next;
+}
+
+//  Allocates the frame buffers and starts the DMA on the latch loop
+bool PixelStripBegin(){
+  for (uint8_t f = 0; f < 2; f++) {
+    strip.frames[f] = (uint32_t*)malloc(PIXEL_STRIP_FRAME_BYTES);
+    if (!strip.frames[f]) return false;
+
+    //  Each frame is a chain of blocks ending in the latch loop
+    uint8_t* p = (uint8_t*)strip.frames[f];
+    uint32_t left = PIXEL_STRIP_FRAME_BYTES;
+    for (uint8_t i = 0; i < PIXEL_STRIP_DESCRIPTORS; i++) {
+      uint16_t length = left > PIXEL_STRIP_DMA_BLOCK ? PIXEL_STRIP_DMA_BLOCK : left;
+      SetSlcDescriptor(strip.chains[f][i], p, length, i + 1 < PIXEL_STRIP_DESCRIPTORS ? &strip.chains[f][i + 1] : &strip.latch[0]);
+      p += length;
+      left -= length;
+    }
+  }
+
+  memset(strip.pixels, 0, sizeof(strip.pixels));
+  memset(strip.zeros, 0, sizeof(strip.zeros));
+  SetSlcDescriptor(strip.latch[0], strip.zeros, sizeof(strip.zeros), &strip.latch[1]);
+  SetSlcDescriptor(strip.latch[1], strip.zeros, sizeof(strip.zeros), &strip.latch[0]);
+  strip.latch[0].eof = 1;   //  the only block that interrupts
+  strip.back = 0;
+  strip.state = PIXEL_STRIP_IDLE;
+
+  //  SLC: descriptors go out through the RX link, the TX link only needs a valid one
+  ETS_SLC_INTR_DISABLE();
+  SLCC0 |= SLCRXLR | SLCTXLR;
+  SLCC0 &= ~(SLCRXLR | SLCTXLR);
+  SLCIC = 0xFFFFFFFF;
+
+  SLCC0 &= ~(SLCMM << SLCM);
+  SLCC0 |= (1 << SLCM);
+  SLCRXDC |= SLCBINR | SLCBTNR;
+  SLCRXDC &= ~(SLCBRXFE | SLCBRXEM | SLCBRXFM);
+
+  SLCTXL &= ~(SLCTXLAM << SLCTXLA);
+  SLCTXL |= (uint32_t)&strip.latch[1] << SLCTXLA;
+  SLCRXL &= ~(SLCRXLAM << SLCRXLA);
+  SLCRXL |= (uint32_t)&strip.latch[0] << SLCRXLA;
+
+  ETS_SLC_INTR_ATTACH(PixelStripInterrupt, NULL);
+  SLCIE = SLCIRXEOF;
+  ETS_SLC_INTR_ENABLE();
+
+  SLCTXL |= SLCTXLS;
+  SLCRXL |= SLCRXLS;
+
+  //  I2S: transmit master, 16 bits per channel, fed by DMA
+  pinMode(PIXEL_STRIP_GPIO, FUNCTION_1);
+  I2S_CLK_ENABLE();
+  I2SIC = 0x3F;
+  I2SIE = 0;
+
+  I2SC &= ~(I2SRST);
+  I2SC |= I2SRST;
+  I2SC &= ~(I2SRST);
+
+  I2SFC &= ~(I2SDE | (I2STXFMM << I2STXFM) | (I2SRXFMM << I2SRXFM));
+  I2SFC |= I2SDE;
+  I2SCC &= ~((I2STXCMM << I2STXCM) | (I2SRXCMM << I2SRXCM));
+
+  I2SC &= ~(I2STSM | I2SRSM | (I2SBMM << I2SBM) | (I2SBDM << I2SBD) | (I2SCDM << I2SCD));
+  I2SC |= I2SRF | I2SMR | I2SRSM | I2SRMS | ((PIXEL_STRIP_BASE_CLOCK_DIV & I2SBDM) << I2SBD) | ((PIXEL_STRIP_CLOCK_DIV & I2SCDM) << I2SCD);
+  I2SC |= I2STXS;
+
+  return true;
+}
+
+//  Encodes the pixels and queues them. False if the last frame has not
+//  started yet, then this one is dropped.
+bool PixelStripShow(){
+  if (!strip.frames[0] || strip.state == PIXEL_STRIP_PENDING) return false;
+
+  EncodePixels(strip.pixels, PIXEL_STRIP_LENGTH, strip.frames[strip.back]);
+
+  strip.pending = (uint32_t)&strip.chains[strip.back][0];
+  strip.state = PIXEL_STRIP_PENDING;
+  strip.back ^= 1;
+  return true;
+}
+
+//  False while a frame waits to go out, rendering into the pixels is wasted then
+bool PixelStripReady(){
+  return strip.frames[0] && strip.state != PIXEL_STRIP_PENDING;
+}
+
+void PixelStripFill(const uint16_t colour[LIGHT_CHANNEL_COUNT]){
+  for (uint16_t i = 0; i < PIXEL_STRIP_LENGTH; i++)
+    for (uint8_t c = 0; c < LIGHT_CHANNEL_COUNT; c++) strip.pixels[i][c] = colour[c];
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+    power.h - Idle power saving
+
+    An idle luminaire used to spin loop() flat out, keeping the CPU and
+    the radio awake. Once the light has been still for POWER_IDLE_AFTER
+    (a fixed colour or off, no fade, no flash, no wake-up ramp, no
+    realtime stream) the node goes idle:
+
+      - the light engine ticks only every POWER_IDLE_TICK, which is
+        enough to pick up a change and wake up again,
+      - the outputs are rounded instead of dithered, so they hold steady
+        at the slow tick,
+      - loop() gives the rest of each pass to the SDK, up to the next
+        periodic task or POWER_IDLE_DELAY, so the CPU can idle and the
+        radio sleeps between beacons.
+
+    With every output fully on or fully off the GPIOs hold their level by
+    themselves and the WiFi is put in light sleep, which also stops the
+    CPU clock. PWM needs the timer running, so with any output in between
+    it is modem sleep, where only the radio sleeps. Pixel strips are
+    never put in light sleep, it would stop the I2S clock mid frame.
+
+    Time spent in the idle delays is counted as asleep, the rest as
+    awake; the idle time is also split by sleep type.
+*/
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+struct powerManager{
+  bool idle;
+  bool lightSleep;
+  WiFiSleepType activeSleepType;    //  restored on leaving idle
+  uint32_t quietSince;              //  millis() since the light is still
+  uint32_t entries;
+
+  //  Accounting, us
+  uint32_t lastUpdate;
+  uint64_t asleep;
+  uint64_t awake;
+  uint64_t lightSleepTime;
+  uint64_t modemSleepTime;
+};
+
+powerManager power;
+
+void PowerBegin(){
+  power.activeSleepType = WiFi.getSleepMode();
+  power.lastUpdate = micros();
+  power.quietSince = millis();
+}
+
+//  Splits the time since the last call between the buckets
+void UpdatePowerAccounting(uint32_t asleep){
+  uint32_t now = micros();
+  uint32_t elapsed = now - power.lastUpdate;
+  power.lastUpdate = now;
+
+  if (asleep > elapsed) asleep = elapsed;
+  power.asleep += asleep;
+  power.awake += elapsed - asleep;
+
+  if (power.idle){
+    if (power.lightSleep) power.lightSleepTime += elapsed;
+    else power.modemSleepTime += elapsed;
+  }
+}
+
+void PowerEnterIdle(bool lightSleep){
+  UpdatePowerAccounting(0);
+  power.idle = true;
+  power.lightSleep = lightSleep;
+  power.entries++;
+  WiFi.setSleepMode(lightSleep ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP);
+}
+
+void PowerSetLightSleep(bool lightSleep){
+  if (!power.idle || power.lightSleep == lightSleep) return;
+  UpdatePowerAccounting(0);
+  power.lightSleep = lightSleep;
+  WiFi.setSleepMode(lightSleep ? WIFI_LIGHT_SLEEP : WIFI_MODEM_SLEEP);
+}
+
+void PowerExitIdle(){
+  UpdatePowerAccounting(0);
+  power.idle = false;
+  WiFi.setSleepMode(power.activeSleepType);
+}
+
+//  Called at the end of a loop pass with the us until the next task is due
+void PowerSleep(uint32_t idleTime){
+  uint32_t asleep = 0;
+
+  if (power.idle){
+    uint32_t ms = idleTime / 1000;
+    if (ms > POWER_IDLE_DELAY) ms = POWER_IDLE_DELAY;
+    if (ms){
+      uint32_t start = micros();
+      delay(ms);
+      asleep = micros() - start;
+    }
+  }
+
+  UpdatePowerAccounting(asleep);
+}
+
+//  Share of the time asleep, in percent
+uint8_t PowerAsleepPercent(){
+  uint64_t total = power.asleep + power.awake;
+  return total ? power.asleep * 100 / total : 0;
+}
+
+#endif
@@ -0,0 +1,76 @@
+/*
+    presets.h - Scene preset bank
+
+    PRESET_COUNT fixed slots, each a complete look: the RGBW colour, a
+    brightness it is recalled at and the program to run. The bank is one
+    packed binary file in LittleFS and is mirrored in RAM, so a recall is
+    an array lookup by ID and only storing or deleting touches the flash.
+*/
+
+#ifndef PRESETS_H
+#define PRESETS_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "rgbw.h"
+
+#define PRESET_COUNT 64
+#define PRESET_FILE "/presets.bin"
+
+struct preset{
+  uint8_t used;
+  uint8_t program;
+  uint8_t brightness;   //  perceptual, 0..255
+  uint8_t reserved;
+  rgbwColour colour;
+};
+
+static_assert(sizeof(preset) == 12, "Preset must be 12 bytes");
+
+preset presets[PRESET_COUNT];
+
+//  A missing or foreign file leaves the bank empty
+void LoadPresets(){
+  memset(presets, 0, sizeof(presets));
+
+  File f = LittleFS.open(PRESET_FILE, "r");
+  if (!f) return;
+
+  if (f.size() != sizeof(presets) || f.read((uint8_t*)presets, sizeof(presets)) != sizeof(presets))
+    memset(presets, 0, sizeof(presets));
+  f.close();
+}
+
+bool SavePresets(){
+  File f = LittleFS.open(PRESET_FILE, "w");
+  if (!f) return false;
+
+  bool ok = f.write((const uint8_t*)presets, sizeof(presets)) == sizeof(presets);
+  f.close();
+  return ok;
+}
+
+const preset* GetPreset(uint8_t id){
+  if (id >= PRESET_COUNT || !presets[id].used) return NULL;
+  return &presets[id];
+}
+
+bool StorePreset(uint8_t id, rgbwColour colour, uint8_t brightness, uint8_t program){
+  if (id >= PRESET_COUNT) return false;
+
+  presets[id].used = 1;
+  presets[id].program = program;
+  presets[id].brightness = brightness;
+  presets[id].reserved = 0;
+  presets[id].colour = colour;
+  return SavePresets();
+}
+
+bool DeletePreset(uint8_t id){
+  if (id >= PRESET_COUNT || !presets[id].used) return false;
+
+  memset(&presets[id], 0, sizeof(preset));
+  return SavePresets();
+}
+
+#endif
@@ -0,0 +1,258 @@
+/*
+    realtime.h - E1.31 (sACN) and Art-Net receiver
+
+    Lets a lighting desk drive the light directly at frame rate. Both
+    protocols are received with the raw lwIP UDP API: the packet is
+    parsed in place in the pbuf it arrived in, and only the few DMX slots
+    from the start address on are copied out, one per channel of the
+    board (see board.h). The light engine picks the frame up from the
+    main loop and writes it to the output stage without a fade.
+
+    The universe is numbered the E1.31 way, from 1. Art-Net port
+    addresses count from 0, so Art-Net universe 0 is universe 1 here, as
+    most desks show it.
+
+    Out of order E1.31 packets are discarded as the standard asks, any
+    other jump in the sequence number is counted as a sequence error.
+    Packets without any DMX slots are discarded as malformed.
+
+    With a playout delay set, frames go through the jitter buffer instead
+    (jitterbuffer.h), which puts them back in order and plays them out
+    interpolated on the light engine tick.
+*/
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <Arduino.h>
+#include <lwip/udp.h>
+#include <lwip/igmp.h>
+#include "jitterbuffer.h"
+
+#define E131_PORT 5568
+#define ARTNET_PORT 6454
+
+#define E131_DATA_OFFSET 126
+#define E131_OPTION_PREVIEW 0x80
+#define E131_OPTION_TERMINATED 0x40
+#define ARTNET_DATA_OFFSET 18
+#define ARTNET_OPCODE_DMX 0x5000
+#define DMX_SLOTS 512
+
+//  A DMX frame inside a received packet
+struct dmxFrame{
+  uint16_t universe;
+  bool sequenced;
+  uint8_t sequence;
+  bool skipsZero;         //  Art-Net, the sequence goes from 255 to 1
+  bool terminated;
+  const uint8_t* data;    //  slot 1, points into the packet
+  uint16_t length;
+};
+
+inline uint16_t ReadBigEndian16(const uint8_t* p){
+  return ((uint16_t)p[0] << 8) | p[1];
+}
+
+//  E1.31 data packet (root, framing and DMP layers) carrying DMX slots
+bool ParseE131(const uint8_t* p, uint16_t length, dmxFrame& frame){
+  static const uint8_t identifier[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+  if (length < E131_DATA_OFFSET) return false;
+  if (ReadBigEndian16(p) != 0x0010 || memcmp(p + 4, identifier, sizeof(identifier)) != 0) return false;
+  if (p[21] != 0x04 || p[43] != 0x02 || p[117] != 0x02) return false;   //  root, framing and DMP vectors
+  if (p[125] != 0) return false;                                        //  DMX start code
+  if (p[112] & E131_OPTION_PREVIEW) return false;
+
+  //  The property count includes the start code
+  uint16_t count = ReadBigEndian16(p + 123);
+  if (count < 2 || count - 1 > DMX_SLOTS || E131_DATA_OFFSET + count - 1 > length) return false;
+  uint16_t slots = count - 1;
+
+  frame.universe = ReadBigEndian16(p + 113);
+  frame.sequenced = true;
+  frame.sequence = p[111];
+  frame.skipsZero = false;
+  frame.terminated = p[112] & E131_OPTION_TERMINATED;
+  frame.data = p + E131_DATA_OFFSET;
+  frame.length = slots;
+  return true;
+}
+
+//  ArtDmx packet. Sequence 0 means the sender does not number its packets.
+//  The 15 bit port address is Net (7 bits) in byte 15 and Sub-Net and
+//  Universe (4 bits each) in byte 14.
+bool ParseArtNet(const uint8_t* p, uint16_t length, dmxFrame& frame){
+  if (length < ARTNET_DATA_OFFSET || memcmp(p, "Art-Net", 8) != 0) return false;
+  if ((p[8] | ((uint16_t)p[9] << 8)) != ARTNET_OPCODE_DMX || ReadBigEndian16(p + 10) < 14) return false;
+
+  uint16_t slots = ReadBigEndian16(p + 16);
+  if (slots == 0 || slots > DMX_SLOTS || ARTNET_DATA_OFFSET + slots > length) return false;
+
+  frame.universe = ((((uint16_t)p[15] & 0x7F) << 8) | p[14]) + 1;
+  frame.sequenced = p[12] != 0;
+  frame.sequence = p[12];
+  frame.skipsZero = true;
+  frame.terminated = false;
+  frame.data = p + ARTNET_DATA_OFFSET;
+  frame.length = slots;
+  return true;
+}
+
+//  E1.31 6.7.2: a packet up to 19 behind the last one is out of order
+inline bool IsOutOfOrder(uint8_t last, uint8_t sequence, bool skipsZero){
+  int16_t d = SequenceDistance(last, sequence, skipsZero);
+  return d <= 0 && d > -20;
+}
+
+struct realtimeStats{
+  uint32_t frames;
+  uint32_t sequenceErrors;
+  uint32_t discarded;         //  out of order or malformed
+  uint32_t latency;           //  us from the packet to the outputs, last frame
+  uint32_t latencyAverage;
+  uint32_t latencyMax;
+};
+
+struct realtimeReceiver{
+  udp_pcb* e131;
+  udp_pcb* artnet;
+  uint16_t universe;
+  uint16_t address;           //  DMX slot of the first channel, from 1
+  uint16_t playoutDelay;      //  ms, 0 shows every frame as it arrives
+
+  //  Written by the receive callback, taken by the main loop
+  uint8_t values[LIGHT_CHANNEL_COUNT];
+  volatile bool fresh;
+  volatile bool terminated;
+  uint32_t lastFrame;         //  millis()
+  uint32_t received;          //  micros() of the latest frame
+
+  bool active;
+  bool sequenced;
+  uint8_t sequence;
+  realtimeStats stats;
+  jitterBuffer jitter;
+};
+
+realtimeReceiver realtime;
+
+void RealtimeAccept(const dmxFrame& frame, uint32_t receivedAt){
+  if (frame.sequenced){
+    bool outOfOrder = realtime.sequenced && IsOutOfOrder(realtime.sequence, frame.sequence, frame.skipsZero);
+    if (realtime.sequenced && SequenceDistance(realtime.sequence, frame.sequence, frame.skipsZero) != 1) realtime.stats.sequenceErrors++;
+
+    //  The jitter buffer can still use it
+    if (outOfOrder && !realtime.playoutDelay){
+      realtime.stats.discarded++;
+      return;
+    }
+    if (!outOfOrder) realtime.sequence = frame.sequence;
+  }
+  realtime.sequenced = frame.sequenced;
+
+  if (frame.terminated){
+    realtime.terminated = true;
+    return;
+  }
+
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    uint16_t slot = realtime.address - 1 + i;
+    realtime.values[i] = slot < frame.length ? frame.data[slot] : 0;
+  }
+
+  if (realtime.playoutDelay) JitterPush(realtime.jitter, frame.sequenced, frame.sequence, frame.skipsZero, receivedAt, realtime.values, realtime.playoutDelay * 1000UL);
+
+  realtime.lastFrame = millis();
+  realtime.received = receivedAt;
+  realtime.stats.frames++;
+  realtime.fresh = true;
+}
+
+void RealtimeReceive(void* arg, udp_pcb* pcb, pbuf* p, const ip_addr_t* addr, u16_t port){
+  uint32_t t = micros();
+  dmxFrame frame;
+
+  //  A frame always fits one pbuf, a chain would have to be copied
+  bool valid = p->len == p->tot_len &&
+    (pcb == realtime.e131 ? ParseE131((const uint8_t*)p->payload, p->len, frame) : ParseArtNet((const uint8_t*)p->payload, p->len, frame));
+
+  if (!valid) realtime.stats.discarded++;
+  else if (frame.universe == realtime.universe) RealtimeAccept(frame, t);
+
+  pbuf_free(p);
+}
+
+//  The E1.31 multicast group of a universe, 239.255.hi.lo
+ip4_addr_t E131Group(uint16_t universe){
+  ip4_addr_t group;
+  IP4_ADDR(&group, 239, 255, universe >> 8, universe & 0xFF);
+  return group;
+}
+
+udp_pcb* RealtimeListen(uint16_t port){
+  udp_pcb* pcb = udp_new();
+  if (!pcb) return NULL;
+
+  if (udp_bind(pcb, IP_ADDR_ANY, port) != ERR_OK){
+    udp_remove(pcb);
+    return NULL;
+  }
+
+  udp_recv(pcb, RealtimeReceive, NULL);
+  return pcb;
+}
+
+void RealtimeEnd(){
+  if (realtime.e131){
+    ip4_addr_t group = E131Group(realtime.universe);
+    igmp_leavegroup(IP4_ADDR_ANY4, &group);
+    udp_remove(realtime.e131);
+    realtime.e131 = NULL;
+  }
+  if (realtime.artnet){
+    udp_remove(realtime.artnet);
+    realtime.artnet = NULL;
+  }
+  realtime.fresh = false;
+}
+
+//  Starts listening on both ports, the network has to be up to join the multicast group
+bool RealtimeBegin(uint16_t universe, uint16_t address, uint16_t playoutDelay){
+  RealtimeEnd();
+
+  realtime.universe = universe;
+  realtime.address = address ? address : 1;
+  realtime.playoutDelay = playoutDelay;
+  JitterReset(realtime.jitter);
+  realtime.sequenced = false;
+  realtime.terminated = false;
+
+  realtime.e131 = RealtimeListen(E131_PORT);
+  realtime.artnet = RealtimeListen(ARTNET_PORT);
+
+  ip4_addr_t group = E131Group(universe);
+  igmp_joingroup(IP4_ADDR_ANY4, &group);
+
+  return realtime.e131 && realtime.artnet;
+}
+
+//  Called once per frame when it reaches the outputs, with the micros() it arrived at
+void RealtimeFrameShown(uint32_t receivedAt){
+  uint32_t latency = micros() - receivedAt;
+  realtime.stats.latency = latency;
+  realtime.stats.latencyAverage = realtime.stats.latencyAverage ? realtime.stats.latencyAverage + ((int32_t)(latency - realtime.stats.latencyAverage) >> 3) : latency;
+  if (latency > realtime.stats.latencyMax) realtime.stats.latencyMax = latency;
+}
+
+//  The channels from the jitter buffer at now, 0..max, false while nothing
+//  is due. The latency of a frame is taken when it starts being played.
+bool RealtimePlayout(uint32_t now, int32_t out[LIGHT_CHANNEL_COUNT], int32_t max){
+  uint32_t played = realtime.jitter.played;
+  if (!JitterPlayout(realtime.jitter, now, out, max)) return false;
+
+  if (realtime.jitter.played != played) RealtimeFrameShown(realtime.jitter.frames[0].arrival);
+  return true;
+}
+
+#endif
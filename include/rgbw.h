@@ -0,0 +1,136 @@
+/*
+    rgbw.h - RGB to RGBW conversion and colour temperature rendering
+
+    The white LED is modelled as an RGB mix: driving it at COLOUR_MAX
+    produces the same light as the red, green and blue LEDs driven at the
+    values of the colour temperature it was binned for. White extraction
+    moves as much of an RGB colour as possible into the white channel.
+
+    Colour temperatures are rendered through a table of RGBW values at
+    full brightness, one entry every CCT_STEP Kelvin. It is rebuilt from
+    the PROGMEM Planckian locus table whenever the white point changes.
+*/
+
+#ifndef RGBW_H
+#define RGBW_H
+
+#include <Arduino.h>
+#include "colourspace.h"
+#include "board.h"
+
+#define CCT_MIN 1700
+#define CCT_MAX 10000
+#define CCT_STEP 100
+#define CCT_TABLE_SIZE ((CCT_MAX - CCT_MIN) / CCT_STEP + 1)
+
+struct rgbwColour{
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
+  uint16_t w;
+};
+
+//  Planckian locus in linear sRGB, brightest channel normalised to COLOUR_MAX
+const uint16_t CctRgbTable[CCT_TABLE_SIZE][3] PROGMEM = {
+  { 1023,  188,    0 }, { 1023,  212,    0 }, { 1023,  237,    0 }, { 1023,  262,    8 },  //  1700 K
+  { 1023,  287,   18 }, { 1023,  311,   29 }, { 1023,  336,   41 }, { 1023,  359,   55 },  //  2100 K
+  { 1023,  382,   70 }, { 1023,  405,   86 }, { 1023,  427,  102 }, { 1023,  448,  120 },  //  2500 K
+  { 1023,  469,  139 }, { 1023,  490,  158 }, { 1023,  509,  178 }, { 1023,  529,  199 },  //  2900 K
+  { 1023,  548,  220 }, { 1023,  566,  242 }, { 1023,  584,  265 }, { 1023,  602,  288 },  //  3300 K
+  { 1023,  619,  312 }, { 1023,  635,  336 }, { 1023,  652,  361 }, { 1023,  668,  386 },  //  3700 K
+  { 1023,  684,  411 }, { 1023,  700,  437 }, { 1023,  715,  462 }, { 1023,  730,  488 },  //  4100 K
+  { 1023,  744,  514 }, { 1023,  758,  540 }, { 1023,  772,  566 }, { 1023,  785,  592 },  //  4500 K
+  { 1023,  798,  618 }, { 1023,  811,  644 }, { 1023,  823,  670 }, { 1023,  835,  695 },  //  4900 K
+  { 1023,  847,  721 }, { 1023,  858,  747 }, { 1023,  869,  772 }, { 1023,  880,  797 },  //  5300 K
+  { 1023,  890,  822 }, { 1023,  901,  847 }, { 1023,  911,  872 }, { 1023,  920,  896 },  //  5700 K
+  { 1023,  930,  921 }, { 1023,  939,  945 }, { 1023,  948,  969 }, { 1023,  957,  992 },  //  6100 K
+  { 1023,  965, 1016 }, { 1008,  959, 1023 }, {  986,  946, 1023 }, {  965,  934, 1023 },  //  6500 K
+  {  946,  922, 1023 }, {  927,  911, 1023 }, {  910,  900, 1023 }, {  893,  890, 1023 },  //  6900 K
+  {  877,  880, 1023 }, {  862,  870, 1023 }, {  847,  861, 1023 }, {  833,  852, 1023 },  //  7300 K
+  {  820,  844, 1023 }, {  807,  835, 1023 }, {  795,  828, 1023 }, {  783,  820, 1023 },  //  7700 K
+  {  772,  813, 1023 }, {  762,  806, 1023 }, {  751,  799, 1023 }, {  741,  792, 1023 },  //  8100 K
+  {  732,  786, 1023 }, {  723,  780, 1023 }, {  714,  774, 1023 }, {  705,  768, 1023 },  //  8500 K
+  {  697,  762, 1023 }, {  689,  757, 1023 }, {  682,  752, 1023 }, {  674,  747, 1023 },  //  8900 K
+  {  667,  742, 1023 }, {  661,  737, 1023 }, {  654,  732, 1023 }, {  648,  728, 1023 },  //  9300 K
+  {  641,  724, 1023 }, {  635,  719, 1023 }, {  630,  715, 1023 }, {  624,  711, 1023 }   //  9700 K
+};
+
+//  RGB equivalent of the white LED at full drive
+rgbColour whitePoint = { COLOUR_MAX, COLOUR_MAX, COLOUR_MAX };
+bool whiteExtractionEnabled = true;
+
+rgbwColour cctTable[CCT_TABLE_SIZE];
+
+uint16_t clampKelvin(uint16_t kelvin){
+  if (kelvin < CCT_MIN) return CCT_MIN;
+  if (kelvin > CCT_MAX) return CCT_MAX;
+  return kelvin;
+}
+
+rgbColour KelvinToRgb(uint16_t kelvin){
+  uint16_t i = (clampKelvin(kelvin) - CCT_MIN + CCT_STEP / 2) / CCT_STEP;
+  rgbColour c = { pgm_read_word(&CctRgbTable[i][0]), pgm_read_word(&CctRgbTable[i][1]), pgm_read_word(&CctRgbTable[i][2]) };
+  return c;
+}
+
+rgbwColour RgbToRgbw(rgbColour c){
+  rgbwColour out = { c.r, c.g, c.b, 0 };
+
+  if (!whiteExtractionEnabled) return out;
+
+  //  The largest white level that fits under all three channels
+  uint32_t w = COLOUR_MAX;
+  if (whitePoint.r) w = min(w, (uint32_t)c.r * COLOUR_MAX / whitePoint.r);
+  if (whitePoint.g) w = min(w, (uint32_t)c.g * COLOUR_MAX / whitePoint.g);
+  if (whitePoint.b) w = min(w, (uint32_t)c.b * COLOUR_MAX / whitePoint.b);
+
+  out.w = w;
+  out.r = clampColour((int32_t)c.r - (int32_t)((w * whitePoint.r) / COLOUR_MAX));
+  out.g = clampColour((int32_t)c.g - (int32_t)((w * whitePoint.g) / COLOUR_MAX));
+  out.b = clampColour((int32_t)c.b - (int32_t)((w * whitePoint.b) / COLOUR_MAX));
+
+  return out;
+}
+
+//  The RGB colour an RGBW colour looks like
+rgbColour RgbwToRgb(rgbwColour c){
+  rgbColour out = {
+    clampColour(c.r + ((uint32_t)c.w * whitePoint.r) / COLOUR_MAX),
+    clampColour(c.g + ((uint32_t)c.w * whitePoint.g) / COLOUR_MAX),
+    clampColour(c.b + ((uint32_t)c.w * whitePoint.b) / COLOUR_MAX) };
+  return out;
+}
+
+void SetWhitePoint(uint16_t kelvin, bool extraction){
+  whitePoint = KelvinToRgb(kelvin);
+  whiteExtractionEnabled = extraction;
+
+  whiteMix[0] = ((uint32_t)whitePoint.r << 16) / COLOUR_MAX;
+  whiteMix[1] = ((uint32_t)whitePoint.g << 16) / COLOUR_MAX;
+  whiteMix[2] = ((uint32_t)whitePoint.b << 16) / COLOUR_MAX;
+
+  for (uint16_t i = 0; i < CCT_TABLE_SIZE; i++) {
+    rgbColour c = { pgm_read_word(&CctRgbTable[i][0]), pgm_read_word(&CctRgbTable[i][1]), pgm_read_word(&CctRgbTable[i][2]) };
+    cctTable[i] = RgbToRgbw(c);
+  }
+}
+
+//  Colour temperature at brightness 0..COLOUR_MAX, interpolated between table entries
+rgbwColour KelvinToRgbw(uint16_t kelvin, uint16_t brightness){
+  uint16_t offset = clampKelvin(kelvin) - CCT_MIN;
+  uint16_t i = offset / CCT_STEP;
+  uint16_t j = (i < CCT_TABLE_SIZE - 1) ? i + 1 : i;
+  int32_t frac = offset % CCT_STEP;
+
+  const rgbwColour& a = cctTable[i];
+  const rgbwColour& b = cctTable[j];
+
+  rgbwColour out = {
+    (uint16_t)(((a.r + ((b.r - a.r) * frac) / CCT_STEP) * (uint32_t)brightness) / COLOUR_MAX),
+    (uint16_t)(((a.g + ((b.g - a.g) * frac) / CCT_STEP) * (uint32_t)brightness) / COLOUR_MAX),
+    (uint16_t)(((a.b + ((b.b - a.b) * frac) / CCT_STEP) * (uint32_t)brightness) / COLOUR_MAX),
+    (uint16_t)(((a.w + ((b.w - a.w) * frac) / CCT_STEP) * (uint32_t)brightness) / COLOUR_MAX) };
+  return out;
+}
+
+#endif
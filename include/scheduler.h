@@ -0,0 +1,98 @@
+/*
+    scheduler.h - Weekly on/off schedule
+
+    The schedule is a handful of rules (appConfig.activationRules), each
+    switching the lights on or off at a local time of day on a set of
+    weekdays, plus a one-shot countdown that is not persisted.
+
+    Nothing here polls the clock. After every change the next due event
+    is worked out once and a single os_timer is armed for it; when it
+    fires, the due action is applied and the next event is planned. With
+    this few rules a linear scan for the earliest one is cheaper than
+    keeping a heap.
+
+    A wake-up rule is due its lead time (the length of the ramp) before
+    the time set in the rule, so the light is fully up at that time.
+
+    Rule times are local times, converted to UTC through the timezone for
+    the day they fall on, so DST changes are taken into account when the
+    event is planned. The timer is never armed for longer than
+    ACTIVATION_MAX_SLEEP, which bounds the error if the clock is
+    corrected by NTP in the meantime.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <Timezone.h>
+
+#define ACTIVATION_NONE 0
+#define ACTIVATION_ON 1
+#define ACTIVATION_OFF 2
+#define ACTIVATION_WAKEUP 3
+
+#define ACTIVATION_ALL_DAYS 0x7F
+#define ACTIVATION_MAX_SLEEP 3600   //  s
+
+struct activationEvent{
+  time_t time;      //  UTC, 0 if there is no event
+  uint8_t action;
+};
+
+//  First time after utc a rule fires, 0 if it never does
+time_t NextRuleTime(const activationRule& rule, time_t utc, Timezone& tz, uint32_t wakeUpLead){
+  if (rule.action == ACTIVATION_NONE || (rule.days & ACTIVATION_ALL_DAYS) == 0) return 0;
+
+  time_t midnight = previousMidnight(tz.toLocal(utc));
+
+  //  Today's time may have passed already, so look up to a week and a day ahead
+  for (uint8_t d = 0; d < 8; d++){
+    time_t day = midnight + d * SECS_PER_DAY;
+    if (!(rule.days & (1 << (weekday(day) - 1)))) continue;
+
+    time_t at = tz.toUTC(day + rule.hour * SECS_PER_HOUR + rule.minute * SECS_PER_MIN);
+    if (rule.action == ACTIVATION_WAKEUP) at -= wakeUpLead;
+    if (at > utc) return at;
+  }
+
+  return 0;
+}
+
+//  The earliest event after utc
+activationEvent NextActivation(const activationRule rules[], uint8_t count, const activationEvent& countdown, time_t utc, Timezone& tz, uint32_t wakeUpLead){
+  activationEvent next = { 0, ACTIVATION_NONE };
+
+  if (countdown.time > utc) next = countdown;
+
+  for (uint8_t i = 0; i < count; i++) {
+    time_t at = NextRuleTime(rules[i], utc, tz, wakeUpLead);
+    if (at && (next.time == 0 || at < next.time)){
+      next.time = at;
+      next.action = rules[i].action;
+    }
+  }
+
+  return next;
+}
+
+//  The latest event in (from, to], ACTIVATION_NONE if none is due
+activationEvent DueActivation(const activationRule rules[], uint8_t count, const activationEvent& countdown, time_t from, time_t to, Timezone& tz, uint32_t wakeUpLead){
+  activationEvent due = { 0, ACTIVATION_NONE };
+
+  if (countdown.time > from && countdown.time <= to) due = countdown;
+
+  for (uint8_t i = 0; i < count; i++) {
+    //  A rule can only fire once in an interval this short
+    time_t at = NextRuleTime(rules[i], from, tz, wakeUpLead);
+    if (at && at <= to && at >= due.time){
+      due.time = at;
+      due.action = rules[i].action;
+    }
+  }
+
+  return due;
+}
+
+#endif
@@ -0,0 +1,245 @@
+/*
+    sequencer.h - Plays keyframe sequences from LittleFS
+
+    A sequence file lives in SEQUENCE_DIRECTORY and is a little endian
+    binary file: a 12 byte header followed by 16 byte keyframes.
+
+      header:   char     magic[4]     "LSQ1"
+                uint16_t count        number of keyframes
+                uint16_t flags        reserved, 0
+                uint32_t length       ms, length of one pass, used to
+                                      time the wrap around when looping
+
+      keyframe: uint32_t time         ms from the start of the sequence,
+                                      keyframes are in ascending order
+                uint16_t r, g, b, w   target, 0..COLOUR_MAX
+                uint16_t duration     ms, the fade to the target
+                uint8_t  easing       SEQUENCE_EASING_*
+                uint8_t  reserved     0
+
+    The file is never loaded as a whole: the player keeps only the
+    keyframe it plays next in its effectState and reads the one after it
+    when that fires, so memory use does not depend on the length of the
+    sequence. The file stays open while the sequence plays and is only
+    opened again when another one is selected, so firing a keyframe in
+    the light tick costs a read, and a seek only when playback jumps.
+    Once, loop and ping-pong playback are set with appConfig.sequenceMode.
+*/
+
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "colourspace.h"
+#include "rgbw.h"
+
+#define SEQUENCE_DIRECTORY "/sequences/"
+#define SEQUENCE_MAGIC "LSQ1"
+
+#define SEQUENCE_MODE_ONCE 0
+#define SEQUENCE_MODE_LOOP 1
+#define SEQUENCE_MODE_PINGPONG 2
+
+#define SEQUENCE_EASING_LINEAR 0
+#define SEQUENCE_EASING_IN 1
+#define SEQUENCE_EASING_OUT 2
+#define SEQUENCE_EASING_IN_OUT 3
+#define SEQUENCE_EASING_STEP 4
+
+struct sequenceHeader{
+  char magic[4];
+  uint16_t count;
+  uint16_t flags;
+  uint32_t length;
+};
+
+struct sequenceKeyframe{
+  uint32_t time;
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
+  uint16_t w;
+  uint16_t duration;
+  uint8_t easing;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(sequenceHeader) == 12, "Sequence header must be 12 bytes");
+static_assert(sizeof(sequenceKeyframe) == 16, "Sequence keyframe must be 16 bytes");
+
+String SequencePath(const char* name){
+  return String(SEQUENCE_DIRECTORY) + name;
+}
+
+//  Checks the header against the size of the file
+bool ReadSequenceHeader(const char* name, sequenceHeader& header){
+  File f = LittleFS.open(SequencePath(name), "r");
+  if (!f) return false;
+
+  bool ok = f.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            memcmp(header.magic, SEQUENCE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.count > 0 &&
+            f.size() == sizeof(header) + (size_t)header.count * sizeof(sequenceKeyframe);
+  f.close();
+  return ok;
+}
+
+//  The sequence being played, kept open from one keyframe to the next
+struct openSequence{
+  File file;
+  char name[32];
+};
+
+openSequence playingSequence;
+
+//  Has to be called before the file of the sequence is written or removed
+void CloseSequence(){
+  if (playingSequence.file) playingSequence.file.close();
+  playingSequence.name[0] = 0;
+}
+
+bool ReadSequenceKeyframe(const char* name, uint16_t index, sequenceKeyframe& keyframe){
+  openSequence& p = playingSequence;
+  if (!p.file || strcmp(p.name, name) != 0){
+    CloseSequence();
+    p.file = LittleFS.open(SequencePath(name), "r");
+    if (!p.file) return false;
+    strlcpy(p.name, name, sizeof(p.name));
+  }
+
+  uint32_t offset = sizeof(sequenceHeader) + (uint32_t)index * sizeof(sequenceKeyframe);
+  if (p.file.position() != offset && !p.file.seek(offset)) return false;
+  return p.file.read((uint8_t*)&keyframe, sizeof(keyframe)) == sizeof(keyframe);
+}
+
+//  Easing curves, t = 0..65535
+uint16_t SequenceEase(uint8_t easing, uint16_t t){
+  uint32_t x = t;
+  switch (easing) {
+    case SEQUENCE_EASING_IN:      return (x * x) >> 16;
+    case SEQUENCE_EASING_OUT:     return 65535 - (((65535 - x) * (65535 - x)) >> 16);
+    case SEQUENCE_EASING_IN_OUT:  return (((x * x) >> 16) * (196608 - 2 * x)) >> 16;
+    case SEQUENCE_EASING_STEP:    return 0;
+    default:                      return t;
+  }
+}
+
+class SequenceEffect{
+  public:
+    static const char Name[];
+
+    struct State{
+      sequenceKeyframe next;    //  the keyframe that fires at nextAt
+      rgbwColour from;
+      rgbwColour to;
+      uint32_t fadeStart;       //  effect time the current fade started
+      uint32_t nextAt;          //  effect time the next keyframe fires
+      uint32_t length;
+      uint32_t firstTime;
+      uint16_t count;
+      uint16_t index;           //  index of the next keyframe
+      uint16_t fadeDuration;
+      uint8_t easing;
+      int8_t direction;
+      bool pending;             //  false once a sequence played once has ended
+    };
+
+    static rgbwColour Colour(const State& s, uint32_t time){
+      uint32_t elapsed = time - s.fadeStart;
+      if (elapsed >= s.fadeDuration) return s.to;
+
+      uint16_t t = SequenceEase(s.easing, ((uint32_t)elapsed << 16) / s.fadeDuration);
+      rgbwColour c = {
+        (uint16_t)lerp16(s.from.r, s.to.r, t),
+        (uint16_t)lerp16(s.from.g, s.to.g, t),
+        (uint16_t)lerp16(s.from.b, s.to.b, t),
+        (uint16_t)lerp16(s.from.w, s.to.w, t) };
+      return c;
+    }
+
+    static void Init(effectState& state, const effectParams& params){
+      State& s = EffectData<State>(state);
+      sequenceHeader header;
+
+      s.from = state.base;
+      s.to = state.base;
+      s.fadeStart = 0;
+      s.fadeDuration = 0;
+      s.easing = SEQUENCE_EASING_LINEAR;
+      s.direction = 1;
+      s.index = 0;
+
+      //  The file may have been uploaded again since it was opened
+      CloseSequence();
+      s.pending = ReadSequenceHeader(appConfig.sequenceFile, header) &&
+                  ReadSequenceKeyframe(appConfig.sequenceFile, 0, s.next);
+
+      if (s.pending){
+        s.count = header.count;
+        s.length = header.length;
+        s.firstTime = s.next.time;
+        s.nextAt = s.next.time;
+      }
+    }
+
+    //  Fires the pending keyframe and fetches the one after it
+    static void Fire(effectState& state, State& s){
+      s.from = Colour(s, s.nextAt);
+      s.to = { s.next.r, s.next.g, s.next.b, s.next.w };
+      s.fadeStart = s.nextAt;
+      s.fadeDuration = s.next.easing == SEQUENCE_EASING_STEP ? 0 : s.next.duration;
+      s.easing = s.next.easing;
+
+      uint32_t firedTime = s.next.time;
+      int32_t index = (int32_t)s.index + s.direction;
+      bool turned = false;
+
+      if (index < 0 || index >= s.count){
+        switch (appConfig.sequenceMode) {
+          case SEQUENCE_MODE_LOOP:
+            index = 0;
+            break;
+
+          case SEQUENCE_MODE_PINGPONG:
+            s.direction = -s.direction;
+            index = s.count > 1 ? (int32_t)s.index + s.direction : s.index;
+            break;
+
+          default:
+            s.pending = false;
+            CloseSequence();
+            return;
+        }
+        turned = true;
+      }
+
+      if (!ReadSequenceKeyframe(appConfig.sequenceFile, index, s.next)){
+        s.pending = false;
+        return;
+      }
+      s.index = index;
+
+      uint32_t gap;
+      if (turned && appConfig.sequenceMode == SEQUENCE_MODE_LOOP)
+        gap = (s.length > firedTime ? s.length - firedTime : 0) + s.firstTime;
+      else
+        gap = s.next.time > firedTime ? s.next.time - firedTime : firedTime - s.next.time;
+
+      //  Never fire more than one keyframe per tick when turning around
+      if (turned && gap == 0) gap = state.tickMs;
+      s.nextAt += gap;
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      State& s = EffectData<State>(state);
+
+      //  Keyframes with the same time fire in the same tick, the last one wins
+      for (uint16_t i = 0; s.pending && state.time >= s.nextAt && i < s.count; i++) Fire(state, s);
+
+      out = Colour(s, state.time);
+    }
+};
+const char SequenceEffect::Name[] PROGMEM = "Sequence";
+
+#endif
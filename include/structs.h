@@ -1,3 +1,16 @@
+struct activationRule{
+  uint8_t days;         //  bit 0 is Sunday
+  uint8_t hour;         //  local time
+  uint8_t minute;
+  uint8_t action;
+};
+
+struct circadianPoint{
+  uint16_t minute;      //  local time of day
+  uint16_t kelvin;
+  uint8_t level;        //  perceptual brightness, 0..255
+};
+
 struct config{
   char ssid[32];
   char password[32];
@@ -11,23 +24,58 @@ struct config{
   int mqttPort;
   char mqttTopic[32];
 
+  char syslogServer[64];          //  empty: no syslog
+  uint16_t syslogPort;
+
   int selectedProgram;
 
   int pwmAdjustmentSpeed;
   int pwmChangeSpeed;
 
-  int activationOnHours;
-  int activationOnMinutes;
-  int activationOnTimerHours;
-  int activationOnTimerMinutes;
+  uint8_t programSaturation;
+  uint8_t programBrightness;
+  uint8_t colourInterpolation;
+
+  uint8_t effectSpeed;
+  uint8_t effectIntensity;
+  uint8_t effectPalette;
+  uint32_t transitionTime;
+
+  char sequenceFile[32];
+  uint8_t sequenceMode;
+
+  uint16_t followDayMinTemperature;
+  uint16_t followDayMaxTemperature;
+  uint8_t followDayBrightness;
+  uint8_t followDayNightBrightness;
+
+  circadianPoint circadianCurve[CIRCADIAN_POINTS];
+  uint8_t circadianPointCount;
+
+  uint8_t wakeUpDuration;         //  minutes
+  uint16_t wakeUpTemperature;
+  uint8_t wakeUpBrightness;
+
+  bool realtimeEnabled;
+  uint16_t realtimeUniverse;
+  uint16_t realtimeAddress;       //  DMX start address
+  uint16_t realtimeTimeout;       //  ms
+  uint16_t realtimePlayoutDelay;  //  ms, 0: no jitter buffer
+
+  uint16_t whiteTemperature;
+  bool whiteExtraction;
+
+  int16_t calibrationMatrix[CALIBRATION_CHANNELS][CALIBRATION_CHANNELS];
+  uint8_t masterBrightness;
 
-  int activationOffHours;
-  int activationOffMinutes;
-  int activationOffTimerHours;
-  int activationOffTimerMinutes;
+  activationRule activationRules[ACTIVATION_RULE_COUNT];
 };
 
 struct sunData_t{
   time_t Sunrise;
   time_t Sunset;
+  time_t CivilDawn;
+  time_t SolarNoon;
+  time_t CivilDusk;
+  time_t Day;           //  days since 1970 these times belong to
 };
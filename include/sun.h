@@ -0,0 +1,78 @@
+/*
+    sun.h - Sun times and the follow day program
+
+    Sunrise, sunset, solar noon and civil twilight for LATITUDE and
+    LONGITUDE are worked out in suntimes.h. That needs trigonometry in
+    software floating point, so it is done once a day: the results are
+    cached in todaysSun and the follow day program only compares and
+    interpolates times on every tick.
+
+    All times are UTC, like now().
+*/
+
+#ifndef SUN_H
+#define SUN_H
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include "rgbw.h"
+#include "suntimes.h"
+
+//  The sun times of the solar day todaysSun.Day, days since 1970
+sunData_t todaysSun = { 0, 0, 0, 0, 0, (time_t)-1 };
+
+//  Sun times of the current day, recomputed when the day changes. Days
+//  change at local solar midnight rather than UTC midnight, so every
+//  event of the night and the day around t is in the same table.
+const sunData_t& GetSunData(time_t t){
+  time_t solarTime = t + (time_t)(LONGITUDE * 240);
+  if (todaysSun.Day != (time_t)elapsedDays(solarTime)) ComputeSunData(solarTime, LATITUDE, LONGITUDE, todaysSun);
+  return todaysSun;
+}
+
+//  Position of t between from and to, 0..65535
+uint16_t SunProgress(time_t t, time_t from, time_t to){
+  if (t <= from || to <= from) return 0;
+  if (t >= to) return 65535;
+  return ((uint64_t)(t - from) << 16) / (to - from);
+}
+
+//  Follow day: warm and dim through twilight, cool and bright at noon
+class FollowDayEffect{
+  public:
+    static const char Name[];
+
+    static void Init(effectState& state, const effectParams& params){
+    }
+
+    static void Tick(effectState& state, const effectParams& params, rgbwColour& out){
+      time_t t = now();
+      const sunData_t& sun = GetSunData(t);
+
+      uint8_t night = appConfig.followDayNightBrightness;
+      uint8_t day = appConfig.followDayBrightness;
+      uint8_t twilight = (night + day) / 2;
+
+      uint16_t kelvin = appConfig.followDayMinTemperature;
+      uint8_t level = night;
+
+      if (t >= sun.CivilDawn && t < sun.Sunrise){
+        level = lerp16(night, twilight, SunProgress(t, sun.CivilDawn, sun.Sunrise));
+      }
+      else if (t >= sun.Sunrise && t < sun.Sunset){
+        //  Up to noon and back down again
+        uint16_t p = t < sun.SolarNoon ? SunProgress(t, sun.Sunrise, sun.SolarNoon) : 65535 - SunProgress(t, sun.SolarNoon, sun.Sunset);
+        p = (((uint32_t)p * p >> 16) * (196608 - 2 * (uint32_t)p)) >> 16;
+        level = lerp16(twilight, day, p);
+        kelvin = lerp16(appConfig.followDayMinTemperature, appConfig.followDayMaxTemperature, p);
+      }
+      else if (t >= sun.Sunset && t < sun.CivilDusk){
+        level = lerp16(twilight, night, SunProgress(t, sun.Sunset, sun.CivilDusk));
+      }
+
+      out = KelvinToRgbw(kelvin, GammaLevel(level));
+    }
+};
+const char FollowDayEffect::Name[] PROGMEM = "Follow day";
+
+#endif
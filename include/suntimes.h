@@ -0,0 +1,87 @@
+/*
+    suntimes.h - Sunrise, sunset, solar noon and civil twilight
+
+    Worked out with the NOAA general solar position equations
+    (https://gml.noaa.gov/grad/solcalc/solareqns.PDF), the declination
+    and the equation of time taken at the time of each event. Within
+    a minute of the full NOAA algorithm away from the polar circles,
+    see test/test_sun.
+
+    All times are UTC, like now().
+*/
+
+#ifndef SUNTIMES_H
+#define SUNTIMES_H
+
+#include <Arduino.h>
+#include <TimeLib.h>
+
+#define SUN_ZENITH_SUNRISE 90.833   //  refraction and the radius of the sun
+#define SUN_ZENITH_CIVIL 96.0
+
+//  Minutes from UTC midnight to the sun crossing a zenith angle on
+//  the way up (rising = true) or down. A sun that never gets there is
+//  clamped to solar noon, one that never leaves it to noon -/+ 12 h.
+double SunCrossing(double zenith, double latitude, double declination, double noon, bool rising){
+  double lat = latitude * DEG_TO_RAD;
+  double c = cos(zenith * DEG_TO_RAD) / (cos(lat) * cos(declination)) - tan(lat) * tan(declination);
+
+  double hourAngle;
+  if (c >= 1.0) hourAngle = 0;                //  polar night
+  else if (c <= -1.0) hourAngle = 180.0;      //  midnight sun
+  else hourAngle = acos(c) * RAD_TO_DEG;
+
+  return rising ? noon - 4.0 * hourAngle : noon + 4.0 * hourAngle;
+}
+
+//  Declination (rad) and equation of time (minutes) at the fractional year g
+void SunPosition(double g, double& declination, double& equationOfTime){
+  equationOfTime = 229.18 * (0.000075 + 0.001868 * cos(g) - 0.032077 * sin(g)
+                             - 0.014615 * cos(2 * g) - 0.040849 * sin(2 * g));
+
+  declination = 0.006918 - 0.399912 * cos(g) + 0.070257 * sin(g)
+                - 0.006758 * cos(2 * g) + 0.000907 * sin(2 * g)
+                - 0.002697 * cos(3 * g) + 0.00148 * sin(3 * g);
+}
+
+//  Minutes from UTC midnight to a sun crossing, or to solar noon for a
+//  zenith of 0. The sun moves enough between noon and twilight to matter,
+//  so its position is taken again at the time of the first estimate.
+double SunEvent(double zenith, double latitude, double longitude, int dayOfYear, int daysInYear, bool rising){
+  double minutes = 720.0 - 4.0 * longitude;
+
+  for (uint8_t pass = 0; pass < 2; pass++) {
+    //  Fractional year. The paper counts the days from 0 on January 1,
+    //  counting them from 1 matches the full algorithm better by about a
+    //  minute over the leap year cycle, see test/test_sun.
+    double g = 2.0 * PI / daysInYear * (dayOfYear + 1 + (minutes - 720.0) / 1440.0);
+    double declination, equationOfTime;
+    SunPosition(g, declination, equationOfTime);
+
+    double noon = 720.0 - 4.0 * longitude - equationOfTime;
+    minutes = zenith > 0 ? SunCrossing(zenith, latitude, declination, noon, rising) : noon;
+  }
+  return minutes;
+}
+
+//  Sun times of the calendar day of t
+void ComputeSunData(time_t t, double latitude, double longitude, sunData_t& sun){
+  time_t midnight = previousMidnight(t);
+
+  tmElements_t tm;
+  breakTime(midnight, tm);
+  tm.Month = 1;
+  tm.Day = 1;
+  int dayOfYear = (midnight - makeTime(tm)) / SECS_PER_DAY;
+  int year = tmYearToCalendar(tm.Year);
+  int daysInYear = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 366 : 365;
+
+  sun.CivilDawn = midnight + (time_t)(SunEvent(SUN_ZENITH_CIVIL, latitude, longitude, dayOfYear, daysInYear, true) * 60.0);
+  sun.Sunrise   = midnight + (time_t)(SunEvent(SUN_ZENITH_SUNRISE, latitude, longitude, dayOfYear, daysInYear, true) * 60.0);
+  sun.SolarNoon = midnight + (time_t)(SunEvent(0, latitude, longitude, dayOfYear, daysInYear, true) * 60.0);
+  sun.Sunset    = midnight + (time_t)(SunEvent(SUN_ZENITH_SUNRISE, latitude, longitude, dayOfYear, daysInYear, false) * 60.0);
+  sun.CivilDusk = midnight + (time_t)(SunEvent(SUN_ZENITH_CIVIL, latitude, longitude, dayOfYear, daysInYear, false) * 60.0);
+  sun.Day = elapsedDays(t);
+}
+
+#endif
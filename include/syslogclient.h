@@ -0,0 +1,101 @@
+/*
+    syslogclient.h - RFC 5424 syslog over UDP, a sink of the event log
+
+    Fire and forget over the raw lwIP UDP API, like NTP.h: the server name
+    is resolved asynchronously when the link comes up, and a message is
+    one datagram handed to lwIP, nothing waits for the network. A record
+    the stack cannot take (no buffer, no route) is left in the ring and
+    sent again on the next call.
+
+    The messages are in the RFC 5424 format, facility local0:
+
+      <134>1 2024-03-01T12:00:00Z fws-1234567 fws - 3.1 [meta sequenceId="18" sysUpTime="234"] Title: data
+
+    with the category and the ID of the event as the MSGID, and the
+    sequence number and uptime of the record in the meta structured data
+    element (the uptime in hundredths of a second, as RFC 5424 has it).
+    A record logged before the clock was set is dated from its uptime
+    when it is replayed; without a clock the timestamp is the NILVALUE.
+*/
+
+#ifndef SYSLOGCLIENT_H
+#define SYSLOGCLIENT_H
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <lwip/udp.h>
+#include <lwip/dns.h>
+
+#define SYSLOG_FACILITY 16          //  local0
+#define SYSLOG_PACKET_SIZE 320
+#define SYSLOG_APP_NAME "fws"
+
+struct syslogClient{
+  udp_pcb* pcb;
+  uint8_t round;            //  tells the DNS callbacks of an old lookup apart
+  bool resolved;
+  ip_addr_t address;
+  uint16_t port;
+  const char* hostname;
+};
+
+syslogClient sysLog;
+
+void SyslogDnsFound(const char* name, const ip_addr_t* address, void* arg){
+  if ((uintptr_t)arg != sysLog.round || !address) return;
+  sysLog.address = *address;
+  sysLog.resolved = true;
+}
+
+//  Resolves the server again, on every new link; an empty name disables syslog
+bool SyslogBegin(const char* server, uint16_t port, const char* hostname){
+  sysLog.round++;
+  sysLog.resolved = false;
+  sysLog.port = port;
+  sysLog.hostname = hostname;
+  if (!*server) return false;
+
+  if (!sysLog.pcb){
+    sysLog.pcb = udp_new();
+    if (!sysLog.pcb) return false;
+  }
+
+  err_t err = dns_gethostbyname(server, &sysLog.address, SyslogDnsFound, (void*)(uintptr_t)sysLog.round);
+  if (err == ERR_OK) sysLog.resolved = true;
+  return err == ERR_OK || err == ERR_INPROGRESS;
+}
+
+void SyslogEnd(){
+  sysLog.round++;
+  sysLog.resolved = false;
+}
+
+bool SyslogReady(){
+  return sysLog.resolved;
+}
+
+bool SyslogSend(const logRecord& r, time_t utcNow){
+  char timestamp[24] = "-";
+  time_t time = LogRecordTime(r, utcNow);
+  if (time){
+    tmElements_t tm;
+    breakTime(time, tm);
+    snprintf(timestamp, sizeof(timestamp), "%04d-%02d-%02dT%02d:%02d:%02dZ", tmYearToCalendar(tm.Year), tm.Month, tm.Day, tm.Hour, tm.Minute, tm.Second);
+  }
+
+  char packet[SYSLOG_PACKET_SIZE];
+  int length = snprintf(packet, sizeof(packet), "<%u>1 %s %s %s - %u.%u [meta sequenceId=\"%lu\" sysUpTime=\"%lu\"] %s%s%s",
+    SYSLOG_FACILITY * 8 + r.header.severity, timestamp, sysLog.hostname, SYSLOG_APP_NAME, r.header.category, r.header.id,
+    (unsigned long)(r.sequence % 2147483647 + 1), (unsigned long)(r.header.uptime / 10), r.title, *r.data ? ": " : "", r.data);
+  if (length < 0) return true;
+  if (length >= (int)sizeof(packet)) length = sizeof(packet) - 1;
+
+  pbuf* p = pbuf_alloc(PBUF_TRANSPORT, length, PBUF_RAM);
+  if (!p) return false;
+  memcpy(p->payload, packet, length);
+  err_t err = udp_sendto(sysLog.pcb, p, &sysLog.address, sysLog.port);
+  pbuf_free(p);
+  return err == ERR_OK;
+}
+
+#endif
@@ -0,0 +1,120 @@
+/*
+    tasks.h - Cooperative task scheduler for the main loop
+
+    Every service of the node is a task in one table, in priority order:
+    on each pass of loop() the due tasks run one after the other from the
+    top, so a task that is due always runs before the ones below it.
+
+    A task is due when
+      - it is an event task and its flag was raised (by an os_timer
+        callback, a receive callback...), the flag is cleared before the
+        task runs,
+      - it is a periodic task and its period has passed, or its flag
+        was raised, which runs it early,
+      - or it is a polled task (neither a flag nor a period), which runs
+        on every pass and returns at once when it has nothing to do.
+
+    Tasks must not block. Each has a time budget: a run that takes longer
+    is counted as an overrun, and the run time statistics are kept so the
+    status page can show which task holds the loop up.
+
+    A periodic task that falls more than a period behind skips the missed
+    runs instead of running them back to back.
+*/
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <Arduino.h>
+
+struct task{
+  const char* name;
+  void (*run)();
+  bool* event;            //  event task: raised to run it
+  uint32_t period;        //  periodic task: us between runs
+  uint32_t budget;        //  us a run may take
+
+  //  Statistics
+  uint32_t due;           //  micros() of the next periodic run
+  uint32_t runs;
+  uint32_t overruns;
+  uint32_t lastTime;      //  us the last run took
+  uint32_t maxTime;
+  uint64_t totalTime;
+};
+
+struct taskLoopStats{
+  uint32_t passes;
+  uint32_t lastTime;      //  us the last pass took
+  uint32_t maxTime;
+};
+
+taskLoopStats taskLoop;
+
+bool IsTaskDue(task& t, uint32_t now){
+  if (t.event && *t.event){
+    *t.event = false;
+    return true;
+  }
+
+  if (!t.period) return !t.event;
+  if ((int32_t)(now - t.due) < 0) return false;
+
+  t.due += t.period;
+  if ((int32_t)(now - t.due) >= 0) t.due = now + t.period;
+  return true;
+}
+
+void RunTask(task& t){
+  uint32_t start = micros();
+  t.run();
+  uint32_t elapsed = micros() - start;
+
+  t.runs++;
+  t.lastTime = elapsed;
+  t.totalTime += elapsed;
+  if (elapsed > t.maxTime) t.maxTime = elapsed;
+  if (elapsed > t.budget) t.overruns++;
+}
+
+//  One pass over the table, running the due tasks in priority order
+void RunTasks(task tasks[], uint8_t count){
+  uint32_t start = micros();
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (IsTaskDue(tasks[i], micros())) RunTask(tasks[i]);
+  }
+
+  uint32_t elapsed = micros() - start;
+  taskLoop.passes++;
+  taskLoop.lastTime = elapsed;
+  if (elapsed > taskLoop.maxTime) taskLoop.maxTime = elapsed;
+}
+
+//  us until the next periodic task is due, 0 if an event is waiting
+uint32_t TaskIdleTime(const task tasks[], uint8_t count){
+  uint32_t now = micros();
+  uint32_t idle = UINT32_MAX;
+
+  for (uint8_t i = 0; i < count; i++) {
+    if (tasks[i].event && *tasks[i].event) return 0;
+    if (!tasks[i].period) continue;
+
+    int32_t left = tasks[i].due - now;
+    if (left <= 0) return 0;
+    if ((uint32_t)left < idle) idle = left;
+  }
+  return idle;
+}
+
+//  Periodic tasks start a period after this
+void StartTasks(task tasks[], uint8_t count){
+  uint32_t now = micros();
+  for (uint8_t i = 0; i < count; i++) tasks[i].due = now + tasks[i].period;
+}
+
+uint32_t TaskAverageTime(const task& t){
+  return t.runs ? t.totalTime / t.runs : 0;
+}
+
+#endif
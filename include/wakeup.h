@@ -0,0 +1,41 @@
+/*
+    wakeup.h - Wake-up light
+
+    Ramps the output from dark to the wake-up colour over a long time
+    (typically 30-60 minutes), ending at the alarm time. The ramp is not
+    done by the light engine but with the fine dimming level of the
+    output stage (Q16, see calibration.h), so it is not limited to the
+    1023 steps of a channel: the light starts below the first 10 bit step
+    and rises in sub-step increments that are dithered on the PWM.
+
+    The level follows a cube of the elapsed time, which looks like an
+    even rise to the eye.
+*/
+
+#ifndef WAKEUP_H
+#define WAKEUP_H
+
+#include <Arduino.h>
+
+struct wakeUpRamp{
+  bool active;
+  uint32_t start;       //  millis()
+  uint32_t duration;    //  ms
+};
+
+void WakeUpStart(wakeUpRamp& ramp, uint32_t ms, uint32_t duration){
+  ramp.active = true;
+  ramp.start = ms;
+  ramp.duration = duration ? duration : 1;
+}
+
+//  Output level at ms, Q16
+uint16_t WakeUpLevel(const wakeUpRamp& ramp, uint32_t ms){
+  uint32_t elapsed = ms - ramp.start;
+  if (elapsed >= ramp.duration) return OUTPUT_LEVEL_MAX;
+
+  uint32_t p = ((uint64_t)elapsed << 16) / ramp.duration;
+  return (((p * p) >> 16) * p) >> 16;
+}
+
+#endif
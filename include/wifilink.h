@@ -0,0 +1,202 @@
+/*
+    wifilink.h - Non-blocking WiFi station connection
+
+    The connection is started once and then followed through the WiFi
+    event callbacks, nothing here waits for the access point. The
+    connectivity task polls the state and handles the timeouts.
+
+    After every successful connection the BSSID and channel of the access
+    point, and the DHCP lease, are kept in RTC user memory, which
+    survives a reset (but not a power loss). The next connection goes
+    straight to that access point on that channel, without the scan of
+    every channel, and reuses the lease instead of waiting for DHCP. That
+    brings a reconnect after a reset down from several seconds to a few
+    hundred milliseconds. If the cached access point does not answer
+    within WIFI_FAST_CONNECT_TIMEOUT, the cache is dropped and a normal
+    connection with a scan and DHCP is started instead.
+
+    The node has no clock across a reset to tell when the lease expires,
+    so a lease is reused once only: a connection on a reused lease does
+    not cache it again, and the next one asks DHCP. Reusing it at all is
+    an option, off by default (WIFI_REUSE_LEASE), as the address may have
+    been handed to another host in the meantime.
+
+    The cache carries a checksum and a hash of the credentials, so a
+    cache from other firmware or for another network is never used.
+*/
+
+#ifndef WIFILINK_H
+#define WIFILINK_H
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+//  RTC user memory, in 4 byte blocks. Blocks 0 to 31 hold the eboot command
+//  an OTA update leaves for the bootloader, so the cache starts after them.
+#define WIFI_CACHE_RTC_OFFSET 32
+#define WIFI_FAST_CONNECT_TIMEOUT 2000  //  ms
+
+#define WIFI_LINK_IDLE 0
+#define WIFI_LINK_CONNECTING 1
+#define WIFI_LINK_CONNECTED 2
+#define WIFI_LINK_FAILED 3
+
+struct wifiCache{
+  uint32_t checksum;
+  uint32_t credentials;   //  hash of the SSID and password
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t hasLease;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t mask;
+  uint32_t dns;
+};
+
+static_assert(sizeof(wifiCache) % 4 == 0, "RTC memory is written in 4 byte blocks");
+static_assert(WIFI_CACHE_RTC_OFFSET * 4 + sizeof(wifiCache) <= 512, "The cache must fit the 512 bytes of RTC user memory");
+
+struct wifiLink{
+  uint8_t state;
+  bool fast;              //  trying the cached access point
+  bool reuseLease;
+  bool leaseReused;       //  the address was set from the cache, not by DHCP
+  uint32_t started;       //  millis() of the connection start or the drop
+  uint32_t timeout;       //  ms
+  uint32_t connectTime;   //  ms the last connection took
+  bool lastFast;          //  and whether it came from the cache
+  uint32_t disconnects;
+  const char* ssid;
+  const char* password;
+  wifiCache cache;
+  WiFiEventHandler gotIpHandler;
+  WiFiEventHandler disconnectedHandler;
+};
+
+wifiLink wifi;
+
+//  Raised on every change of the link, to wake the connectivity task
+bool wifiLinkChanged = false;
+
+//  FNV-1a
+uint32_t HashBytes(uint32_t hash, const uint8_t* p, size_t length){
+  while (length--) hash = (hash ^ *p++) * 16777619UL;
+  return hash;
+}
+
+uint32_t WiFiCacheChecksum(const wifiCache& c){
+  return HashBytes(2166136261UL, (const uint8_t*)&c + sizeof(c.checksum), sizeof(c) - sizeof(c.checksum));
+}
+
+uint32_t WiFiCredentialsHash(const char* ssid, const char* password){
+  uint32_t hash = HashBytes(2166136261UL, (const uint8_t*)ssid, strlen(ssid) + 1);
+  return HashBytes(hash, (const uint8_t*)password, strlen(password) + 1);
+}
+
+bool LoadWiFiCache(wifiCache& c, uint32_t credentials){
+  if (!ESP.rtcUserMemoryRead(WIFI_CACHE_RTC_OFFSET, (uint32_t*)&c, sizeof(c))) return false;
+  return c.checksum == WiFiCacheChecksum(c) && c.credentials == credentials && c.channel >= 1 && c.channel <= 14;
+}
+
+void SaveWiFiCache(wifiCache& c){
+  c.checksum = WiFiCacheChecksum(c);
+  ESP.rtcUserMemoryWrite(WIFI_CACHE_RTC_OFFSET, (uint32_t*)&c, sizeof(c));
+}
+
+void ClearWiFiCache(){
+  memset(&wifi.cache, 0, sizeof(wifi.cache));
+  ESP.rtcUserMemoryWrite(WIFI_CACHE_RTC_OFFSET, (uint32_t*)&wifi.cache, sizeof(wifi.cache));
+}
+
+void WiFiLinkGotIp(const WiFiEventStationModeGotIP& event){
+  wifi.state = WIFI_LINK_CONNECTED;
+  wifi.connectTime = millis() - wifi.started;
+  wifi.lastFast = wifi.fast;
+  wifi.fast = false;
+
+  wifi.cache.credentials = WiFiCredentialsHash(wifi.ssid, wifi.password);
+  memcpy(wifi.cache.bssid, WiFi.BSSID(), sizeof(wifi.cache.bssid));
+  wifi.cache.channel = WiFi.channel();
+  wifi.cache.hasLease = wifi.reuseLease && !wifi.leaseReused;
+  wifi.cache.ip = WiFi.localIP();
+  wifi.cache.gateway = WiFi.gatewayIP();
+  wifi.cache.mask = WiFi.subnetMask();
+  wifi.cache.dns = WiFi.dnsIP(0);
+  SaveWiFiCache(wifi.cache);
+
+  wifiLinkChanged = true;
+}
+
+//  The SDK reconnects by itself, the timeout counts from the drop
+void WiFiLinkDisconnected(const WiFiEventStationModeDisconnected& event){
+  if (wifi.state != WIFI_LINK_CONNECTED) return;
+
+  wifi.state = WIFI_LINK_CONNECTING;
+  wifi.started = millis();
+  wifi.disconnects++;
+  wifiLinkChanged = true;
+}
+
+//  Normal connection: scan for the access point, address from DHCP
+void WiFiLinkBeginFull(){
+  WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));
+  WiFi.begin(wifi.ssid, wifi.password);
+  wifi.fast = false;
+  wifi.leaseReused = false;
+}
+
+//  Starts connecting and returns at once. The credentials must stay valid while connected.
+void WiFiLinkBegin(const char* ssid, const char* password, uint32_t timeout, bool reuseLease){
+  wifi.ssid = ssid;
+  wifi.password = password;
+  wifi.timeout = timeout;
+  wifi.reuseLease = reuseLease;
+  wifi.started = millis();
+  wifi.state = WIFI_LINK_CONNECTING;
+
+  if (!wifi.gotIpHandler){
+    wifi.gotIpHandler = WiFi.onStationModeGotIP(WiFiLinkGotIp);
+    wifi.disconnectedHandler = WiFi.onStationModeDisconnected(WiFiLinkDisconnected);
+  }
+
+  //  The cache replaces the copy the SDK would write to flash on every begin
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(true);
+  WiFi.mode(WIFI_STA);
+
+  if (!LoadWiFiCache(wifi.cache, WiFiCredentialsHash(ssid, password))){
+    WiFiLinkBeginFull();
+    return;
+  }
+
+  wifi.leaseReused = reuseLease && wifi.cache.hasLease;
+  if (wifi.leaseReused)
+    WiFi.config(IPAddress(wifi.cache.ip), IPAddress(wifi.cache.gateway), IPAddress(wifi.cache.mask), IPAddress(wifi.cache.dns));
+  else
+    WiFi.config(IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0), IPAddress(0, 0, 0, 0));
+
+  WiFi.begin(ssid, password, wifi.cache.channel, wifi.cache.bssid);
+  wifi.fast = true;
+}
+
+//  Falls back from the cache and gives up on the timeout, returns the state
+uint8_t WiFiLinkPoll(){
+  if (wifi.state != WIFI_LINK_CONNECTING) return wifi.state;
+
+  uint32_t elapsed = millis() - wifi.started;
+
+  if (wifi.fast && elapsed >= WIFI_FAST_CONNECT_TIMEOUT){
+    ClearWiFiCache();
+    WiFi.disconnect(false);
+    WiFiLinkBeginFull();
+  }
+
+  if (elapsed >= wifi.timeout){
+    WiFi.disconnect(false);
+    wifi.state = WIFI_LINK_FAILED;
+  }
+
+  return wifi.state;
+}
+
+#endif
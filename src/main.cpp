@@ -4,20 +4,15 @@
 IRrecv irrecv(IR_RECEIVE_GPIO);
 IRsend irsend(IR_SEND_GPIO);
 
+//  The PWM channels of the board (see board.h) and their manually set values
 struct pwmOutput{
   char gpio;
   const char* name;
-  uint value;
   uint desiredValue;
-} pwmOutputs[4] = {
-  {16, "Red",   1, 0 },
-  {12, "Green", 1, 0 },
-  {13, "Blue",  1, 0 },
-  { 2, "White", 1, 0 }
-};
+} pwmOutputs[LIGHT_CHANNEL_COUNT] = LIGHT_CHANNELS;
 
-//  Web server
-ESP8266WebServer server(80);
+//  Web server, counting the responses by route (see metrics.h)
+meteredWebServer server(80);
 
 //  Initialize Wifi
 WiFiClient wclient;
@@ -26,40 +21,111 @@ PubSubClient PSclient(wclient);
 //  Timers and their flags
 os_timer_t heartbeatTimer;
 os_timer_t pwmAdjustmentTimer;
-os_timer_t pwmModifierTimer;
 os_timer_t accessPointTimer;
+os_timer_t activationTimer;
 
-//  Flags
+//  Flags, raised by the events task from the timer events
 bool needsHeartbeat = false;
 bool needsPwmAdjustment = false;
-bool needsPwmModify = false;
+bool needsActivation = false;
+
+//  Light engine ticks due and not run yet, and the ones given up on
+uint32_t pendingLightTicks = 0;
+uint32_t skippedLightTicks = 0;
+
+//  The light engine and the colour it rendered last
+compositor lightCompositor;
+bool lightsOn = true;
+rgbwColour lightColour = { 0, 0, 0, 0 };
+
+//  The schedule
+activationEvent activationCountdown = { 0, ACTIVATION_NONE };
+activationEvent nextActivation = { 0, ACTIVATION_NONE };
+time_t lastActivationCheck = 0;
+
+//  Fine dimming level of the output stage, Q16, and the dither state of its fraction bits
+uint16_t outputLevel = OUTPUT_LEVEL_MAX;
+outputDither outputDithering;
+
+//  Wake-up light
+wakeUpRamp wakeUp = { false, 0, 0 };
+
+//  Values last written to the PWM outputs, after calibration
+uint16_t outputValues[LIGHT_CHANNEL_COUNT];
 
 //  Other global variables
 config appConfig;
 bool isAccessPoint = false;
 bool isAccessPointCreated = false;
-TimeChangeRule *tcr;        // Pointer to the time change rule
 decode_results results;
 bool ntpInitialized = false;
 enum CONNECTION_STATE connectionState;
 
+//  The task table, filled in after the task functions
+#define TASK_COUNT 13
+extern task tasks[TASK_COUNT];
+
+//  The sinks of the event log, filled in after their functions
+#define LOG_SINK_COUNT 2
+extern logSink logSinks[LOG_SINK_COUNT];
+
 WiFiUDP Udp;
 
+//  Publishes and counts the message for /metrics
+bool MqttPublish(const char* topic, const char* payload, bool retained){
+  bool sent = PSclient.publish(topic, payload, retained);
+  if (sent) mqttStats.published++;
+  else mqttStats.publishFailed++;
+  return sent;
+}
+
+//  The syslog severity of an event category
+uint8_t LogSeverity(int Category){
+  switch (Category){
+    case EVENTCATEGORIES::PageHandler:
+      return LOG_SEVERITY_DEBUG;
+    case EVENTCATEGORIES::Authentication:
+    case EVENTCATEGORIES::Login:
+    case EVENTCATEGORIES::Reboot:
+    case EVENTCATEGORIES::Conn:
+      return LOG_SEVERITY_NOTICE;
+    default:
+      return LOG_SEVERITY_INFO;
+  }
+}
+
+//  Keeps the event in the log buffer and forwards it to the sinks that are up,
+//  the others get it when they come up. Debug events (page requests) are not
+//  kept, only sent to the sinks that are up (see eventlog.h).
 void LogEvent(int Category, int ID, String Title, String Data){
-  if (PSclient.connected()){
+  LogRecordEvent(logSinks, LOG_SINK_COUNT, LogSeverity(Category), Category, ID, ntp.set ? now() : 0, Title.c_str(), Data.c_str());
+}
 
-    String msg = "{";
+bool MqttLogReady(){
+  return PSclient.connected();
+}
 
-    msg += "\"Node\":" + (String)ESP.getChipId() + ",";
-    msg += "\"Category\":" + (String)Category + ",";
-    msg += "\"ID\":" + (String)ID + ",";
-    msg += "\"Title\":\"" + Title + "\",";
-    msg += "\"Data\":\"" + Data + "\"}";
+bool MqttLogSend(const logRecord& r){
+  char msg[LOG_TITLE_SIZE + LOG_DATA_SIZE + 128];
+  snprintf(msg, sizeof(msg), "{\"Node\":%u,\"Category\":%u,\"ID\":%u,\"Title\":\"%s\",\"Data\":\"%s\",\"Sequence\":%lu,\"Uptime\":%lu,\"Time\":%lu}",
+    ESP.getChipId(), r.header.category, r.header.id, r.title, r.data, (unsigned long)r.sequence, (unsigned long)r.header.uptime,
+    (unsigned long)LogRecordTime(r, ntp.set ? now() : 0));
 
-    Serial.println(msg);
+  return MqttPublish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/log").c_str(), msg, false);
+}
 
-    PSclient.publish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/log").c_str(), msg.c_str(), false);
-  }
+bool SyslogLogSend(const logRecord& r){
+  return SyslogSend(r, ntp.set ? now() : 0);
+}
+
+logSink logSinks[LOG_SINK_COUNT] = {
+  //  name, ready, send
+  { "Syslog",   SyslogReady,    SyslogLogSend },
+  { "MQTT",     MqttLogReady,   MqttLogSend }
+};
+
+time_t LocalNow(){
+  return ToLocalTime(appConfig.timeZone, now());
 }
 
 void SetRandomSeed(){
@@ -84,15 +150,59 @@ void accessPointTimerCallback(void *pArg) {
 }
 
 void heartbeatTimerCallback(void *pArg) {
-  needsHeartbeat = true;
+  PostEvent(loopEvents, EVENT_HEARTBEAT);
 }
 
 void pwmAdjustmentTimerCallback(void *pArg) {
-  needsPwmAdjustment = true;
+  PostEvent(loopEvents, EVENT_LIGHT_TICK);
+}
+
+void activationTimerCallback(void *pArg) {
+  PostEvent(loopEvents, EVENT_ACTIVATION);
+}
+
+//  Reads [[minute, kelvin, level], ...], returns the number of points or 0 if the curve is not valid
+uint8_t ReadCircadianCurve(JsonArray array, circadianPoint curve[]){
+  if (array.size() == 0 || array.size() > CIRCADIAN_POINTS) return 0;
+
+  uint8_t count = 0;
+  for (JsonArray point : array) {
+    int minute = point[0].as<int>();
+    if (point.size() != 3 || minute < 0 || minute >= CIRCADIAN_MINUTES_PER_DAY) return 0;
+    curve[count].minute = minute;
+    curve[count].kelvin = clampKelvin(point[1].as<int>());
+    curve[count].level = constrain(point[2].as<int>(), 0, 255);
+    count++;
+  }
+  if (count != array.size()) return 0;
+
+  SortCircadianCurve(curve, count);
+  return count;
+}
+
+//  Reads the calibration matrix, row major. False when an entry is missing,
+//  not an integer or out of the int16_t range, leaving the matrix untouched.
+bool ReadCalibrationMatrix(JsonArray array, int16_t matrix[CALIBRATION_CHANNELS][CALIBRATION_CHANNELS]){
+  if (array.size() != CALIBRATION_CHANNELS * CALIBRATION_CHANNELS) return false;
+
+  int16_t m[CALIBRATION_CHANNELS][CALIBRATION_CHANNELS];
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS * CALIBRATION_CHANNELS; i++) {
+    long v = array[i].as<long>();
+    if (!array[i].is<long>() || v < INT16_MIN || v > INT16_MAX) return false;
+    m[i / CALIBRATION_CHANNELS][i % CALIBRATION_CHANNELS] = v;
+  }
+
+  memcpy(matrix, m, sizeof(m));
+  return true;
 }
 
-void pwmModifierTimerCallback(void *pArg) {
-  needsPwmModify = true;
+void WriteCircadianCurve(JsonArray array){
+  for (uint8_t i = 0; i < appConfig.circadianPointCount; i++) {
+    JsonArray point = array.createNestedArray();
+    point.add(appConfig.circadianCurve[i].minute);
+    point.add(appConfig.circadianCurve[i].kelvin);
+    point.add(appConfig.circadianCurve[i].level);
+  }
 }
 
 bool loadSettings(config& data) {
@@ -104,7 +214,7 @@ bool loadSettings(config& data) {
   }
 
   size_t size = configFile.size();
-  if (size > 1024) {
+  if (size > CONFIG_FILE_MAX_SIZE) {
     Serial.println("Config file size is too large");
     LogEvent(EVENTCATEGORIES::System, 2, "FS failure", "Config file size is too large.");
     return false;
@@ -120,7 +230,7 @@ bool loadSettings(config& data) {
   configFile.close();
 
   StaticJsonDocument<JSON_SETTINGS_SIZE> doc;
-  DeserializationError error = deserializeJson(doc, buf.get());
+  DeserializationError error = deserializeJson(doc, buf.get(), size);
 
   if (error) {
     Serial.println("Failed to parse config file");
@@ -166,6 +276,22 @@ bool loadSettings(config& data) {
     appConfig.mqttPort = DEFAULT_MQTT_PORT;
   }
 
+  if (doc["syslogServer"]){
+    strcpy(appConfig.syslogServer, doc["syslogServer"]);
+  }
+  else
+  {
+    appConfig.syslogServer[0] = 0;
+  }
+
+  if (doc["syslogPort"]){
+    appConfig.syslogPort = doc["syslogPort"];
+  }
+  else
+  {
+    appConfig.syslogPort = DEFAULT_SYSLOG_PORT;
+  }
+
   if (doc["mqttTopic"]){
     strcpy(appConfig.mqttTopic, doc["mqttTopic"]);
   }
@@ -222,11 +348,214 @@ bool loadSettings(config& data) {
     appConfig.pwmChangeSpeed = 5;
   }
 
+  if (doc["programSaturation"]){
+    appConfig.programSaturation = doc["programSaturation"];
+  }
+  else
+  {
+    appConfig.programSaturation = DEFAULT_PROGRAM_SATURATION;
+  }
+
+  if (doc["programBrightness"]){
+    appConfig.programBrightness = doc["programBrightness"];
+  }
+  else
+  {
+    appConfig.programBrightness = DEFAULT_PROGRAM_BRIGHTNESS;
+  }
+
+  if (doc["colourInterpolation"]){
+    appConfig.colourInterpolation = doc["colourInterpolation"];
+  }
+  else
+  {
+    appConfig.colourInterpolation = COLOUR_INTERPOLATION_HUE;
+  }
+
+  if (doc["effectSpeed"]){
+    appConfig.effectSpeed = doc["effectSpeed"];
+  }
+  else
+  {
+    appConfig.effectSpeed = DEFAULT_EFFECT_SPEED;
+  }
+
+  if (doc["effectIntensity"]){
+    appConfig.effectIntensity = doc["effectIntensity"];
+  }
+  else
+  {
+    appConfig.effectIntensity = DEFAULT_EFFECT_INTENSITY;
+  }
+
+  if (doc["effectPalette"]){
+    appConfig.effectPalette = doc["effectPalette"];
+  }
+  else
+  {
+    appConfig.effectPalette = DEFAULT_EFFECT_PALETTE;
+  }
+
+  if (doc["sequenceFile"]){
+    strlcpy(appConfig.sequenceFile, doc["sequenceFile"], sizeof(appConfig.sequenceFile));
+  }
+  else
+  {
+    appConfig.sequenceFile[0] = 0;
+  }
+
+  if (doc.containsKey("sequenceMode")){
+    appConfig.sequenceMode = doc["sequenceMode"];
+  }
+  else
+  {
+    appConfig.sequenceMode = DEFAULT_SEQUENCE_MODE;
+  }
+
+  if (doc["followDayMinTemperature"]){
+    appConfig.followDayMinTemperature = doc["followDayMinTemperature"];
+  }
+  else
+  {
+    appConfig.followDayMinTemperature = DEFAULT_FOLLOW_DAY_MIN_TEMPERATURE;
+  }
+
+  if (doc["followDayMaxTemperature"]){
+    appConfig.followDayMaxTemperature = doc["followDayMaxTemperature"];
+  }
+  else
+  {
+    appConfig.followDayMaxTemperature = DEFAULT_FOLLOW_DAY_MAX_TEMPERATURE;
+  }
+
+  if (doc.containsKey("followDayBrightness")){
+    appConfig.followDayBrightness = doc["followDayBrightness"];
+  }
+  else
+  {
+    appConfig.followDayBrightness = DEFAULT_FOLLOW_DAY_BRIGHTNESS;
+  }
+
+  if (doc.containsKey("followDayNightBrightness")){
+    appConfig.followDayNightBrightness = doc["followDayNightBrightness"];
+  }
+  else
+  {
+    appConfig.followDayNightBrightness = DEFAULT_FOLLOW_DAY_NIGHT_BRIGHTNESS;
+  }
+
+  if (doc["wakeUpDuration"]){
+    appConfig.wakeUpDuration = doc["wakeUpDuration"];
+  }
+  else
+  {
+    appConfig.wakeUpDuration = DEFAULT_WAKEUP_DURATION;
+  }
+
+  if (doc["wakeUpTemperature"]){
+    appConfig.wakeUpTemperature = doc["wakeUpTemperature"];
+  }
+  else
+  {
+    appConfig.wakeUpTemperature = DEFAULT_WAKEUP_TEMPERATURE;
+  }
+
+  if (doc["wakeUpBrightness"]){
+    appConfig.wakeUpBrightness = doc["wakeUpBrightness"];
+  }
+  else
+  {
+    appConfig.wakeUpBrightness = DEFAULT_WAKEUP_BRIGHTNESS;
+  }
+
+  appConfig.realtimeEnabled = doc["realtimeEnabled"];
+
+  if (doc["realtimeUniverse"]){
+    appConfig.realtimeUniverse = doc["realtimeUniverse"];
+  }
+  else
+  {
+    appConfig.realtimeUniverse = DEFAULT_REALTIME_UNIVERSE;
+  }
+
+  if (doc["realtimeAddress"]){
+    appConfig.realtimeAddress = doc["realtimeAddress"];
+  }
+  else
+  {
+    appConfig.realtimeAddress = DEFAULT_REALTIME_ADDRESS;
+  }
+
+  if (doc["realtimeTimeout"]){
+    appConfig.realtimeTimeout = doc["realtimeTimeout"];
+  }
+  else
+  {
+    appConfig.realtimeTimeout = DEFAULT_REALTIME_TIMEOUT;
+  }
+
+  if (doc.containsKey("realtimePlayoutDelay")){
+    appConfig.realtimePlayoutDelay = doc["realtimePlayoutDelay"];
+  }
+  else
+  {
+    appConfig.realtimePlayoutDelay = DEFAULT_REALTIME_PLAYOUT_DELAY;
+  }
+
+  if (doc.containsKey("transitionTime")){
+    appConfig.transitionTime = doc["transitionTime"];
+  }
+  else
+  {
+    appConfig.transitionTime = DEFAULT_TRANSITION_TIME;
+  }
+
+  if (doc["whiteTemperature"]){
+    appConfig.whiteTemperature = doc["whiteTemperature"];
+  }
+  else
+  {
+    appConfig.whiteTemperature = DEFAULT_WHITE_TEMPERATURE;
+  }
+
+  if (doc.containsKey("whiteExtraction")){
+    appConfig.whiteExtraction = doc["whiteExtraction"];
+  }
+  else
+  {
+    appConfig.whiteExtraction = true;
+  }
+
+  if (!ReadCalibrationMatrix(doc["calibration"], appConfig.calibrationMatrix))
+  {
+    CalibrationIdentity(appConfig.calibrationMatrix);
+  }
+
+  appConfig.circadianPointCount = ReadCircadianCurve(doc["circadian"], appConfig.circadianCurve);
+  if (appConfig.circadianPointCount == 0) CircadianDefaults(appConfig.circadianCurve, appConfig.circadianPointCount);
+
+  JsonArray activationRules = doc["activationRules"];
+  for (uint8_t i = 0; i < ACTIVATION_RULE_COUNT; i++) {
+    JsonArray rule = activationRules[i];
+    appConfig.activationRules[i].days = rule[0];
+    appConfig.activationRules[i].hour = constrain(rule[1].as<int>(), 0, 23);
+    appConfig.activationRules[i].minute = constrain(rule[2].as<int>(), 0, 59);
+    appConfig.activationRules[i].action = constrain(rule[3].as<int>(), ACTIVATION_NONE, ACTIVATION_WAKEUP);
+  }
+
+  if (doc.containsKey("masterBrightness")){
+    appConfig.masterBrightness = doc["masterBrightness"];
+  }
+  else
+  {
+    appConfig.masterBrightness = MASTER_BRIGHTNESS_MAX;
+  }
+
   return true;
 }
 
 bool saveSettings() {
-  StaticJsonDocument<1024> doc;
+  StaticJsonDocument<JSON_SETTINGS_SIZE> doc;
 
   doc["ssid"] = appConfig.ssid;
   doc["password"] = appConfig.password;
@@ -239,9 +568,51 @@ bool saveSettings() {
   doc["mqttPort"] = appConfig.mqttPort;
   doc["mqttTopic"] = appConfig.mqttTopic;
 
+  doc["syslogServer"] = appConfig.syslogServer;
+  doc["syslogPort"] = appConfig.syslogPort;
+
   doc["selectedProgram"] = appConfig.selectedProgram;
   doc["pwmAdjustmentSpeed"] = appConfig.pwmAdjustmentSpeed;
   doc["pwmChangeSpeed"] = appConfig.pwmChangeSpeed;
+  doc["programSaturation"] = appConfig.programSaturation;
+  doc["programBrightness"] = appConfig.programBrightness;
+  doc["colourInterpolation"] = appConfig.colourInterpolation;
+  doc["effectSpeed"] = appConfig.effectSpeed;
+  doc["effectIntensity"] = appConfig.effectIntensity;
+  doc["effectPalette"] = appConfig.effectPalette;
+  doc["transitionTime"] = appConfig.transitionTime;
+  doc["sequenceFile"] = appConfig.sequenceFile;
+  doc["sequenceMode"] = appConfig.sequenceMode;
+  doc["followDayMinTemperature"] = appConfig.followDayMinTemperature;
+  doc["followDayMaxTemperature"] = appConfig.followDayMaxTemperature;
+  doc["followDayBrightness"] = appConfig.followDayBrightness;
+  doc["followDayNightBrightness"] = appConfig.followDayNightBrightness;
+  doc["wakeUpDuration"] = appConfig.wakeUpDuration;
+  doc["wakeUpTemperature"] = appConfig.wakeUpTemperature;
+  doc["wakeUpBrightness"] = appConfig.wakeUpBrightness;
+  doc["realtimeEnabled"] = appConfig.realtimeEnabled;
+  doc["realtimeUniverse"] = appConfig.realtimeUniverse;
+  doc["realtimeAddress"] = appConfig.realtimeAddress;
+  doc["realtimeTimeout"] = appConfig.realtimeTimeout;
+  doc["realtimePlayoutDelay"] = appConfig.realtimePlayoutDelay;
+  doc["whiteTemperature"] = appConfig.whiteTemperature;
+  doc["whiteExtraction"] = appConfig.whiteExtraction;
+
+  JsonArray calibration = doc.createNestedArray("calibration");
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS * CALIBRATION_CHANNELS; i++)
+    calibration.add(appConfig.calibrationMatrix[i / CALIBRATION_CHANNELS][i % CALIBRATION_CHANNELS]);
+  doc["masterBrightness"] = appConfig.masterBrightness;
+
+  WriteCircadianCurve(doc.createNestedArray("circadian"));
+
+  JsonArray activationRules = doc.createNestedArray("activationRules");
+  for (uint8_t i = 0; i < ACTIVATION_RULE_COUNT; i++) {
+    JsonArray rule = activationRules.createNestedArray();
+    rule.add(appConfig.activationRules[i].days);
+    rule.add(appConfig.activationRules[i].hour);
+    rule.add(appConfig.activationRules[i].minute);
+    rule.add(appConfig.activationRules[i].action);
+  }
 
   doc["friendlyName"] = appConfig.friendlyName;
   #ifdef __debugSettings
@@ -277,6 +648,9 @@ void defaultSettings(){
   sprintf(defaultSSID, "%s-%u", DEFAULT_MQTT_TOPIC, ESP.getChipId());
   strcpy(appConfig.mqttTopic, defaultSSID);
 
+  appConfig.syslogServer[0] = 0;
+  appConfig.syslogPort = DEFAULT_SYSLOG_PORT;
+
   appConfig.timeZone = 2;
 
   strcpy(appConfig.friendlyName, NODE_DEFAULT_FRIENDLY_NAME);
@@ -284,6 +658,41 @@ void defaultSettings(){
 
   appConfig.pwmAdjustmentSpeed = DEFAULT_PWM_ADJUSTMENT_SPEED;
   appConfig.pwmChangeSpeed = DEFAULT_PWM_CHANGE_SPEED;
+  appConfig.programSaturation = DEFAULT_PROGRAM_SATURATION;
+  appConfig.programBrightness = DEFAULT_PROGRAM_BRIGHTNESS;
+  appConfig.colourInterpolation = COLOUR_INTERPOLATION_HUE;
+
+  appConfig.effectSpeed = DEFAULT_EFFECT_SPEED;
+  appConfig.effectIntensity = DEFAULT_EFFECT_INTENSITY;
+  appConfig.effectPalette = DEFAULT_EFFECT_PALETTE;
+  appConfig.transitionTime = DEFAULT_TRANSITION_TIME;
+  appConfig.sequenceFile[0] = 0;
+  appConfig.sequenceMode = DEFAULT_SEQUENCE_MODE;
+
+  appConfig.followDayMinTemperature = DEFAULT_FOLLOW_DAY_MIN_TEMPERATURE;
+  appConfig.followDayMaxTemperature = DEFAULT_FOLLOW_DAY_MAX_TEMPERATURE;
+  appConfig.followDayBrightness = DEFAULT_FOLLOW_DAY_BRIGHTNESS;
+  appConfig.followDayNightBrightness = DEFAULT_FOLLOW_DAY_NIGHT_BRIGHTNESS;
+
+  appConfig.wakeUpDuration = DEFAULT_WAKEUP_DURATION;
+  appConfig.wakeUpTemperature = DEFAULT_WAKEUP_TEMPERATURE;
+  appConfig.wakeUpBrightness = DEFAULT_WAKEUP_BRIGHTNESS;
+
+  appConfig.realtimeEnabled = false;
+  appConfig.realtimeUniverse = DEFAULT_REALTIME_UNIVERSE;
+  appConfig.realtimeAddress = DEFAULT_REALTIME_ADDRESS;
+  appConfig.realtimeTimeout = DEFAULT_REALTIME_TIMEOUT;
+  appConfig.realtimePlayoutDelay = DEFAULT_REALTIME_PLAYOUT_DELAY;
+
+  appConfig.whiteTemperature = DEFAULT_WHITE_TEMPERATURE;
+  appConfig.whiteExtraction = true;
+
+  CalibrationIdentity(appConfig.calibrationMatrix);
+  appConfig.masterBrightness = MASTER_BRIGHTNESS_MAX;
+
+  memset(appConfig.activationRules, 0, sizeof(appConfig.activationRules));
+
+  CircadianDefaults(appConfig.circadianCurve, appConfig.circadianPointCount);
 
   appConfig.heartbeatInterval = DEFAULT_HEARTBEAT_INTERVAL;
 
@@ -295,132 +704,539 @@ void defaultSettings(){
   }
 }
 
-String DateTimeToString(time_t time){
+void PublishPwmResult(uint i){
+  if (PSclient.connected()){
+    MqttPublish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/RESULT").c_str(), ("{\"PWM" + (String)i + "\":\"" + (String)pwmOutputs[i].desiredValue + "\"}" ).c_str(), 0);
+  }
+}
 
-  String myTime = "";
-  char s[2];
+#ifdef LIGHT_PIXEL_STRIP
+//  Pixel mapped rainbow: while the Rainbow program runs and no realtime
+//  stream is shown, pixel i shows the light with its hue turned by
+//  i / PIXEL_STRIP_LENGTH of the wheel, so the whole wheel is spread along
+//  the strip and moves with the program. Every pixel goes through the
+//  output stage on its own, rounded rather than dithered, at most once
+//  every PIXEL_STRIP_FRAME_MS.
+void WritePixelRainbow(){
+  static uint32_t lastFrame = 0;
+  if (millis() - lastFrame < PIXEL_STRIP_FRAME_MS || !PixelStripReady()) return;
+
+  rgbColour light = { lightColour.r, lightColour.g, lightColour.b };
+  hsvColour hsv = RgbToHsv(light);
+  uint16_t coldShare = ColdWhiteShare(appConfig.whiteTemperature);
+
+  for (uint16_t i = 0; i < PIXEL_STRIP_LENGTH; i++) {
+    hsvColour h = { (uint16_t)((hsv.h + (uint32_t)i * HUE_MAX / PIXEL_STRIP_LENGTH) % HUE_MAX), hsv.s, hsv.v };
+    rgbColour c = HsvToRgb(h);
+    uint16_t in[CALIBRATION_CHANNELS] = { c.r, c.g, c.b, lightColour.w };
+    int32_t calibrated[CALIBRATION_CHANNELS], mapped[LIGHT_CHANNEL_COUNT];
+    uint16_t out[LIGHT_CHANNEL_COUNT];
+
+    ApplyCalibration(appConfig.calibrationMatrix, appConfig.masterBrightness, outputLevel, in, calibrated);
+    MapLightChannels(calibrated, mapped, coldShare, CALIBRATION_MAX_OUTPUT);
+    RoundOutputs(mapped, out);
+    for (uint8_t c = 0; c < LIGHT_CHANNEL_COUNT; c++) strip.pixels[i][c] = out[c];
+  }
 
-  //  years
-  itoa(year(time), s, DEC);
-  myTime+= s;
-  myTime+="-";
+  if (PixelStripShow()) lastFrame = millis();
 
+  //  The strip is not one colour any more, so the next plain frame always goes out
+  memset(outputValues, 0xFF, sizeof(outputValues));
+}
+#endif
+
+//  Output stage: colour correction, master brightness and level, the channels
+//  of the board, dithering, then the PWM hardware
+void WriteOutputs(){
+#ifdef LIGHT_PIXEL_STRIP
+  if (!realtime.active && GetEffect(appConfig.selectedProgram).tick == RainbowEffect::Tick){
+    WritePixelRainbow();
+    return;
+  }
+#endif
+
+  uint16_t in[CALIBRATION_CHANNELS] = { lightColour.r, lightColour.g, lightColour.b, lightColour.w };
+  int32_t calibrated[CALIBRATION_CHANNELS], mapped[LIGHT_CHANNEL_COUNT];
+  uint16_t out[LIGHT_CHANNEL_COUNT];
+
+  ApplyCalibration(appConfig.calibrationMatrix, appConfig.masterBrightness, outputLevel, in, calibrated);
+  MapLightChannels(calibrated, mapped, ColdWhiteShare(appConfig.whiteTemperature), CALIBRATION_MAX_OUTPUT);
+  if (power.idle) RoundOutputs(mapped, out);
+  else DitherOutputs(outputDithering, mapped, out);
+
+#ifdef LIGHT_PIXEL_STRIP
+  //  Every pixel shows the light, a frame is sent whenever it changes
+  if (memcmp(out, outputValues, sizeof(out)) == 0) return;
+  memcpy(outputValues, out, sizeof(out));
+  PixelStripFill(out);
+  if (!PixelStripShow()) memset(outputValues, 0xFF, sizeof(outputValues));   //  dropped, send it next tick
+#else
+  for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    if (out[i] != outputValues[i]){
+      analogWrite(pwmOutputs[i].gpio, out[i]);
+      outputValues[i] = out[i];
+    }
+  }
+#endif
+}
 
-  //  months
-  itoa(month(time), s, DEC);
-  myTime+= s;
-  myTime+="-";
+//  The manually set colour, the colour of program 0. It is kept as the
+//  desired values of the board's channels, so it maps to and from RGBW.
+rgbwColour GetDesiredColour(){
+  int32_t channels[LIGHT_CHANNEL_COUNT], rgbw[4];
+  for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) channels[i] = pwmOutputs[i].desiredValue;
 
-  //  days
-  itoa(day(time), s, DEC);
-  myTime+= s;
+  UnmapLightChannels(channels, rgbw, COLOUR_MAX);
+  rgbwColour c = { clampColour(rgbw[0]), clampColour(rgbw[1]), clampColour(rgbw[2]), clampColour(rgbw[3]) };
+  return c;
+}
 
-  myTime+=" ";
+//  Sets the desired values of the channels to an RGBW colour and publishes them
+void StoreDesiredColour(rgbwColour c){
+  int32_t rgbw[4] = { c.r, c.g, c.b, c.w }, channels[LIGHT_CHANNEL_COUNT];
+  MapLightChannels(rgbw, channels, ColdWhiteShare(appConfig.whiteTemperature), COLOUR_MAX);
 
-  //  hours
-  itoa(hour(time), s, DEC);
-  myTime+= s;
-  myTime+=":";
+  for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    pwmOutputs[i].desiredValue = channels[i];
+    PublishPwmResult(i);
+  }
+}
 
-  //  minutes
-  if(minute(time) <10)
-    myTime+="0";
+effectParams GetProgramParams(){
+  effectParams params = { appConfig.effectSpeed, appConfig.effectIntensity, appConfig.effectPalette };
+  return params;
+}
 
-  itoa(minute(time), s, DEC);
-  myTime+= s;
-  myTime+=":";
+//  Ends a wake-up ramp early, e.g. when the light is changed by hand
+void StopWakeUp(){
+  wakeUp.active = false;
+  outputLevel = OUTPUT_LEVEL_MAX;
+}
 
-  //  seconds
-  if(second(time) <10)
-    myTime+="0";
+//  Crossfades to the selected program, switching the lights on
+void StartProgram(){
+  StopWakeUp();
+  lightsOn = true;
+  CompositorTransition(lightCompositor, appConfig.selectedProgram, GetProgramParams(), GetDesiredColour(), appConfig.pwmAdjustmentSpeed, appConfig.transitionTime);
+}
 
-  itoa(second(time), s, DEC);
-  myTime+= s;
+//  Fades to dark without forgetting the program or the colour
+void SwitchLights(bool on){
+  if (on){
+    StartProgram();
+    return;
+  }
 
-  return myTime;
+  rgbwColour black = { 0, 0, 0, 0 };
+  StopWakeUp();
+  lightsOn = false;
+  CompositorTransition(lightCompositor, 0, GetProgramParams(), black, appConfig.pwmAdjustmentSpeed, appConfig.transitionTime);
 }
 
-String TimeIntervalToString(time_t time){
-
-  String myTime = "";
-  char s[2];
+//  Ramps up from dark to the wake-up colour in duration ms
+void StartWakeUp(uint32_t duration){
+  rgbwColour colour = KelvinToRgbw(appConfig.wakeUpTemperature, GammaLevel(appConfig.wakeUpBrightness));
 
-  //  hours
-  itoa((time/3600), s, DEC);
-  myTime+= s;
-  myTime+=":";
+  lightsOn = true;
+  CompositorStart(lightCompositor, 0, GetProgramParams(), colour, appConfig.pwmAdjustmentSpeed);
+  outputLevel = 0;
+  WakeUpStart(wakeUp, millis(), duration);
+}
 
-  //  minutes
-  if(minute(time) <10)
-    myTime+="0";
+//  Crossfades to a stored preset, O(1) from the RAM copy of the bank
+bool RecallPreset(uint8_t id){
+  const preset* p = GetPreset(id);
+  if (!p){
+    LogEvent(EVENTCATEGORIES::System, 9, "Unknown preset", (String)id);
+    return false;
+  }
 
-  itoa(minute(time), s, DEC);
-  myTime+= s;
-  myTime+=":";
+  StoreDesiredColour(ScaleRgbw(p->colour, GammaLevel(p->brightness)));
 
-  //  seconds
-  if(second(time) <10)
-    myTime+="0";
+  appConfig.selectedProgram = p->program < EFFECT_COUNT ? p->program : 0;
+  StartProgram();
+  LogEvent(EVENTCATEGORIES::System, 10, "Preset recalled", (String)id);
+  return true;
+}
 
-  itoa(second(time), s, DEC);
-  myTime+= s;
-  return myTime;
+//  Stores the manually set colour and the selected program
+bool StoreCurrentPreset(uint8_t id, uint8_t brightness){
+  if (!StorePreset(id, GetDesiredColour(), brightness, appConfig.selectedProgram)) return false;
+  LogEvent(EVENTCATEGORIES::System, 11, "Preset stored", (String)id);
+  return true;
 }
 
-bool is_authenticated(){
-  #ifdef __debugSettings
+bool RemovePreset(uint8_t id){
+  if (!DeletePreset(id)) return false;
+  LogEvent(EVENTCATEGORIES::System, 12, "Preset deleted", (String)id);
   return true;
-  #endif
-  if (server.hasHeader("Cookie")){
-    String cookie = server.header("Cookie");
-    if (cookie.indexOf("EspAuth=1") != -1) {
-      LogEvent(EVENTCATEGORIES::Authentication, 1, "Success", "");
-      return true;
-    }
-  }
-  LogEvent(EVENTCATEGORIES::Authentication, 2, "Failure", "");
+}
+
+//  Recall, store or delete from a JSON command, false if there was none. The
+//  brightness of a stored preset has a key of its own, "brightness" is the
+//  master brightness of the calibration, which can come in the same command.
+bool RunPresetCommand(JsonVariant doc){
+  if (doc.containsKey("preset")) return RecallPreset(doc["preset"].as<int>());
+  if (doc.containsKey("store")) return StoreCurrentPreset(doc["store"].as<int>(), doc.containsKey("presetBrightness") ? constrain(doc["presetBrightness"].as<int>(), 0, 255) : 255);
+  if (doc.containsKey("delete")) return RemovePreset(doc["delete"].as<int>());
   return false;
 }
 
-void handleLogin(){
-  String msg = "";
-  if (server.hasHeader("Cookie")){
-    String cookie = server.header("Cookie");
-  }
-  if (server.hasArg("DISCONNECT")){
-    String header = "HTTP/1.1 301 OK\r\nSet-Cookie: EspAuth=0\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-    server.sendContent(header);
-    LogEvent(EVENTCATEGORIES::Login, 1, "Logout", "");
-    return;
-  }
-  if (server.hasArg("username") && server.hasArg("password")){
-    if (server.arg("username") == ADMIN_USERNAME &&  server.arg("password") == ADMIN_PASSWORD ){
-      String header = "HTTP/1.1 301 OK\r\nSet-Cookie: EspAuth=1\r\nLocation: /status.html\r\nCache-Control: no-cache\r\n\r\n";
-      server.sendContent(header);
-      LogEvent(EVENTCATEGORIES::Login, 2, "Success", "User name: " + server.arg("username"));
-      return;
-    }
-    msg = "<div class=\"alert alert-danger\"><strong>Error!</strong> Wrong user name and/or password specified.<a href=\"#\" class=\"close\" data-dismiss=\"alert\" aria-label=\"close\">&times;</a></div>";
-    LogEvent(EVENTCATEGORIES::Login, 2, "Failure", "User name: " + server.arg("username") + " - Password: " + server.arg("password"));
+//  Crossfades to the manually set colour, leaving any running program. Leaving
+//  it is saved, so a reboot does not bring the old program back.
+void ShowDesiredColour(){
+  if (appConfig.selectedProgram != 0){
+    appConfig.selectedProgram = 0;
+    saveSettings();
   }
+  StartProgram();
+}
 
-  File f = LittleFS.open("/pageheader.html", "r");
-  String headerString;
-  if (f.available()) headerString = f.readString();
-  f.close();
+void SetDesiredChannel(uint i, uint value){
+  pwmOutputs[i].desiredValue = value;
+  PublishPwmResult(i);
+  ShowDesiredColour();
+}
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+//  Sets the target of all channels
+void SetDesiredColour(rgbwColour c){
+  StoreDesiredColour(c);
+  ShowDesiredColour();
+}
 
-  f = LittleFS.open("/login.html", "r");
+void SetDesiredColour(rgbColour c){
+  SetDesiredColour(RgbToRgbw(c));
+}
 
-  String s, htmlString;
+void SetColourTemperature(uint16_t kelvin, uint16_t brightness){
+  SetDesiredColour(KelvinToRgbw(kelvin, brightness));
+}
 
-  while (f.available()){
-    s = f.readStringUntil('\n');
+void ArmLightEngineTimer(){
+  os_timer_disarm(&pwmAdjustmentTimer);
+  os_timer_arm(&pwmAdjustmentTimer, power.idle ? POWER_IDLE_TICK : appConfig.pwmAdjustmentSpeed, true);
+}
 
-    if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
-    if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
-    if (s.indexOf("%alert%")>-1) s.replace("%alert%", msg);
+//  Fades in from dark to the selected program
+void StartLightEngine(){
+  rgbwColour black = { 0, 0, 0, 0 };
+  CompositorStart(lightCompositor, 0, GetProgramParams(), black, appConfig.pwmAdjustmentSpeed);
+  StartProgram();
+  ArmLightEngineTimer();
+}
+
+//  Realtime channel values, 0..COLOUR_MAX, to the outputs
+void WriteRealtimeChannels(const int32_t channels[LIGHT_CHANNEL_COUNT]){
+  int32_t rgbw[4];
+  UnmapLightChannels(channels, rgbw, COLOUR_MAX);
+
+  lightColour.r = rgbw[0];
+  lightColour.g = rgbw[1];
+  lightColour.b = rgbw[2];
+  lightColour.w = rgbw[3];
+  WriteOutputs();
+}
+
+//  Takes over the outputs when frames start coming. Without a playout delay
+//  the latest frame is shown as it is, with one the light engine tick plays
+//  the jitter buffer out.
+void ShowRealtimeFrame(){
+  realtime.fresh = false;
+
+  if (!realtime.active){
+    realtime.active = true;
+    StopWakeUp();
+    LogEvent(EVENTCATEGORIES::System, 13, "Realtime control", "Started");
+  }
+
+  if (realtime.playoutDelay) return;
+
+  int32_t channels[LIGHT_CHANNEL_COUNT];
+  for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) channels[i] = ((uint32_t)realtime.values[i] * COLOUR_MAX + 127) / 255;
+  WriteRealtimeChannels(channels);
+
+  RealtimeFrameShown(realtime.received);
+}
+
+//  Back to the program when the desk stops sending, fading from the last frame
+void EndRealtime(const char* reason){
+  realtime.active = false;
+  realtime.terminated = false;
+  JitterReset(realtime.jitter);
+
+  CompositorStart(lightCompositor, 0, GetProgramParams(), lightColour, appConfig.pwmAdjustmentSpeed);
+  SwitchLights(lightsOn);
+  LogEvent(EVENTCATEGORIES::System, 13, "Realtime control", reason);
+}
+
+void StartRealtime(){
+  if (realtime.active) EndRealtime("Restarted");
+  RealtimeEnd();
+
+  if (appConfig.realtimeEnabled && !RealtimeBegin(appConfig.realtimeUniverse, appConfig.realtimeAddress, appConfig.realtimePlayoutDelay))
+    LogEvent(EVENTCATEGORIES::System, 14, "Realtime control", "Failed to open the UDP ports");
+}
+
+//  Runs the light engine ticks that became due since the last call
+void AdjustPwm(){
+  uint32_t ticks = pendingLightTicks;
+  pendingLightTicks = 0;
+
+  //  The frames drive the outputs until they stop coming
+  if (realtime.active){
+    if (millis() - realtime.lastFrame <= appConfig.realtimeTimeout){
+      int32_t channels[LIGHT_CHANNEL_COUNT];
+      if (realtime.playoutDelay && RealtimePlayout(micros(), channels, COLOUR_MAX)) WriteRealtimeChannels(channels);
+      return;
+    }
+    EndRealtime("Timed out");
+  }
+
+  //  Every missed tick is run, so fades keep their length when the loop was late
+  if (ticks > LIGHT_ENGINE_MAX_CATCH_UP){
+    skippedLightTicks += ticks - LIGHT_ENGINE_MAX_CATCH_UP;
+    ticks = LIGHT_ENGINE_MAX_CATCH_UP;
+  }
+  while (ticks--) CompositorTick(lightCompositor, lightColour);
+
+  if (wakeUp.active){
+    outputLevel = WakeUpLevel(wakeUp, millis());
+    if (outputLevel == OUTPUT_LEVEL_MAX) wakeUp.active = false;
+  }
+
+  WriteOutputs();
+}
+
+//  Accepts {"calibration":[16 values, Q12, row major], "brightness":0..255}, either key is optional.
+//  A matrix with an entry out of the int16_t range rejects the whole command.
+bool SetCalibration(JsonVariant doc){
+  bool changed = false;
+
+  if (doc.containsKey("calibration")){
+    if (!ReadCalibrationMatrix(doc["calibration"], appConfig.calibrationMatrix)) return false;
+    changed = true;
+  }
+
+  if (doc.containsKey("brightness")){
+    appConfig.masterBrightness = constrain((int)doc["brightness"], 0, MASTER_BRIGHTNESS_MAX);
+    changed = true;
+  }
+
+  if (changed){
+    saveSettings();
+    WriteOutputs();
+    LogEvent(EVENTCATEGORIES::System, 5, "Calibration changed", "Brightness: " + (String)appConfig.masterBrightness);
+  }
+
+  return changed;
+}
+
+void SerializeLatency(JsonObject o, const latencyHistogram& h){
+  o["count"] = h.count;
+  o["mean"] = h.count ? (uint32_t)(h.totalTime / h.count) : 0;
+  o["p50"] = LatencyPercentile(h, 50);
+  o["p99"] = LatencyPercentile(h, 99);
+  o["max"] = h.maxTime;
+  JsonArray buckets = o.createNestedArray("histogram");
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) buckets.add(h.buckets[i]);
+}
+
+//  Times in us; a bucket limit of 0 is the open last bucket
+void SerializeInstrumentation(JsonDocument& doc){
+  doc["uptime"] = millis();
+
+  JsonArray limits = doc.createNestedArray("bucketlimits");
+  for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) limits.add(LatencyBucketLimit(i));
+
+  SerializeLatency(doc.createNestedObject("loop"), loopLatency);
+  SerializeLatency(doc.createNestedObject("ticklateness"), tickLateness);
+
+  JsonArray taskList = doc.createNestedArray("tasks");
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    JsonObject t = taskList.createNestedObject();
+    t["name"] = tasks[i].name;
+    t["runs"] = tasks[i].runs;
+    t["overruns"] = tasks[i].overruns;
+    t["mean"] = TaskAverageTime(tasks[i]);
+    t["max"] = tasks[i].maxTime;
+    t["total"] = (uint32_t)(tasks[i].totalTime / 1000);   //  ms
+  }
+
+  JsonArray sections = doc.createNestedArray("sections");
+  for (uint8_t i = 0; i < LATENCY_SECTIONS && latencySections[i].tag; i++) {
+    const latencySection& l = latencySections[i];
+    JsonObject s = sections.createNestedObject();
+    s["tag"] = l.tag;
+    s["calls"] = l.calls;
+    s["last"] = l.lastTime;
+    s["mean"] = (uint32_t)(l.totalTime / l.calls);
+    s["max"] = l.maxTime;
+    s["maxat"] = l.maxAt;
+  }
+
+  uint32_t free, maxBlock;
+  uint8_t fragmentation;
+  ESP.getHeapStats(&free, &maxBlock, &fragmentation);
+  JsonObject heap = doc.createNestedObject("heap");
+  heap["free"] = free;
+  heap["minfree"] = minFreeHeap;
+  heap["maxblock"] = maxBlock;
+  heap["fragmentation"] = fragmentation;
+}
+
+void SerializeCalibration(JsonDocument& doc){
+  JsonArray calibration = doc.createNestedArray("calibration");
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS * CALIBRATION_CHANNELS; i++)
+    calibration.add(appConfig.calibrationMatrix[i / CALIBRATION_CHANNELS][i % CALIBRATION_CHANNELS]);
+  doc["brightness"] = appConfig.masterBrightness;
+}
+
+//  Accepts {"circadian":[[minute of day, kelvin, level 0..255], ...]}
+bool SetCircadianCurve(JsonVariant doc){
+  circadianPoint curve[CIRCADIAN_POINTS];
+  uint8_t count = ReadCircadianCurve(doc["circadian"], curve);
+  if (count == 0) return false;
+
+  memcpy(appConfig.circadianCurve, curve, sizeof(curve));
+  appConfig.circadianPointCount = count;
+
+  saveSettings();
+  LogEvent(EVENTCATEGORIES::System, 8, "Circadian curve changed", "Points: " + (String)count);
+  return true;
+}
+
+void SerializeCircadianCurve(JsonDocument& doc){
+  WriteCircadianCurve(doc.createNestedArray("circadian"));
+}
+
+//  Arms the activation timer for the next scheduled event
+void PlanActivation(){
+  os_timer_disarm(&activationTimer);
+  nextActivation.time = 0;
+
+  if (timeStatus() == timeNotSet) return;
+
+  time_t t = now();
+  lastActivationCheck = t;
+  nextActivation = NextActivation(appConfig.activationRules, ACTIVATION_RULE_COUNT, activationCountdown, t, *timezones[appConfig.timeZone], appConfig.wakeUpDuration * SECS_PER_MIN);
+  if (!nextActivation.time) return;
+
+  time_t wait = nextActivation.time - t;
+  if (wait > ACTIVATION_MAX_SLEEP) wait = ACTIVATION_MAX_SLEEP;
+  os_timer_arm(&activationTimer, wait * 1000, false);
+}
+
+//  Applies whatever became due since the last check and plans the next event
+void RunActivation(){
+  time_t t = now();
+  uint32_t lead = appConfig.wakeUpDuration * SECS_PER_MIN;
+  activationEvent due = DueActivation(appConfig.activationRules, ACTIVATION_RULE_COUNT, activationCountdown, lastActivationCheck, t, *timezones[appConfig.timeZone], lead);
+
+  if (due.action == ACTIVATION_WAKEUP){
+    //  Finish at the alarm time even if the timer fired late
+    time_t alarm = due.time + lead;
+    StartWakeUp(alarm > t ? (alarm - t) * 1000 : 0);
+    LogEvent(EVENTCATEGORIES::System, 7, "Scheduled switch", "Wake-up");
+  }
+  else if (due.action != ACTIVATION_NONE){
+    SwitchLights(due.action == ACTIVATION_ON);
+    LogEvent(EVENTCATEGORIES::System, 7, "Scheduled switch", due.action == ACTIVATION_ON ? "On" : "Off");
+  }
+
+  PlanActivation();
+}
+
+//  Sequence files are stored flat in SEQUENCE_DIRECTORY
+bool IsValidSequenceName(const String& name){
+  return name.length() > 0 && name.length() < sizeof(appConfig.sequenceFile) && name.indexOf('/') < 0;
+}
+
+//  Switches to the sequence program playing a sequence file, mode < 0 keeps the current mode
+bool SelectSequence(const String& name, int mode){
+  sequenceHeader header;
+  if (!IsValidSequenceName(name) || !ReadSequenceHeader(name.c_str(), header)) return false;
+
+  strlcpy(appConfig.sequenceFile, name.c_str(), sizeof(appConfig.sequenceFile));
+  if (mode >= SEQUENCE_MODE_ONCE && mode <= SEQUENCE_MODE_PINGPONG) appConfig.sequenceMode = mode;
+  appConfig.selectedProgram = FindEffect(SequenceEffect::Tick);
+
+  saveSettings();
+  StartProgram();
+  LogEvent(EVENTCATEGORIES::System, 6, "Sequence selected", name);
+  return true;
+}
+
+String DateTimeToString(time_t time){
+  char s[DATETIME_STRING_SIZE];
+  return FormatDateTime(s, time);
+}
+
+String TimeIntervalToString(time_t time){
+  char s[INTERVAL_STRING_SIZE];
+  return FormatTimeInterval(s, time);
+}
+
+//  301 to location, sent through send() so /metrics counts it
+void SendRedirect(const char* location){
+  server.sendHeader("Location", location);
+  server.sendHeader("Cache-Control", "no-cache");
+  server.send(301);
+}
+
+bool is_authenticated(){
+  #ifdef __debugSettings
+  return true;
+  #endif
+  if (server.hasHeader("Cookie")){
+    String cookie = server.header("Cookie");
+    if (cookie.indexOf("EspAuth=1") != -1) {
+      LogEvent(EVENTCATEGORIES::Authentication, 1, "Success", "");
+      return true;
+    }
+  }
+  LogEvent(EVENTCATEGORIES::Authentication, 2, "Failure", "");
+  return false;
+}
+
+void handleLogin(){
+  String msg = "";
+  if (server.hasHeader("Cookie")){
+    String cookie = server.header("Cookie");
+  }
+  if (server.hasArg("DISCONNECT")){
+    server.sendHeader("Set-Cookie", "EspAuth=0");
+    SendRedirect("/login.html");
+    LogEvent(EVENTCATEGORIES::Login, 1, "Logout", "");
+    return;
+  }
+  if (server.hasArg("username") && server.hasArg("password")){
+    if (server.arg("username") == ADMIN_USERNAME &&  server.arg("password") == ADMIN_PASSWORD ){
+      server.sendHeader("Set-Cookie", "EspAuth=1");
+      SendRedirect("/status.html");
+      LogEvent(EVENTCATEGORIES::Login, 2, "Success", "User name: " + server.arg("username"));
+      return;
+    }
+    msg = "<div class=\"alert alert-danger\"><strong>Error!</strong> Wrong user name and/or password specified.<a href=\"#\" class=\"close\" data-dismiss=\"alert\" aria-label=\"close\">&times;</a></div>";
+    LogEvent(EVENTCATEGORIES::Login, 2, "Failure", "User name: " + server.arg("username") + " - Password: " + server.arg("password"));
+  }
+
+  File f = LittleFS.open("/pageheader.html", "r");
+  String headerString;
+  if (f.available()) headerString = f.readString();
+  f.close();
+
+  time_t localTime = LocalNow();
+
+  f = LittleFS.open("/login.html", "r");
+
+  String s, htmlString;
+
+  while (f.available()){
+    s = f.readStringUntil('\n');
+
+    if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
+    if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
+    if (s.indexOf("%alert%")>-1) s.replace("%alert%", msg);
 
     htmlString+=s;
   }
@@ -433,8 +1249,7 @@ void handleRoot() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "/");
 
   if (!is_authenticated()){
-    String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-    server.sendContent(header);
+    SendRedirect("/login.html");
     return;
   }
 
@@ -443,7 +1258,7 @@ void handleRoot() {
   if (f.available()) headerString = f.readString();
   f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
   f = LittleFS.open("/index.html", "r");
 
@@ -473,8 +1288,7 @@ void handleStatus() {
 
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "status.html");
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
   }
 
@@ -483,7 +1297,7 @@ void handleStatus() {
   if (f.available()) headerString = f.readString();
   f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
   String FirmwareVersionString = String(FIRMWARE_VERSION);
   String s;
@@ -492,6 +1306,12 @@ void handleStatus() {
 
   String htmlString, ds18b20list;
 
+  String tasklist;
+  for (uint i = 0; i < TASK_COUNT; i++) {
+    tasklist += "<tr><td>" + String(tasks[i].name) + "</td><td>" + String(tasks[i].runs) + "</td><td>" + String(TaskAverageTime(tasks[i])) +
+      "</td><td>" + String(tasks[i].maxTime) + "</td><td>" + String(tasks[i].budget) + "</td><td>" + String(tasks[i].overruns) + "</td></tr>";
+  }
+
   while (f.available()){
     s = f.readStringUntil('\n');
 
@@ -505,6 +1325,8 @@ void handleStatus() {
     if (s.indexOf("%firmwareversion%")>-1) s.replace("%firmwareversion%", FirmwareVersionString);
     if (s.indexOf("%uptime%")>-1) s.replace("%uptime%", TimeIntervalToString(millis()/1000));
     if (s.indexOf("%currenttime%")>-1) s.replace("%currenttime%", DateTimeToString(localTime));
+    if (s.indexOf("%timesync%")>-1) s.replace("%timesync%", !ntp.updates ? "Not synchronized" :
+      String(ntp.server) + ", offset " + String((int32_t)(ntp.offset / 1000)) + " ms, round trip " + String(ntp.delay / 1000) + " ms");
     if (s.indexOf("%lastresetreason%")>-1) s.replace("%lastresetreason%", ESP.getResetReason());
     if (s.indexOf("%flashchipsize%")>-1) s.replace("%flashchipsize%",String(ESP.getFlashChipSize()));
     if (s.indexOf("%flashchipspeed%")>-1) s.replace("%flashchipspeed%",String(ESP.getFlashChipSpeed()));
@@ -513,6 +1335,32 @@ void handleStatus() {
     if (s.indexOf("%friendlyname%")>-1) s.replace("%friendlyname%",appConfig.friendlyName);
     if (s.indexOf("%mqtt-topic%")>-1) s.replace("%mqtt-topic%",appConfig.mqttTopic);
 
+    //  Tasks
+    if (s.indexOf("%tasklist%")>-1) s.replace("%tasklist%", tasklist);
+    if (s.indexOf("%looppasses%")>-1) s.replace("%looppasses%", String(taskLoop.passes));
+    if (s.indexOf("%timerevents%")>-1) s.replace("%timerevents%", String(loopEvents.taken) + " taken, " + String(DroppedEvents(loopEvents)) + " dropped, queue up to " +
+      String(loopEvents.maxDepth) + ", waited up to " + String(loopEvents.maxLatency) + " us, " + String(skippedLightTicks) + " light engine ticks skipped");
+    if (s.indexOf("%eventlog%")>-1){
+      String sinks;
+      for (uint8_t i = 0; i < LOG_SINK_COUNT; i++)
+        sinks += "; " + String(logSinks[i].name) + " " + String(logSinks[i].sent) + " sent, " + String(logSinks[i].lost) + " lost, " +
+          String(eventLogBuffer.nextSequence - logSinks[i].next.sequence) + " waiting";
+      s.replace("%eventlog%", String(eventLogBuffer.nextSequence - eventLogBuffer.firstSequence) + " events kept (" +
+        String(eventLogBuffer.head - eventLogBuffer.tail) + " bytes), " + String(eventLogBuffer.dropped) + " dropped" + sinks);
+    }
+    if (s.indexOf("%power%")>-1) s.replace("%power%", String(power.idle ? (power.lightSleep ? "Idle, light sleep" : "Idle, modem sleep") : "Active") + ", asleep " +
+      String(PowerAsleepPercent()) + "% of the time (" + TimeIntervalToString(power.asleep / 1000000) + " asleep, " + TimeIntervalToString(power.awake / 1000000) + " awake; idle " +
+      TimeIntervalToString(power.lightSleepTime / 1000000) + " in light sleep, " + TimeIntervalToString(power.modemSleepTime / 1000000) + " in modem sleep)");
+    if (s.indexOf("%looplatency%")>-1){
+      const latencySection* worst = WorstLatencySection();
+      s.replace("%looplatency%", "median " + String(LatencyPercentile(loopLatency, 50)) + " us, 99% " + String(LatencyPercentile(loopLatency, 99)) + " us, max " +
+        String(loopLatency.maxTime) + " us; light engine ticks late up to " + String(tickLateness.maxTime) + " us" +
+        (worst ? "; slowest call " + String(worst->tag) + ", " + String(worst->maxTime) + " us" : ""));
+    }
+    if (s.indexOf("%heap%")>-1) s.replace("%heap%", String(ESP.getFreeHeap()) + " bytes free (lowest " + String(minFreeHeap) + "), largest block " +
+      String(ESP.getMaxFreeBlockSize()) + ", " + String(ESP.getHeapFragmentation()) + "% fragmented");
+    if (s.indexOf("%looptime%")>-1) s.replace("%looptime%", String(taskLoop.lastTime) + " us (max " + String(taskLoop.maxTime) + " us)");
+
     //  Network settings
     switch (WiFi.getMode()) {
       case WIFI_AP:
@@ -522,6 +1370,8 @@ void handleStatus() {
         if (s.indexOf("%ssid%")>-1) s.replace("%ssid%",String(WiFi.SSID()));
         if (s.indexOf("%subnetmask%")>-1) s.replace("%subnetmask%","n/a");
         if (s.indexOf("%gateway%")>-1) s.replace("%gateway%","n/a");
+        if (s.indexOf("%internet%")>-1) s.replace("%internet%","n/a");
+        if (s.indexOf("%mqttbroker%")>-1) s.replace("%mqttbroker%","n/a");
         break;
       case WIFI_STA:
         if (s.indexOf("%wifimode%")>-1) s.replace("%wifimode%", "Station");
@@ -530,6 +1380,8 @@ void handleStatus() {
         if (s.indexOf("%ssid%")>-1) s.replace("%ssid%",String(WiFi.SSID()));
         if (s.indexOf("%subnetmask%")>-1) s.replace("%subnetmask%",WiFi.subnetMask().toString());
         if (s.indexOf("%gateway%")>-1) s.replace("%gateway%",WiFi.gatewayIP().toString());
+        if (s.indexOf("%internet%")>-1) s.replace("%internet%",ReachabilityToString(internetProbe));
+        if (s.indexOf("%mqttbroker%")>-1) s.replace("%mqttbroker%",ReachabilityToString(brokerProbe));
         break;
       default:
         //  This should not happen...
@@ -547,8 +1399,7 @@ void handleGeneralSettings() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "generalsettings.html");
 
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
    }
 
@@ -562,6 +1413,8 @@ void handleGeneralSettings() {
       adjustTime((appConfig.timeZone - oldTimeZone) * SECS_PER_HOUR);
 
       LogEvent(EVENTCATEGORIES::TimeZoneChange, 1, "New time zone", "UTC " + server.arg("timezoneselector"));
+
+      PlanActivation();
     }
 
     if (server.hasArg("friendlyname")){
@@ -600,6 +1453,16 @@ void handleGeneralSettings() {
         }
     }
 
+    //  Syslog settings
+    if (server.hasArg("syslogserver") && (String)appConfig.syslogServer != server.arg("syslogserver")){
+      snprintf(appConfig.syslogServer, sizeof(appConfig.syslogServer), "%s", server.arg("syslogserver").c_str());
+      LogEvent(EVENTCATEGORIES::System, 16, "New syslog server", appConfig.syslogServer);
+    }
+
+    if (server.hasArg("syslogport")){
+      appConfig.syslogPort = constrain(server.arg("syslogport").toInt(), 1, 65535);
+    }
+
     if (mqttDirty)
       PSclient.disconnect();
 
@@ -613,7 +1476,7 @@ void handleGeneralSettings() {
   if (f.available()) headerString = f.readString();
   f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
   f = LittleFS.open("/generalsettings.html", "r");
 
@@ -645,6 +1508,8 @@ void handleGeneralSettings() {
     if (s.indexOf("%mqtt-servername%")>-1) s.replace("%mqtt-servername%", appConfig.mqttServer);
     if (s.indexOf("%mqtt-port%")>-1) s.replace("%mqtt-port%", String(appConfig.mqttPort));
     if (s.indexOf("%mqtt-topic%")>-1) s.replace("%mqtt-topic%", appConfig.mqttTopic);
+    if (s.indexOf("%syslog-servername%")>-1) s.replace("%syslog-servername%", appConfig.syslogServer);
+    if (s.indexOf("%syslog-port%")>-1) s.replace("%syslog-port%", String(appConfig.syslogPort));
     if (s.indexOf("%timezoneslist%")>-1) s.replace("%timezoneslist%", timezoneslist);
     if (s.indexOf("%friendlyname%")>-1) s.replace("%friendlyname%", appConfig.friendlyName);
     if (s.indexOf("%heartbeatinterval%")>-1) s.replace("%heartbeatinterval%", (String)appConfig.heartbeatInterval);
@@ -661,8 +1526,7 @@ void handleNetworkSettings() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "networksettings.html");
 
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
    }
 
@@ -687,12 +1551,14 @@ void handleNetworkSettings() {
   if (f.available()) headerString = f.readString();
   f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
   f = LittleFS.open("/networksettings.html", "r");
   String s, htmlString, wifiList;
 
+  uint32_t scanStart = LatencyStart();
   byte numberOfNetworks = WiFi.scanNetworks();
+  EndLatencySection("scanNetworks", scanStart);
   for (size_t i = 0; i < numberOfNetworks; i++) {
     wifiList+="<div class=\"radio\"><label><input ";
     if (i==0) wifiList+="id=\"ssid\" ";
@@ -714,12 +1580,172 @@ void handleNetworkSettings() {
   LogEvent(EVENTCATEGORIES::PageHandler, 2, "Page served", "networksettings.html");
 }
 
+//  Local time of day as hh:mm
+String SunTimeString(time_t t){
+  time_t localTime = ToLocalTime(appConfig.timeZone, t);
+  char s[6];
+  sprintf(s, "%02d:%02d", hour(localTime), minute(localTime));
+  return s;
+}
+
+void handleFollowDay() {
+
+  LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "followday.html");
+
+  if (!is_authenticated()){
+     SendRedirect("/login.html");
+     return;
+   }
+
+   if (server.method() == HTTP_POST){  //  POST
+     for (int i = 0; i < server.args(); i++) {
+       Serial.print(server.argName(i));
+       Serial.print(": ");
+       Serial.println(server.arg(i));
+     }
+
+     if (server.hasArg("mintemperature")) appConfig.followDayMinTemperature = clampKelvin(server.arg("mintemperature").toInt());
+     if (server.hasArg("maxtemperature")) appConfig.followDayMaxTemperature = clampKelvin(server.arg("maxtemperature").toInt());
+     if (server.hasArg("daybrightness")) appConfig.followDayBrightness = server.arg("daybrightness").toInt();
+     if (server.hasArg("nightbrightness")) appConfig.followDayNightBrightness = server.arg("nightbrightness").toInt();
+
+     if (server.hasArg("activate")) appConfig.selectedProgram = FindEffect(FollowDayEffect::Tick);
+
+     saveSettings();
+
+     StartProgram();
+   }
+
+   File f = LittleFS.open("/pageheader.html", "r");
+   String headerString;
+   if (f.available()) headerString = f.readString();
+   f.close();
+
+  time_t localTime = LocalNow();
+
+   f = LittleFS.open("/followday.html", "r");
+
+   String s, htmlString, mintemperaturelist, maxtemperaturelist, daybrightnesslist, nightbrightnesslist;
+
+   for (uint k = 1800; k <= 6500; k += 100) {
+     mintemperaturelist+="<option ";
+     if (k == appConfig.followDayMinTemperature) mintemperaturelist+="selected";
+     mintemperaturelist+=" value=\"" + (String)k + "\">" + (String)k + " K</option>";
+
+     maxtemperaturelist+="<option ";
+     if (k == appConfig.followDayMaxTemperature) maxtemperaturelist+="selected";
+     maxtemperaturelist+=" value=\"" + (String)k + "\">" + (String)k + " K</option>";
+   }
+
+   nightbrightnesslist = "<option ";
+   if (appConfig.followDayNightBrightness == 0) nightbrightnesslist+="selected";
+   nightbrightnesslist+=" value=\"0\">Off</option>";
+   for (int i = 15; i < 256; i+=16) {
+     daybrightnesslist+="<option ";
+     if (i == appConfig.followDayBrightness) daybrightnesslist+="selected";
+     daybrightnesslist+=" value=\"" + (String)i + "\">" + String(i/16) + "</option>";
+
+     nightbrightnesslist+="<option ";
+     if (i == appConfig.followDayNightBrightness) nightbrightnesslist+="selected";
+     nightbrightnesslist+=" value=\"" + (String)i + "\">" + String(i/16) + "</option>";
+   }
+
+   const sunData_t& sun = GetSunData(now());
+
+   while (f.available()){
+     s = f.readStringUntil('\n');
+     if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
+    if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
+     if (s.indexOf("%civildawn%")>-1) s.replace("%civildawn%", SunTimeString(sun.CivilDawn));
+     if (s.indexOf("%sunrise%")>-1) s.replace("%sunrise%", SunTimeString(sun.Sunrise));
+     if (s.indexOf("%solarnoon%")>-1) s.replace("%solarnoon%", SunTimeString(sun.SolarNoon));
+     if (s.indexOf("%sunset%")>-1) s.replace("%sunset%", SunTimeString(sun.Sunset));
+     if (s.indexOf("%civildusk%")>-1) s.replace("%civildusk%", SunTimeString(sun.CivilDusk));
+     if (s.indexOf("%mintemperaturelist%")>-1) s.replace("%mintemperaturelist%", mintemperaturelist);
+     if (s.indexOf("%maxtemperaturelist%")>-1) s.replace("%maxtemperaturelist%", maxtemperaturelist);
+     if (s.indexOf("%daybrightnesslist%")>-1) s.replace("%daybrightnesslist%", daybrightnesslist);
+     if (s.indexOf("%nightbrightnesslist%")>-1) s.replace("%nightbrightnesslist%", nightbrightnesslist);
+
+     htmlString+=s;
+   }
+   f.close();
+   server.send(200, "text/html", htmlString);
+   LogEvent(EVENTCATEGORIES::PageHandler, 2, "Page served", "followday.html");
+
+}
+
+void handleRealtime() {
+
+  LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "realtime.html");
+
+  if (!is_authenticated()){
+     SendRedirect("/login.html");
+     return;
+   }
+
+   if (server.method() == HTTP_POST){  //  POST
+     for (int i = 0; i < server.args(); i++) {
+       Serial.print(server.argName(i));
+       Serial.print(": ");
+       Serial.println(server.arg(i));
+     }
+
+     appConfig.realtimeEnabled = server.hasArg("realtimeenabled");
+     if (server.hasArg("universe")) appConfig.realtimeUniverse = constrain(server.arg("universe").toInt(), 1, 63999);
+     if (server.hasArg("address")) appConfig.realtimeAddress = constrain(server.arg("address").toInt(), 1, DMX_SLOTS - LIGHT_CHANNEL_COUNT + 1);
+     if (server.hasArg("timeout")) appConfig.realtimeTimeout = constrain(server.arg("timeout").toInt(), 100, 60000);
+     if (server.hasArg("playoutdelay")) appConfig.realtimePlayoutDelay = constrain(server.arg("playoutdelay").toInt(), 0, 500);
+
+     saveSettings();
+
+     StartRealtime();
+   }
+
+   File f = LittleFS.open("/pageheader.html", "r");
+   String headerString;
+   if (f.available()) headerString = f.readString();
+   f.close();
+
+  time_t localTime = LocalNow();
+
+   f = LittleFS.open("/realtime.html", "r");
+
+   String s, htmlString;
+
+   String status = !appConfig.realtimeEnabled ? "Disabled" : realtime.active ? "Receiving" : "Waiting for frames";
+   String channels = (String)appConfig.realtimeAddress + " - " + (String)(appConfig.realtimeAddress + LIGHT_CHANNEL_COUNT - 1);
+
+   while (f.available()){
+     s = f.readStringUntil('\n');
+     if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
+    if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
+     if (s.indexOf("%realtimeenabled%")>-1) s.replace("%realtimeenabled%", appConfig.realtimeEnabled ? "checked" : "");
+     if (s.indexOf("%universe%")>-1) s.replace("%universe%", (String)appConfig.realtimeUniverse);
+     if (s.indexOf("%address%")>-1) s.replace("%address%", (String)appConfig.realtimeAddress);
+     if (s.indexOf("%timeout%")>-1) s.replace("%timeout%", (String)appConfig.realtimeTimeout);
+     if (s.indexOf("%playoutdelay%")>-1) s.replace("%playoutdelay%", (String)appConfig.realtimePlayoutDelay);
+     if (s.indexOf("%jitterbuffer%")>-1) s.replace("%jitterbuffer%", !appConfig.realtimePlayoutDelay ? "Off" :
+       (String)realtime.jitter.count + " frames buffered, " + (String)realtime.jitter.underruns + " underruns, " + (String)realtime.jitter.late + " late, " + (String)realtime.jitter.overflows + " overflows");
+     if (s.indexOf("%status%")>-1) s.replace("%status%", status);
+     if (s.indexOf("%channels%")>-1) s.replace("%channels%", channels);
+     if (s.indexOf("%frames%")>-1) s.replace("%frames%", (String)realtime.stats.frames);
+     if (s.indexOf("%sequenceerrors%")>-1) s.replace("%sequenceerrors%", (String)realtime.stats.sequenceErrors);
+     if (s.indexOf("%discarded%")>-1) s.replace("%discarded%", (String)realtime.stats.discarded);
+     if (s.indexOf("%latency%")>-1) s.replace("%latency%", (String)realtime.stats.latencyAverage + " us average, " + (String)realtime.stats.latencyMax + " us max");
+
+     htmlString+=s;
+   }
+   f.close();
+   server.send(200, "text/html", htmlString);
+   LogEvent(EVENTCATEGORIES::PageHandler, 2, "Page served", "realtime.html");
+
+}
+
 void handleTools() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "tools.html");
 
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
    }
 
@@ -742,7 +1768,7 @@ void handleTools() {
   if (f.available()) headerString = f.readString();
   f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
   f = LittleFS.open("/tools.html", "r");
 
@@ -767,8 +1793,7 @@ void handleCustomColour() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "customcolour.html");
 
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
    }
 
@@ -779,7 +1804,8 @@ void handleCustomColour() {
        Serial.println(server.arg(i));
      }
 
-     for (uint i = 0; i < sizeof(pwmOutputs)/sizeof(pwmOutputs[0]); i++) {
+     bool colourChanged = false;
+     for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
        char num[2];
        char name[10] = "pwm";
 
@@ -787,12 +1813,29 @@ void handleCustomColour() {
        strcat_P(name, num);
        if (server.hasArg(name)){
          pwmOutputs[i].desiredValue = server.arg(name).toInt();
-          if (PSclient.connected()){
-            PSclient.publish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/RESULT").c_str(), ("{\"PWM" + (String)i + "\":\"" + (String)pwmOutputs[i].desiredValue + "\"}" ).c_str(), 0);
-          }
-
+         PublishPwmResult(i);
+         colourChanged = true;
        }
      }
+     if (colourChanged) ShowDesiredColour();
+
+     if (server.hasArg("whitetemperature")){
+       appConfig.whiteTemperature = server.arg("whitetemperature").toInt();
+       appConfig.whiteExtraction = server.hasArg("whiteextraction");
+       SetWhitePoint(appConfig.whiteTemperature, appConfig.whiteExtraction);
+       saveSettings();
+     }
+
+     if (server.hasArg("ct") && server.arg("ct").toInt() > 0){
+       SetColourTemperature(server.arg("ct").toInt(), server.arg("ctbrightness").toInt());
+     }
+
+     if (server.hasArg("presetaction") && server.hasArg("preset")){
+       uint8_t id = server.arg("preset").toInt();
+       if (server.arg("presetaction") == "recall") RecallPreset(id);
+       if (server.arg("presetaction") == "store") StoreCurrentPreset(id, constrain(server.arg("presetbrightness").toInt(), 0, 255));
+       if (server.arg("presetaction") == "delete") RemovePreset(id);
+     }
 
    }
 
@@ -801,14 +1844,14 @@ void handleCustomColour() {
    if (f.available()) headerString = f.readString();
    f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
    f = LittleFS.open("/customcolour.html", "r");
 
    String s, htmlString, pwmlist;
 
    pwmlist = "";
-   for (uint i = 0; i < sizeof(pwmOutputs)/sizeof(pwmOutputs[0]); i++) {
+   for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
      pwmlist+="<div class=\"form-group\"><label class=\"control-label col-sm-2\" for=\"pwm";
      pwmlist+=(String)i;
      pwmlist+="\">";
@@ -833,11 +1876,41 @@ void handleCustomColour() {
      pwmlist+="</select></div></div>";
    }
 
+   String ctlist, ctbrightnesslist, whitetemperaturelist;
+   for (uint k = 2000; k <= 6500; k += 250) {
+     ctlist+="<option value=\"" + (String)k + "\">" + (String)k + " K</option>";
+   }
+   for (uint j = 1; j < 16; j++) {
+     ctbrightnesslist+="<option value=\"" + (String)LedPwmValues[j*16+15] + "\">Level: " + (String)j + "</option>";
+   }
+   String presetlist;
+   char name[32];
+   for (uint8_t i = 0; i < PRESET_COUNT; i++) {
+     presetlist+="<option value=\"" + (String)i + "\">" + (String)i;
+     if (presets[i].used){
+       strncpy_P(name, GetEffect(presets[i].program).name, sizeof(name) - 1);
+       name[sizeof(name) - 1] = 0;
+       presetlist+=" - " + (String)name + ", brightness " + (String)presets[i].brightness;
+     }
+     presetlist+="</option>";
+   }
+
+   for (uint k = 2500; k <= 6500; k += 500) {
+     whitetemperaturelist+="<option";
+     if (appConfig.whiteTemperature == k) whitetemperaturelist+=" selected";
+     whitetemperaturelist+=" value=\"" + (String)k + "\">" + (String)k + " K</option>";
+   }
+
    while (f.available()){
      s = f.readStringUntil('\n');
      if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
     if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
      if (s.indexOf("%pwmlist%")>-1) s.replace("%pwmlist%", pwmlist);
+     if (s.indexOf("%ctlist%")>-1) s.replace("%ctlist%", ctlist);
+     if (s.indexOf("%ctbrightnesslist%")>-1) s.replace("%ctbrightnesslist%", ctbrightnesslist);
+     if (s.indexOf("%presetlist%")>-1) s.replace("%presetlist%", presetlist);
+     if (s.indexOf("%whitetemperaturelist%")>-1) s.replace("%whitetemperaturelist%", whitetemperaturelist);
+     if (s.indexOf("%whiteextraction%")>-1) s.replace("%whiteextraction%", appConfig.whiteExtraction ? "checked" : "");
      htmlString+=s;
    }
    f.close();
@@ -851,8 +1924,7 @@ void handlePrograms() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "programs.html");
 
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
    }
 
@@ -864,19 +1936,21 @@ void handlePrograms() {
      }
 
 
-     appConfig.selectedProgram = server.arg("optSelectProgram").toInt();
-
-     os_timer_disarm(&pwmModifierTimer);
+     if (server.hasArg("optSelectProgram")){
+       uint program = server.arg("optSelectProgram").toInt();
+       if (program < EFFECT_COUNT) appConfig.selectedProgram = program;
+     }
+     if (server.hasArg("effectspeed")) appConfig.effectSpeed = server.arg("effectspeed").toInt();
+     if (server.hasArg("effectintensity")) appConfig.effectIntensity = server.arg("effectintensity").toInt();
+     if (server.hasArg("effectpalette")) appConfig.effectPalette = server.arg("effectpalette").toInt();
+     if (server.hasArg("transitiontime")) appConfig.transitionTime = server.arg("transitiontime").toInt();
+     if (server.hasArg("sequencefile") && IsValidSequenceName(server.arg("sequencefile")))
+       strlcpy(appConfig.sequenceFile, server.arg("sequencefile").c_str(), sizeof(appConfig.sequenceFile));
+     if (server.hasArg("sequencemode")) appConfig.sequenceMode = constrain(server.arg("sequencemode").toInt(), SEQUENCE_MODE_ONCE, SEQUENCE_MODE_PINGPONG);
 
      saveSettings();
 
-     switch (appConfig.selectedProgram) {
-       case 0:
-         break;
-       case 1:
-         os_timer_arm(&pwmModifierTimer, appConfig.pwmChangeSpeed * 1000, true);
-         break;
-     }
+     StartProgram();
    }
 
    File f = LittleFS.open("/pageheader.html", "r");
@@ -884,14 +1958,68 @@ void handlePrograms() {
    if (f.available()) headerString = f.readString();
    f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
    f = LittleFS.open("/programs.html", "r");
 
+   String programlist, effectspeedlist, effectintensitylist, effectpalettelist, transitiontimelist, sequencelist, sequencemodelist;
+   char name[32];
+
+   for (uint i = 0; i < EFFECT_COUNT; i++) {
+     strncpy_P(name, GetEffect(i).name, sizeof(name) - 1);
+     name[sizeof(name) - 1] = 0;
+     programlist+="<div class=\"radio\"><label><input type=\"radio\" name=\"optSelectProgram\" ";
+     if (appConfig.selectedProgram == (int)i) programlist+="checked ";
+     programlist+="value=\"" + (String)i + "\">" + name + "</label></div>";
+   }
+
+   for (int i = 15; i < 256; i+=16) {
+     effectspeedlist+="<option ";
+     if (i == appConfig.effectSpeed) effectspeedlist+="selected";
+     effectspeedlist+=" value=\"" + (String)i + "\">" + String(i/16) + "</option>";
+
+     effectintensitylist+="<option ";
+     if (i == appConfig.effectIntensity) effectintensitylist+="selected";
+     effectintensitylist+=" value=\"" + (String)i + "\">" + String(i/16) + "</option>";
+   }
+
+   for (uint i = 0; i < PALETTE_COUNT; i++) {
+     palette p;
+     memcpy_P(&p, &Palettes[i], sizeof(p));
+     strncpy_P(name, p.name, sizeof(name) - 1);
+     name[sizeof(name) - 1] = 0;
+     effectpalettelist+="<option ";
+     if (i == appConfig.effectPalette) effectpalettelist+="selected";
+     effectpalettelist+=" value=\"" + (String)i + "\">" + name + "</option>";
+   }
+
+   const uint32_t transitionTimes[] = { 0, 250, 500, 1000, 2000, 3000, 5000, 10000 };
+   for (uint i = 0; i < sizeof(transitionTimes)/sizeof(transitionTimes[0]); i++) {
+     transitiontimelist+="<option ";
+     if (transitionTimes[i] == appConfig.transitionTime) transitiontimelist+="selected";
+     transitiontimelist+=" value=\"" + (String)transitionTimes[i] + "\">" + (transitionTimes[i] ? String(transitionTimes[i] / 1000.0, 2) + " s" : String("Off")) + "</option>";
+   }
+
+   Dir dir = LittleFS.openDir(SEQUENCE_DIRECTORY);
+   while (dir.next()) {
+     size_t size = dir.fileSize();
+     uint32_t keyframes = size > sizeof(sequenceHeader) ? (size - sizeof(sequenceHeader)) / sizeof(sequenceKeyframe) : 0;
+     sequencelist+="<option ";
+     if (dir.fileName() == appConfig.sequenceFile) sequencelist+="selected";
+     sequencelist+=" value=\"" + dir.fileName() + "\">" + dir.fileName() + " (" + (String)keyframes + " keyframes)</option>";
+   }
+
+   const char* sequenceModes[] = { "Once", "Loop", "Ping-pong" };
+   for (uint i = SEQUENCE_MODE_ONCE; i <= SEQUENCE_MODE_PINGPONG; i++) {
+     sequencemodelist+="<option ";
+     if (i == appConfig.sequenceMode) sequencemodelist+="selected";
+     sequencemodelist+=" value=\"" + (String)i + "\">" + sequenceModes[i] + "</option>";
+   }
+
    String s, htmlString, pwmlist;
 
    pwmlist = "";
-   for (uint i = 0; i < sizeof(pwmOutputs)/sizeof(pwmOutputs[0]); i++) {
+   for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
      pwmlist+="<div class=\"form-group\"><label class=\"control-label col-sm-2\" for=\"pwm";
      pwmlist+=(String)i;
      pwmlist+="\">";
@@ -921,9 +2049,13 @@ void handlePrograms() {
      if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
      if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
      if (s.indexOf("%pwmlist%")>-1) s.replace("%pwmlist%", pwmlist);
-     if (s.indexOf("%checked1%")>-1) if (appConfig.selectedProgram == 0) s.replace("%checked1%", "checked");
-     if (s.indexOf("%checked2%")>-1) if (appConfig.selectedProgram == 1) s.replace("%checked2%", "checked");
-     if (s.indexOf("%checked3%")>-1) if (appConfig.selectedProgram == 2) s.replace("%checked3%", "checked");
+     if (s.indexOf("%programlist%")>-1) s.replace("%programlist%", programlist);
+     if (s.indexOf("%effectspeedlist%")>-1) s.replace("%effectspeedlist%", effectspeedlist);
+     if (s.indexOf("%effectintensitylist%")>-1) s.replace("%effectintensitylist%", effectintensitylist);
+     if (s.indexOf("%effectpalettelist%")>-1) s.replace("%effectpalettelist%", effectpalettelist);
+     if (s.indexOf("%transitiontimelist%")>-1) s.replace("%transitiontimelist%", transitiontimelist);
+     if (s.indexOf("%sequencelist%")>-1) s.replace("%sequencelist%", sequencelist);
+     if (s.indexOf("%sequencemodelist%")>-1) s.replace("%sequencemodelist%", sequencemodelist);
 
      htmlString+=s;
    }
@@ -938,8 +2070,7 @@ void handleActivation() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "activation.html");
 
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
    }
 
@@ -950,20 +2081,40 @@ void handleActivation() {
        Serial.println(server.arg(i));
      }
 
+     for (uint i = 0; i < ACTIVATION_RULE_COUNT; i++) {
+       activationRule& rule = appConfig.activationRules[i];
+       String prefix = "rule" + (String)i;
 
-     appConfig.selectedProgram = server.arg("optSelectProgram").toInt();
+       if (!server.hasArg(prefix + "action")) continue;
 
-     os_timer_disarm(&pwmModifierTimer);
+       rule.action = constrain(server.arg(prefix + "action").toInt(), ACTIVATION_NONE, ACTIVATION_WAKEUP);
+       rule.hour = constrain(server.arg(prefix + "hour").toInt(), 0, 23);
+       rule.minute = constrain(server.arg(prefix + "minute").toInt(), 0, 59);
+       rule.days = 0;
+       for (uint d = 0; d < 7; d++) {
+         if (server.hasArg(prefix + "day" + (String)d)) rule.days |= 1 << d;
+       }
+     }
+
+     if (server.hasArg("wakeupduration")) appConfig.wakeUpDuration = constrain(server.arg("wakeupduration").toInt(), 1, 120);
+     if (server.hasArg("wakeuptemperature")) appConfig.wakeUpTemperature = clampKelvin(server.arg("wakeuptemperature").toInt());
+     if (server.hasArg("wakeupbrightness")) appConfig.wakeUpBrightness = server.arg("wakeupbrightness").toInt();
 
      saveSettings();
 
-     switch (appConfig.selectedProgram) {
-       case 0:
-         break;
-       case 1:
-         os_timer_arm(&pwmModifierTimer, appConfig.pwmChangeSpeed * 1000, true);
-         break;
+     if (server.hasArg("countdownaction")){
+       uint8_t action = constrain(server.arg("countdownaction").toInt(), ACTIVATION_NONE, ACTIVATION_WAKEUP);
+       uint32_t minutes = constrain(server.arg("countdownhours").toInt(), 0, 23) * 60 + constrain(server.arg("countdownminutes").toInt(), 0, 59);
+       activationCountdown.action = action;
+       activationCountdown.time = (action != ACTIVATION_NONE && minutes > 0) ? now() + minutes * SECS_PER_MIN : 0;
      }
+
+     if (server.hasArg("optOnOff")){
+       uint8_t action = server.arg("optOnOff").toInt();
+       if (action != ACTIVATION_NONE) SwitchLights(action == ACTIVATION_ON);
+     }
+
+     PlanActivation();
    }
 
    File f = LittleFS.open("/pageheader.html", "r");
@@ -971,99 +2122,82 @@ void handleActivation() {
    if (f.available()) headerString = f.readString();
    f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
    f = LittleFS.open("/activation.html", "r");
 
-   String s, htmlString, onhourlist, onminutelist, ontimerhourlist, ontimerminutelist;
-   String offhourlist, offminutelist, offtimerhourlist, offtimerminutelist;
-
-   onhourlist = "";
-   for (int j = 0; j < 24; j++) {
-     onhourlist+="\r\n<option";
-     if (appConfig.activationOnHours == j) onhourlist+=" selected";
-     onhourlist+=" value=\"";
-     onhourlist+=(String)j;
-     onhourlist+="\">";
-     onhourlist+=(String)j;
-     onhourlist+="</option>";
-   }
+   String s, htmlString, rulelist, countdownhourlist, countdownminutelist, nextactivation;
+   String wakeupdurationlist, wakeuptemperaturelist, wakeupbrightnesslist;
+   const char* actionNames[] = { "Disabled", "Switch on", "Switch off", "Wake-up light" };
+   const char* dayNames[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
 
-   onminutelist = "";
-   for (int j = 0; j < 60; j+=5) {
-     onminutelist+="\r\n<option";
-     if (appConfig.activationOnMinutes == j) onminutelist+=" selected";
-     onminutelist+=" value=\"";
-     onminutelist+=(String)j;
-     onminutelist+="\">";
-     onminutelist+=(String)j;
-     onminutelist+="</option>";
-   }
+   for (uint i = 0; i < ACTIVATION_RULE_COUNT; i++) {
+     const activationRule& rule = appConfig.activationRules[i];
+     String prefix = "rule" + (String)i;
 
-   ontimerhourlist = "";
-   for (int j = 0; j < 24; j++) {
-     ontimerhourlist+="\r\n<option";
-     if (appConfig.activationOnTimerHours == j) ontimerhourlist+=" selected";
-     ontimerhourlist+=" value=\"";
-     ontimerhourlist+=(String)j;
-     ontimerhourlist+="\">";
-     ontimerhourlist+=(String)j;
-     ontimerhourlist+="</option>";
-   }
+     rulelist+="<div class=\"row\"><div class=\"form-group col-sm-2\"><select class=\"form-control\" name=\"" + prefix + "action\">";
+     for (uint a = ACTIVATION_NONE; a <= ACTIVATION_WAKEUP; a++) {
+       rulelist+="<option";
+       if (rule.action == a) rulelist+=" selected";
+       rulelist+=" value=\"" + (String)a + "\">" + actionNames[a] + "</option>";
+     }
+     rulelist+="</select></div>";
 
-   ontimerminutelist = "";
-   for (int j = 0; j < 60; j+=5) {
-     ontimerminutelist+="\r\n<option";
-     if (appConfig.activationOnTimerMinutes == j) ontimerminutelist+=" selected";
-     ontimerminutelist+=" value=\"";
-     ontimerminutelist+=(String)j;
-     ontimerminutelist+="\">";
-     ontimerminutelist+=(String)j;
-     ontimerminutelist+="</option>";
-   }
+     rulelist+="<div class=\"form-group col-sm-1\"><select class=\"form-control\" name=\"" + prefix + "hour\">";
+     for (uint j = 0; j < 24; j++) {
+       rulelist+="<option";
+       if (rule.hour == j) rulelist+=" selected";
+       rulelist+=" value=\"" + (String)j + "\">" + (String)j + "</option>";
+     }
+     rulelist+="</select></div>";
+
+     rulelist+="<div class=\"form-group col-sm-1\"><select class=\"form-control\" name=\"" + prefix + "minute\">";
+     for (uint j = 0; j < 60; j+=5) {
+       rulelist+="<option";
+       if (rule.minute == j) rulelist+=" selected";
+       rulelist+=" value=\"" + (String)j + "\">" + (j < 10 ? "0" : "") + (String)j + "</option>";
+     }
+     rulelist+="</select></div><div class=\"col-sm-8\">";
 
-   offhourlist = "";
-   for (int j = 0; j < 24; j++) {
-     offhourlist+="\r\n<option";
-     if (appConfig.activationOffHours == j) offhourlist+=" selected";
-     offhourlist+=" value=\"";
-     offhourlist+=(String)j;
-     offhourlist+="\">";
-     offhourlist+=(String)j;
-     offhourlist+="</option>";
+     for (uint d = 0; d < 7; d++) {
+       rulelist+="<label class=\"checkbox-inline\"><input type=\"checkbox\" name=\"" + prefix + "day" + (String)d + "\"";
+       if (rule.days & (1 << d)) rulelist+=" checked";
+       rulelist+=">" + (String)dayNames[d] + "</label>";
+     }
+     rulelist+="</div></div>";
    }
 
-   offminutelist = "";
-   for (int j = 0; j < 60; j+=5) {
-     offminutelist+="\r\n<option";
-     if (appConfig.activationOffMinutes == j) offminutelist+=" selected";
-     offminutelist+=" value=\"";
-     offminutelist+=(String)j;
-     offminutelist+="\">";
-     offminutelist+=(String)j;
-     offminutelist+="</option>";
+   for (uint j = 0; j < 24; j++) {
+     countdownhourlist+="<option value=\"" + (String)j + "\">" + (String)j + "</option>";
+   }
+   for (uint j = 0; j < 60; j+=5) {
+     countdownminutelist+="<option value=\"" + (String)j + "\">" + (String)j + "</option>";
    }
 
-   offtimerhourlist = "";
-   for (int j = 0; j < 24; j++) {
-     offtimerhourlist+="\r\n<option";
-     if (appConfig.activationOffTimerHours == j) offtimerhourlist+=" selected";
-     offtimerhourlist+=" value=\"";
-     offtimerhourlist+=(String)j;
-     offtimerhourlist+="\">";
-     offtimerhourlist+=(String)j;
-     offtimerhourlist+="</option>";
+   for (uint j = 10; j <= 60; j+=5) {
+     wakeupdurationlist+="<option";
+     if (appConfig.wakeUpDuration == j) wakeupdurationlist+=" selected";
+     wakeupdurationlist+=" value=\"" + (String)j + "\">" + (String)j + " minutes</option>";
+   }
+   for (uint k = 2000; k <= 5000; k += 250) {
+     wakeuptemperaturelist+="<option";
+     if (appConfig.wakeUpTemperature == k) wakeuptemperaturelist+=" selected";
+     wakeuptemperaturelist+=" value=\"" + (String)k + "\">" + (String)k + " K</option>";
+   }
+   for (uint j = 15; j < 256; j+=16) {
+     wakeupbrightnesslist+="<option";
+     if (appConfig.wakeUpBrightness == j) wakeupbrightnesslist+=" selected";
+     wakeupbrightnesslist+=" value=\"" + (String)j + "\">" + String(j/16) + "</option>";
    }
 
-   offtimerminutelist = "";
-   for (int j = 0; j < 60; j+=5) {
-     offtimerminutelist+="\r\n<option";
-     if (appConfig.activationOffTimerMinutes == j) offtimerminutelist+=" selected";
-     offtimerminutelist+=" value=\"";
-     offtimerminutelist+=(String)j;
-     offtimerminutelist+="\">";
-     offtimerminutelist+=(String)j;
-     offtimerminutelist+="</option>";
+   if (nextActivation.time){
+     time_t nextLocal = ToLocalTime(appConfig.timeZone, nextActivation.time);
+     char t[20];
+     sprintf(t, "%s %02d:%02d", dayNames[weekday(nextLocal) - 1], hour(nextLocal), minute(nextLocal));
+     nextactivation = (String)actionNames[nextActivation.action] + " on " + t;
+   }
+   else{
+     nextactivation = "Nothing scheduled";
    }
 
    while (f.available()){
@@ -1071,15 +2205,14 @@ void handleActivation() {
      if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
     if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
 
-     if (s.indexOf("%onhourlist%")>-1) s.replace("%onhourlist%", onhourlist);
-     if (s.indexOf("%onminutelist%")>-1) s.replace("%onminutelist%", onminutelist);
-     if (s.indexOf("%ontimerhourlist%")>-1) s.replace("%ontimerhourlist%", onhourlist);
-     if (s.indexOf("%ontimerminutelist%")>-1) s.replace("%ontimerminutelist%", onminutelist);
-
-     if (s.indexOf("%offhourlist%")>-1) s.replace("%offhourlist%", offhourlist);
-     if (s.indexOf("%offminutelist%")>-1) s.replace("%offminutelist%", offminutelist);
-     if (s.indexOf("%offtimerhourlist%")>-1) s.replace("%offtimerhourlist%", offtimerhourlist);
-     if (s.indexOf("%offtimerminutelist%")>-1) s.replace("%offtimerminutelist%", offtimerminutelist);
+     if (s.indexOf("%lightstate%")>-1) s.replace("%lightstate%", lightsOn ? "on" : "off");
+     if (s.indexOf("%nextactivation%")>-1) s.replace("%nextactivation%", nextactivation);
+     if (s.indexOf("%rulelist%")>-1) s.replace("%rulelist%", rulelist);
+     if (s.indexOf("%countdownhourlist%")>-1) s.replace("%countdownhourlist%", countdownhourlist);
+     if (s.indexOf("%countdownminutelist%")>-1) s.replace("%countdownminutelist%", countdownminutelist);
+     if (s.indexOf("%wakeupdurationlist%")>-1) s.replace("%wakeupdurationlist%", wakeupdurationlist);
+     if (s.indexOf("%wakeuptemperaturelist%")>-1) s.replace("%wakeuptemperaturelist%", wakeuptemperaturelist);
+     if (s.indexOf("%wakeupbrightnesslist%")>-1) s.replace("%wakeupbrightnesslist%", wakeupbrightnesslist);
 
      htmlString+=s;
    }
@@ -1094,8 +2227,7 @@ void handleSlowChanging() {
   LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "slowchanging.html");
 
   if (!is_authenticated()){
-     String header = "HTTP/1.1 301 OK\r\nLocation: /login.html\r\nCache-Control: no-cache\r\n\r\n";
-     server.sendContent(header);
+     SendRedirect("/login.html");
      return;
    }
 
@@ -1108,20 +2240,14 @@ void handleSlowChanging() {
 
      appConfig.pwmChangeSpeed = server.arg("freq").toInt();
      appConfig.pwmAdjustmentSpeed = server.arg("speed").toInt();
-     os_timer_disarm(&pwmAdjustmentTimer);
-     os_timer_disarm(&pwmModifierTimer);
+     if (server.hasArg("saturation")) appConfig.programSaturation = server.arg("saturation").toInt();
+     if (server.hasArg("brightness")) appConfig.programBrightness = server.arg("brightness").toInt();
+     if (server.hasArg("interpolation")) appConfig.colourInterpolation = server.arg("interpolation").toInt();
 
      saveSettings();
 
-     switch (appConfig.selectedProgram) {
-       case 0:
-         break;
-       case 1:
-         os_timer_arm(&pwmAdjustmentTimer, appConfig.pwmAdjustmentSpeed, true);
-         os_timer_arm(&pwmModifierTimer, appConfig.pwmChangeSpeed * 1000, true);
-         break;
-     }
-
+     ArmLightEngineTimer();
+     StartProgram();
    }
 
    File f = LittleFS.open("/pageheader.html", "r");
@@ -1129,11 +2255,11 @@ void handleSlowChanging() {
    if (f.available()) headerString = f.readString();
    f.close();
 
-  time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+  time_t localTime = LocalNow();
 
    f = LittleFS.open("/slowchanging.html", "r");
 
-   String s, htmlString, freqlist, speedlist;
+   String s, htmlString, freqlist, speedlist, saturationlist, brightnesslist, interpolationlist;
 
    freqlist = "";
    for (int i = 1; i < 61; i++) {
@@ -1149,12 +2275,36 @@ void handleSlowChanging() {
      speedlist+=" value=""" + (String)i + """>" + String(11-i) + "</option>";
    }
 
+   saturationlist = "";
+   for (int i = 15; i < 256; i+=16) {
+     saturationlist+="<option ";
+     if (i == appConfig.programSaturation) saturationlist+="selected";
+     saturationlist+=" value=""" + (String)i + """>" + String(i/16) + "</option>";
+   }
+
+   brightnesslist = "";
+   for (int i = 15; i < 256; i+=16) {
+     brightnesslist+="<option ";
+     if (i == appConfig.programBrightness) brightnesslist+="selected";
+     brightnesslist+=" value=""" + (String)i + """>" + String(i/16) + "</option>";
+   }
+
+   interpolationlist = "<option ";
+   if (appConfig.colourInterpolation == COLOUR_INTERPOLATION_HUE) interpolationlist+="selected";
+   interpolationlist+=" value=""" + (String)COLOUR_INTERPOLATION_HUE + """>Around the colour wheel</option>";
+   interpolationlist+="<option ";
+   if (appConfig.colourInterpolation == COLOUR_INTERPOLATION_OKLAB) interpolationlist+="selected";
+   interpolationlist+=" value=""" + (String)COLOUR_INTERPOLATION_OKLAB + """>Perceptually uniform (OKLab)</option>";
+
    while (f.available()){
      s = f.readStringUntil('\n');
      if (s.indexOf("%pageheader%")>-1) s.replace("%pageheader%", headerString);
     if (s.indexOf("%year%")>-1) s.replace("%year%", (String)year(localTime));
      if (s.indexOf("%freqlist%")>-1) s.replace("%freqlist%", freqlist);
      if (s.indexOf("%speedlist%")>-1) s.replace("%speedlist%", speedlist);
+     if (s.indexOf("%saturationlist%")>-1) s.replace("%saturationlist%", saturationlist);
+     if (s.indexOf("%brightnesslist%")>-1) s.replace("%brightnesslist%", brightnesslist);
+     if (s.indexOf("%interpolationlist%")>-1) s.replace("%interpolationlist%", interpolationlist);
 
      htmlString+=s;
    }
@@ -1164,6 +2314,75 @@ void handleSlowChanging() {
 
 }
 
+void handleCalibration() {
+  LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "calibration.json");
+
+  if (!is_authenticated()){
+     server.send(401, "application/json", "{\"error\":\"Not authenticated\"}");
+     return;
+   }
+
+  if (server.method() == HTTP_POST){  //  POST
+    StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> request;
+    DeserializationError error = deserializeJson(request, server.arg("plain"));
+
+    if (error || !request.is<JsonObject>() || !SetCalibration(request.as<JsonVariant>())){
+      server.send(400, "application/json", "{\"error\":\"Bad request\"}");
+      return;
+    }
+  }
+
+  StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> doc;
+  SerializeCalibration(doc);
+
+  String myJsonString;
+  serializeJson(doc, myJsonString);
+  server.send(200, "application/json", myJsonString);
+
+  LogEvent(EVENTCATEGORIES::PageHandler, 2, "Page served", "calibration.json");
+}
+
+//  GET lists the stored presets, POST takes {"preset":n}, {"store":n, "presetBrightness":0..255} or {"delete":n}
+void handlePresets() {
+  LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "presets.json");
+
+  if (!is_authenticated()){
+     server.send(401, "application/json", "{\"error\":\"Not authenticated\"}");
+     return;
+   }
+
+  if (server.method() == HTTP_POST){  //  POST
+    StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> request;
+    DeserializationError error = deserializeJson(request, server.arg("plain"));
+
+    if (error || !request.is<JsonObject>() || !RunPresetCommand(request.as<JsonVariant>())){
+      server.send(400, "application/json", "{\"error\":\"Bad request\"}");
+      return;
+    }
+  }
+
+  //  Streamed, the whole bank would not fit a static document
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "application/json", "{\"presets\":[");
+
+  bool first = true;
+  for (uint8_t i = 0; i < PRESET_COUNT; i++) {
+    if (!presets[i].used) continue;
+
+    const preset& p = presets[i];
+    String s = first ? "" : ",";
+    s += "{\"id\":" + (String)i + ",\"program\":" + (String)p.program + ",\"brightness\":" + (String)p.brightness;
+    s += ",\"rgbw\":[" + (String)p.colour.r + "," + (String)p.colour.g + "," + (String)p.colour.b + "," + (String)p.colour.w + "]}";
+    server.sendContent(s);
+    first = false;
+  }
+
+  server.sendContent("]}");
+  server.sendContent("");
+
+  LogEvent(EVENTCATEGORIES::PageHandler, 2, "Page served", "presets.json");
+}
+
 /*
     for (size_t i = 0; i < server.args(); i++) {
       Serial.print(server.argName(i));
@@ -1172,6 +2391,229 @@ void handleSlowChanging() {
     }
 */
 
+//  Streams an uploaded sequence file to LittleFS chunk by chunk
+File sequenceUploadFile;
+
+void handleSequenceUpload() {
+  HTTPUpload& upload = server.upload();
+
+  switch (upload.status) {
+    case UPLOAD_FILE_START:
+      if (is_authenticated() && IsValidSequenceName(upload.filename)){
+        if (upload.filename == playingSequence.name) CloseSequence();
+        sequenceUploadFile = LittleFS.open(SequencePath(upload.filename.c_str()), "w");
+      }
+      break;
+
+    case UPLOAD_FILE_WRITE:
+      if (sequenceUploadFile) sequenceUploadFile.write(upload.buf, upload.currentSize);
+      break;
+
+    case UPLOAD_FILE_END:
+      if (sequenceUploadFile){
+        sequenceUploadFile.close();
+        LogEvent(EVENTCATEGORIES::PageHandler, 3, "Sequence uploaded", upload.filename + " (" + (String)upload.totalSize + " bytes)");
+      }
+      break;
+
+    //  Aborted: the partial file goes, if this upload opened it past the checks
+    default:
+      if (sequenceUploadFile){
+        sequenceUploadFile.close();
+        LittleFS.remove(SequencePath(upload.filename.c_str()));
+      }
+      break;
+  }
+}
+
+void handleSequenceUploadDone() {
+  if (!is_authenticated()){
+     SendRedirect("/login.html");
+     return;
+   }
+
+  SendRedirect("/programs.html");
+}
+
+void handleCircadian() {
+  LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "circadian.json");
+
+  if (!is_authenticated()){
+     server.send(401, "application/json", "{\"error\":\"Not authenticated\"}");
+     return;
+   }
+
+  if (server.method() == HTTP_POST){  //  POST
+    StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> request;
+    DeserializationError error = deserializeJson(request, server.arg("plain"));
+
+    if (error || !request.is<JsonObject>() || !SetCircadianCurve(request.as<JsonVariant>())){
+      server.send(400, "application/json", "{\"error\":\"Bad request\"}");
+      return;
+    }
+  }
+
+  StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> doc;
+  SerializeCircadianCurve(doc);
+
+  String myJsonString;
+  serializeJson(doc, myJsonString);
+  server.send(200, "application/json", myJsonString);
+
+  LogEvent(EVENTCATEGORIES::PageHandler, 2, "Page served", "circadian.json");
+}
+
+//  The log buffer as text, oldest first: sequence, UTC time, uptime (ms),
+//  severity, category.ID, title: data
+void handleEventLog() {
+  LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "eventlog.txt");
+
+  if (!is_authenticated()){
+     server.send(401, "text/plain", "Not authenticated");
+     return;
+   }
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain", "");
+
+  logCursor c = { eventLogBuffer.firstSequence, eventLogBuffer.tail };
+  uint32_t end = eventLogBuffer.nextSequence;
+  time_t utcNow = ntp.set ? now() : 0;
+  logRecord r;
+  char line[LOG_TITLE_SIZE + LOG_DATA_SIZE + 64];
+  char time[DATETIME_STRING_SIZE];
+
+  while (c.sequence != end && ReadLogRecord(c, r)){
+    time_t t = LogRecordTime(r, utcNow);
+    int length = snprintf(line, sizeof(line), "%lu %s %lu %u %u.%u %s%s%s\r\n", (unsigned long)r.sequence, t ? FormatDateTime(time, t) : "-",
+      (unsigned long)r.header.uptime, r.header.severity, r.header.category, r.header.id, r.title, *r.data ? ": " : "", r.data);
+    if (length > 0) server.sendContent(line, length < (int)sizeof(line) ? length : sizeof(line) - 1);
+  }
+  server.sendContent("", 0);
+}
+
+void SendMetricsChunk(const char* data, size_t length){
+  server.sendContent(data, length);
+}
+
+//  Prometheus text format. Open to the scraper without a login, and not
+//  logged, so a scrape costs nothing but the bytes (see metrics.h).
+void handleMetrics() {
+  metricsWriter w;
+  w.length = 0;
+  w.send = SendMetricsChunk;
+  char labels[48];
+
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+
+  //  System
+  MetricsHeader(w, "fws_uptime_seconds", "counter", "Time since boot");
+  MetricsSeconds(w, "fws_uptime_seconds", "", micros64());
+
+  uint32_t free, maxBlock;
+  uint8_t fragmentation;
+  ESP.getHeapStats(&free, &maxBlock, &fragmentation);
+  MetricsHeader(w, "fws_heap_free_bytes", "gauge", "Free heap");
+  MetricsValue(w, "fws_heap_free_bytes", "", free);
+  MetricsHeader(w, "fws_heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+  MetricsValue(w, "fws_heap_min_free_bytes", "", minFreeHeap);
+  MetricsHeader(w, "fws_heap_max_block_bytes", "gauge", "Largest free heap block");
+  MetricsValue(w, "fws_heap_max_block_bytes", "", maxBlock);
+  MetricsHeader(w, "fws_heap_fragmentation_percent", "gauge", "Heap fragmentation");
+  MetricsValue(w, "fws_heap_fragmentation_percent", "", fragmentation);
+
+  //  Network
+  MetricsHeader(w, "fws_wifi_rssi_dbm", "gauge", "Signal strength of the access point");
+  MetricsSignedValue(w, "fws_wifi_rssi_dbm", "", WiFi.RSSI());
+  MetricsHeader(w, "fws_wifi_disconnects_total", "counter", "WiFi link losses");
+  MetricsValue(w, "fws_wifi_disconnects_total", "", wifi.disconnects);
+  MetricsHeader(w, "fws_mqtt_connected", "gauge", "Connected to the MQTT broker");
+  MetricsValue(w, "fws_mqtt_connected", "", PSclient.connected());
+  MetricsHeader(w, "fws_mqtt_connects_total", "counter", "Connects to the MQTT broker");
+  MetricsValue(w, "fws_mqtt_connects_total", "", mqttStats.connects);
+  MetricsHeader(w, "fws_mqtt_messages_received_total", "counter", "MQTT messages received");
+  MetricsValue(w, "fws_mqtt_messages_received_total", "", mqttStats.received);
+  MetricsHeader(w, "fws_mqtt_messages_published_total", "counter", "MQTT messages published");
+  MetricsValue(w, "fws_mqtt_messages_published_total", "result=\"ok\"", mqttStats.published);
+  MetricsValue(w, "fws_mqtt_messages_published_total", "result=\"failed\"", mqttStats.publishFailed);
+
+  MetricsHeader(w, "fws_http_responses_total", "counter", "HTTP responses by route and status class");
+  for (uint8_t i = 0; i < httpRouteCount; i++) {
+    for (uint8_t c = 0; c < HTTP_STATUS_CLASSES; c++) {
+      if (!httpRoutes[i].responses[c]) continue;
+      snprintf(labels, sizeof(labels), "route=\"%s\",code=\"%uxx\"", httpRoutes[i].path, c + 1);
+      MetricsValue(w, "fws_http_responses_total", labels, httpRoutes[i].responses[c]);
+    }
+  }
+
+  //  Loop
+  MetricsHistogram(w, "fws_loop_duration_seconds", "Work of a loop pass", loopLatency);
+  MetricsHistogram(w, "fws_light_tick_lateness_seconds", "Wait of a light engine tick for the loop", tickLateness);
+
+  MetricsHeader(w, "fws_task_runs_total", "counter", "Runs of a task");
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", tasks[i].name);
+    MetricsValue(w, "fws_task_runs_total", labels, tasks[i].runs);
+  }
+  MetricsHeader(w, "fws_task_overruns_total", "counter", "Runs of a task over its budget");
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", tasks[i].name);
+    MetricsValue(w, "fws_task_overruns_total", labels, tasks[i].overruns);
+  }
+  MetricsHeader(w, "fws_task_seconds_total", "counter", "Time spent in a task");
+  for (uint8_t i = 0; i < TASK_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "task=\"%s\"", tasks[i].name);
+    MetricsSeconds(w, "fws_task_seconds_total", labels, tasks[i].totalTime);
+  }
+
+  //  Light
+  MetricsHeader(w, "fws_light_on", "gauge", "Light switched on");
+  MetricsValue(w, "fws_light_on", "", lightsOn);
+  MetricsHeader(w, "fws_light_program", "gauge", "Program of the light engine");
+  MetricsValue(w, "fws_light_program", "", lightCompositor.layers[lightCompositor.incoming].program);
+  MetricsHeader(w, "fws_light_fading", "gauge", "Fading between programs");
+  MetricsValue(w, "fws_light_fading", "", lightCompositor.transitioning);
+  MetricsHeader(w, "fws_light_fade_progress_ratio", "gauge", "Progress of the fade");
+  MetricsRatio(w, "fws_light_fade_progress_ratio", "", lightCompositor.transitioning ? lightCompositor.transitionElapsed : 1,
+    lightCompositor.transitioning ? lightCompositor.transitionTime : 1);
+  MetricsHeader(w, "fws_light_wakeup_active", "gauge", "Wake-up ramp running");
+  MetricsValue(w, "fws_light_wakeup_active", "", wakeUp.active);
+  MetricsHeader(w, "fws_light_realtime_active", "gauge", "Realtime stream shown");
+  MetricsValue(w, "fws_light_realtime_active", "", realtime.active);
+  MetricsHeader(w, "fws_power_idle", "gauge", "Idle power saving");
+  MetricsValue(w, "fws_power_idle", "", power.idle);
+
+  MetricsHeader(w, "fws_output_duty_ratio", "gauge", "Duty cycle of an output channel");
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    snprintf(labels, sizeof(labels), "channel=\"%u\",name=\"%s\"", i, pwmOutputs[i].name);
+    MetricsRatio(w, "fws_output_duty_ratio", labels, outputValues[i], PWM_OUTPUT_MAX);
+  }
+
+  //  Realtime
+  MetricsHeader(w, "fws_realtime_frames_total", "counter", "Realtime frames taken for the light");
+  MetricsValue(w, "fws_realtime_frames_total", "", realtime.stats.frames);
+  MetricsHeader(w, "fws_realtime_sequence_errors_total", "counter", "Realtime frames out of sequence");
+  MetricsValue(w, "fws_realtime_sequence_errors_total", "", realtime.stats.sequenceErrors);
+  MetricsHeader(w, "fws_realtime_discarded_total", "counter", "Realtime packets malformed or out of order");
+  MetricsValue(w, "fws_realtime_discarded_total", "", realtime.stats.discarded);
+  MetricsHeader(w, "fws_realtime_latency_seconds", "gauge", "Time from a realtime packet to the outputs");
+  MetricsSeconds(w, "fws_realtime_latency_seconds", "stat=\"last\"", realtime.stats.latency);
+  MetricsSeconds(w, "fws_realtime_latency_seconds", "stat=\"average\"", realtime.stats.latencyAverage);
+  MetricsSeconds(w, "fws_realtime_latency_seconds", "stat=\"max\"", realtime.stats.latencyMax);
+  MetricsHeader(w, "fws_realtime_jitter_buffer_frames", "gauge", "Frames in the jitter buffer");
+  MetricsValue(w, "fws_realtime_jitter_buffer_frames", "", realtime.jitter.count);
+  MetricsHeader(w, "fws_realtime_jitter_underruns_total", "counter", "Jitter buffer run dry");
+  MetricsValue(w, "fws_realtime_jitter_underruns_total", "", realtime.jitter.underruns);
+  MetricsHeader(w, "fws_realtime_jitter_late_frames_total", "counter", "Frames too late for the jitter buffer");
+  MetricsValue(w, "fws_realtime_jitter_late_frames_total", "", realtime.jitter.late);
+  MetricsHeader(w, "fws_realtime_jitter_overflows_total", "counter", "Frames pushed out of a full jitter buffer");
+  MetricsValue(w, "fws_realtime_jitter_overflows_total", "", realtime.jitter.overflows);
+
+  MetricsFlush(w);
+  server.sendContent("", 0);
+}
+
 void handleNotFound(){
   String message = "File Not Found\n\n";
   message += "URI: ";
@@ -1187,15 +2629,34 @@ void handleNotFound(){
   server.send(404, "text/plain", message);
 }
 
+void handleInstrumentation() {
+  LogEvent(EVENTCATEGORIES::PageHandler, 1, "Page requested", "instrumentation.json");
+
+  if (!is_authenticated()){
+     server.send(401, "application/json", "{\"error\":\"Not authenticated\"}");
+     return;
+   }
+
+  StaticJsonDocument<JSON_INSTRUMENTATION_SIZE> doc;
+  SerializeInstrumentation(doc);
+
+  String myJsonString;
+  serializeJson(doc, myJsonString);
+  server.send(200, "application/json", myJsonString);
+
+  LogEvent(EVENTCATEGORIES::PageHandler, 2, "Page served", "instrumentation.json");
+}
+
 void SendHeartbeat(){
   if (PSclient.connected()){
 
-    time_t localTime = timezones[appConfig.timeZone]->toLocal(now(), &tcr);
+    time_t localTime = LocalNow();
 
-    const size_t capacity = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(6) + 180;
+    const size_t capacity = JSON_OBJECT_SIZE(3) + JSON_OBJECT_SIZE(9) + JSON_OBJECT_SIZE(8) + JSON_ARRAY_SIZE(LATENCY_BUCKETS) + JSON_OBJECT_SIZE(4) + JSON_OBJECT_SIZE(11) + 180;
     StaticJsonDocument<capacity> doc;
 
-    doc["Time"] = DateTimeToString(localTime);
+    char time[DATETIME_STRING_SIZE];
+    doc["Time"] = FormatDateTime(time, localTime);
     doc["Node"] = ESP.getChipId();
     doc["Freeheap"] = ESP.getFreeHeap();
     doc["FriendlyName"] = appConfig.friendlyName;
@@ -1206,6 +2667,45 @@ void SendHeartbeat(){
     wifiDetails["MACAddress"] = String(WiFi.macAddress());
     wifiDetails["IPAddress"] = WiFi.localIP().toString();
 
+    JsonObject loopDetails = doc.createNestedObject("Loop");
+    loopDetails["Passes"] = taskLoop.passes;
+    loopDetails["P50"] = LatencyPercentile(loopLatency, 50);
+    loopDetails["P99"] = LatencyPercentile(loopLatency, 99);
+    loopDetails["Max"] = loopLatency.maxTime;
+    loopDetails["TickLateMax"] = tickLateness.maxTime;
+    JsonArray histogram = loopDetails.createNestedArray("Histogram");
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++) histogram.add(loopLatency.buckets[i]);
+    const latencySection* worst = WorstLatencySection();
+    if (worst){
+      loopDetails["Worst"] = worst->tag;
+      loopDetails["WorstTime"] = worst->maxTime;
+    }
+
+    uint32_t free, maxBlock;
+    uint8_t fragmentation;
+    ESP.getHeapStats(&free, &maxBlock, &fragmentation);
+    JsonObject heapDetails = doc.createNestedObject("Heap");
+    heapDetails["Free"] = free;
+    heapDetails["MinFree"] = minFreeHeap;
+    heapDetails["MaxBlock"] = maxBlock;
+    heapDetails["Fragmentation"] = fragmentation;
+
+    //  Times in us, as in Loop
+    if (appConfig.realtimeEnabled){
+      JsonObject realtimeDetails = doc.createNestedObject("Realtime");
+      realtimeDetails["Active"] = realtime.active;
+      realtimeDetails["Frames"] = realtime.stats.frames;
+      realtimeDetails["SequenceErrors"] = realtime.stats.sequenceErrors;
+      realtimeDetails["Discarded"] = realtime.stats.discarded;
+      realtimeDetails["Latency"] = realtime.stats.latency;
+      realtimeDetails["LatencyAverage"] = realtime.stats.latencyAverage;
+      realtimeDetails["LatencyMax"] = realtime.stats.latencyMax;
+      realtimeDetails["Buffered"] = realtime.jitter.count;
+      realtimeDetails["Underruns"] = realtime.jitter.underruns;
+      realtimeDetails["Late"] = realtime.jitter.late;
+      realtimeDetails["Overflows"] = realtime.jitter.overflows;
+    }
+
     #ifdef __debugSettings
     serializeJsonPretty(doc,Serial);
     Serial.println();
@@ -1215,7 +2715,7 @@ void SendHeartbeat(){
 
     serializeJson(doc, myJsonString);
 
-    PSclient.publish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + "/" + appConfig.mqttTopic + "/HEARTBEAT").c_str(), myJsonString.c_str(), false);
+    MqttPublish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + "/" + appConfig.mqttTopic + "/HEARTBEAT").c_str(), myJsonString.c_str(), false);
   }
 
   needsHeartbeat = false;
@@ -1277,6 +2777,7 @@ void dumpIR(decode_results *results) {
 }
 
 void mqtt_callback(char* topic, byte* payload, unsigned int length) {
+  mqttStats.received++;
 
   Serial.print("Topic:\t\t");
   Serial.println(topic);
@@ -1288,21 +2789,54 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
   Serial.println();
 
   StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> doc;
-  DeserializationError error = deserializeJson(doc, payload);
+  DeserializationError error = deserializeJson(doc, payload, length);
 
-  if (error) {
+  //  A bare number such as a pwm value is valid JSON too, commands are objects
+  if (error || !doc.is<JsonObject>()) {
     //  It is NOT a JSON string
 
+    //  The payload is not null terminated
+    String s;
+    for (unsigned int i = 0; i < length; i++) s += (char)payload[i];
+
     //  pwm
-    for (size_t i = 0; i < sizeof(pwmOutputs)/sizeof(pwmOutputs[0]); i++) {
+    for (size_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
       if ( (String)topic == (MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/pwm" + (String)i).c_str() ){
-        String s(reinterpret_cast<char const*>(payload));
-        pwmOutputs[i].desiredValue = s.toInt();
-        if (PSclient.connected()){
-          PSclient.publish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/RESULT").c_str(), ("{\"PWM" + (String)i + "\":\"" + (String)pwmOutputs[i].desiredValue + "\"}" ).c_str(), 0);
-        }
+        SetDesiredChannel(i, s.toInt());
       }
     }
+
+    //  rgb - "r,g,b", the shared white component goes to the white channel
+    if ( (String)topic == (MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/rgb").c_str() ){
+      int firstComma = s.indexOf(',');
+      int secondComma = s.indexOf(',', firstComma + 1);
+      if (firstComma > 0 && secondComma > firstComma){
+        rgbColour c = {
+          clampColour(s.substring(0, firstComma).toInt()),
+          clampColour(s.substring(firstComma + 1, secondComma).toInt()),
+          clampColour(s.substring(secondComma + 1).toInt()) };
+        SetDesiredColour(c);
+      }
+    }
+
+    //  preset - the ID as a decimal number
+    if ( (String)topic == (MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/preset").c_str() ){
+      if (length > 0) RecallPreset(s.toInt());
+    }
+
+    //  presetraw - the ID as a single raw byte, for wall controllers that can only send one byte
+    if ( (String)topic == (MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/presetraw").c_str() ){
+      if (length == 1) RecallPreset(payload[0]);
+    }
+
+    //  ct - "kelvin" or "kelvin,brightness"
+    if ( (String)topic == (MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/ct").c_str() ){
+      int comma = s.indexOf(',');
+      if (comma > 0)
+        SetColourTemperature(s.substring(0, comma).toInt(), clampColour(s.substring(comma + 1).toInt()));
+      else
+        SetColourTemperature(s.toInt(), COLOUR_MAX);
+    }
   }
   else{
     //  It IS a JSON string
@@ -1324,10 +2858,345 @@ void mqtt_callback(char* topic, byte* payload, unsigned int length) {
       LogEvent(EVENTCATEGORIES::MqttMsg, 2, "Restart", "");
       ESP.reset();
     }
+
+    //  flash - {"flash":[r,g,b,w], "count":3, "period":400, "alpha":255}, count and the rest are optional
+    JsonArray flash = doc["flash"];
+    if (flash.size() == 4){
+      rgbwColour c = { clampColour(flash[0]), clampColour(flash[1]), clampColour(flash[2]), clampColour(flash[3]) };
+      uint16_t count = doc.containsKey("count") ? doc["count"] : 1;
+      uint16_t period = doc.containsKey("period") ? doc["period"] : 500;
+      uint8_t alpha = doc.containsKey("alpha") ? doc["alpha"] : 255;
+      CompositorFlash(lightCompositor, c, alpha, count, period);
+      LogEvent(EVENTCATEGORIES::MqttMsg, 3, "Flash", (String)count);
+    }
+
+    //  sequence - {"sequence":"name", "mode":0..2}, mode is optional
+    if (doc.containsKey("sequence")){
+      if (!SelectSequence(doc["sequence"].as<String>(), doc.containsKey("mode") ? doc["mode"] : -1))
+        LogEvent(EVENTCATEGORIES::MqttMsg, 4, "Unknown sequence", doc["sequence"].as<String>());
+    }
+
+    //  preset - {"preset":n}, {"store":n, "presetBrightness":0..255} or {"delete":n}
+    RunPresetCommand(doc.as<JsonVariant>());
+
+    //  circadian
+    if (SetCircadianCurve(doc.as<JsonVariant>())){
+      StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> result;
+      SerializeCircadianCurve(result);
+
+      String myJsonString;
+      serializeJson(result, myJsonString);
+      MqttPublish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/RESULT").c_str(), myJsonString.c_str(), 0);
+    }
+
+    //  calibration
+    if (SetCalibration(doc.as<JsonVariant>())){
+      StaticJsonDocument<JSON_MQTT_COMMAND_SIZE> result;
+      SerializeCalibration(result);
+
+      String myJsonString;
+      serializeJson(result, myJsonString);
+      MqttPublish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/RESULT").c_str(), myJsonString.c_str(), 0);
+    }
   }
 
 }
 
+void StartAccessPoint(){
+  Serial.print("Could not connect to ");
+  Serial.print(appConfig.ssid);
+  Serial.println("\r\nReverting to Access Point mode.");
+
+  delay(500);
+
+  WiFi.mode(WiFiMode::WIFI_AP);
+  WiFi.softAP(defaultSSID, DEFAULT_PASSWORD);
+
+  IPAddress myIP;
+  myIP = WiFi.softAPIP();
+  isAccessPointCreated = true;
+
+  Serial.println("Access point created. Use the following information to connect to the ESP device, then follow the on-screen instructions to connect to a different wifi network:");
+
+  Serial.print("SSID:\t\t\t");
+  Serial.println(defaultSSID);
+
+  Serial.print("Password:\t\t");
+  Serial.println(DEFAULT_PASSWORD);
+
+  Serial.print("Access point address:\t");
+  Serial.println(myIP);
+
+  Serial.println();
+  Serial.println("Note: The device will reset in 5 minutes.");
+
+  if (MDNS.begin(appConfig.mqttTopic)) Serial.println("MDNS responder started.");
+
+  os_timer_setfn(&accessPointTimer, accessPointTimerCallback, NULL);
+  os_timer_arm(&accessPointTimer, ACCESS_POINT_TIMEOUT, true);
+  os_timer_disarm(&heartbeatTimer);
+}
+
+//  Connectivity task: one step of the connection state machine per run.
+//  The other tasks only look at the state, nothing waits for it.
+void ConnectivityTask(){
+  if (isAccessPoint){
+    if (!isAccessPointCreated) StartAccessPoint();
+    return;
+  }
+
+  switch (connectionState) {
+
+    // Check the WiFi connection
+    case STATE_CHECK_WIFI_CONNECTION:
+
+      // Are we connected ?
+      if (WiFiLinkPoll() != WIFI_LINK_CONNECTED) {
+        // Wifi is NOT connected
+        digitalWrite(CONNECTION_STATUS_LED_GPIO, HIGH);
+        connectionState = STATE_WIFI_CONNECT;
+      } else  {
+        // Wifi is connected so check Internet
+        digitalWrite(CONNECTION_STATUS_LED_GPIO, LOW);
+        connectionState = STATE_CHECK_INTERNET_CONNECTION;
+      }
+      break;
+
+    // No Wifi so start connecting, then follow the link on every run
+    case STATE_WIFI_CONNECT:
+
+      // Indicate NTP no yet initialized
+      ntpInitialized = false;
+
+      switch (WiFiLinkPoll()) {
+        case WIFI_LINK_IDLE:
+          digitalWrite(CONNECTION_STATUS_LED_GPIO, HIGH);
+          Serial.printf("Trying to connect to WIFI network: %s", appConfig.ssid);
+
+          WiFi.hostname((String)appConfig.mqttTopic);
+          WiFiLinkBegin(appConfig.ssid, appConfig.password, WIFI_CONNECTION_TIMEOUT * 1000UL, WIFI_REUSE_LEASE);
+          break;
+
+        case WIFI_LINK_CONNECTING:
+          digitalWrite(CONNECTION_STATUS_LED_GPIO, !digitalRead(CONNECTION_STATUS_LED_GPIO));
+          Serial.print(".");
+          break;
+
+        case WIFI_LINK_CONNECTED:
+          digitalWrite(CONNECTION_STATUS_LED_GPIO, LOW);
+          Serial.printf(" Success in %u ms%s!\r\n", wifi.connectTime, wifi.lastFast ? " from the cache" : "");
+          Serial.print("IP address: ");
+          Serial.println(WiFi.localIP());
+          if (MDNS.begin(appConfig.mqttTopic)) Serial.println("MDNS responder started.");
+          connectionState = STATE_CHECK_INTERNET_CONNECTION;
+          break;
+
+        case WIFI_LINK_FAILED:
+          Serial.println();
+          Serial.println("Could not connect to WiFi");
+          isAccessPoint=true;
+          break;
+      }
+      break;
+
+    // The WiFi has just come up: start what only needs the LAN, the probes find out about the rest
+    case STATE_CHECK_INTERNET_CONNECTION:
+      StartRealtime();
+      SyslogBegin(appConfig.syslogServer, appConfig.syslogPort, appConfig.mqttTopic);
+      connectionState = STATE_INTERNET_CONNECTED;
+      break;
+
+    case STATE_INTERNET_CONNECTED:
+
+      // Stay here until the WiFi drops
+      if (WiFiLinkPoll() != WIFI_LINK_CONNECTED) {
+        digitalWrite(CONNECTION_STATUS_LED_GPIO, HIGH);
+        ResetConnectivity();
+        SyslogEnd();
+        connectionState = STATE_WIFI_CONNECT;
+        break;
+      }
+
+      PollConnectivity(ntpServerName, appConfig.mqttServer, appConfig.mqttPort, PSclient.connected());
+
+      if (!ntpInitialized && Reachability(internetProbe) == REACHABILITY_UP) {
+        // We are connected to the Internet for the first time so start asking for the time
+        if (!NtpBegin()) Serial.println("Error: Could not open the NTP port!");
+
+        ntpInitialized = true;
+
+        Serial.println("Connected to the Internet.");
+      }
+      break;
+  }
+}
+
+//  Events task: turns the timer events into the flags of the tasks that
+//  handle them, counting every light engine tick, dropped ones included
+void EventsTask(){
+  loopEvent e;
+  while (TakeEvent(loopEvents, e)){
+    switch (e.type){
+      case EVENT_LIGHT_TICK:
+        RecordLatency(tickLateness, micros() - e.time);
+        pendingLightTicks++;
+        needsPwmAdjustment = true;
+        break;
+      case EVENT_HEARTBEAT:
+        needsHeartbeat = true;
+        break;
+      case EVENT_ACTIVATION:
+        needsActivation = true;
+        break;
+    }
+  }
+
+  uint32_t dropped = TakeDroppedEvents(loopEvents, EVENT_LIGHT_TICK);
+  if (dropped){
+    pendingLightTicks += dropped;
+    needsPwmAdjustment = true;
+  }
+  if (TakeDroppedEvents(loopEvents, EVENT_HEARTBEAT)) needsHeartbeat = true;
+  if (TakeDroppedEvents(loopEvents, EVENT_ACTIVATION)) needsActivation = true;
+}
+
+//  Realtime task: picks up the frames the receive callback left
+void RealtimeTask(){
+  if (realtime.terminated && realtime.active){
+    EndRealtime("Stream terminated");
+  }
+  else if (realtime.fresh){
+    ShowRealtimeFrame();
+  }
+}
+
+void HttpTask(){
+  uint32_t start = LatencyStart();
+  server.handleClient();
+  EndLatencySection("handleClient", start);
+}
+
+//  MQTT task: keeps the client connected and serves it. A connect to a
+//  broker that does not answer blocks for the TCP timeout, so it is only
+//  tried when the broker probe has just reached it.
+void MqttTask(){
+  if (connectionState != STATE_INTERNET_CONNECTED) return;
+
+  if (!PSclient.connected()) {
+    if (Reachability(brokerProbe) != REACHABILITY_UP) return;
+
+    PSclient.setServer(appConfig.mqttServer, appConfig.mqttPort);
+    uint32_t start = LatencyStart();
+    bool connected = PSclient.connect(defaultSSID, (MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/STATE").c_str(), 0, true, "offline" );
+    EndLatencySection("PSclient.connect", start);
+
+    if (connected){
+      mqttStats.connects++;
+      PSclient.setCallback(mqtt_callback);
+
+      PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd").c_str(), 0);
+      for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++)
+        PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/pwm" + (String)i).c_str(), 0);
+      PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/rgb").c_str(), 0);
+      PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/ct").c_str(), 0);
+      PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/preset").c_str(), 0);
+      PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/presetraw").c_str(), 0);
+
+      MqttPublish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/STATE").c_str(), "online", true);
+      LogEvent(EVENTCATEGORIES::Conn, 1, "Node online", WiFi.localIP().toString());
+    }
+    else ReportUnreachable(brokerProbe);
+  }
+
+  if (PSclient.connected()){
+    uint32_t start = LatencyStart();
+    PSclient.loop();
+    EndLatencySection("PSclient.loop", start);
+  }
+}
+
+//  Log task: replays the buffered events to the sinks that came up
+void LogTask(){
+  ForwardLog(logSinks, LOG_SINK_COUNT);
+}
+
+void OtaTask(){
+  if (connectionState != STATE_INTERNET_CONNECTED) return;
+  uint32_t start = LatencyStart();
+  ArduinoOTA.handle();
+  EndLatencySection("ArduinoOTA.handle", start);
+}
+
+//  IR remote: the NEC command of our address is the preset ID
+void IrTask(){
+  if (irrecv.decode(&results)){
+    if (results.decode_type == NEC && results.address == IR_PRESET_ADDRESS && !results.repeat)
+      RecallPreset(results.command % PRESET_COUNT);
+    irrecv.resume();
+  }
+}
+
+//  Clock task: NTP rounds and TimeLib on the second. The schedule is planned
+//  again when the clock steps, the first time included.
+void ClockTask(){
+  if (NtpTick()) PlanActivation();
+}
+
+//  Nothing on the light moves, it only has to be held
+bool IsLightStill(){
+  return lightCompositor.layers[lightCompositor.incoming].program == 0 && !lightCompositor.transitioning && !lightCompositor.overlayCount &&
+    !wakeUp.active && !realtime.active && !realtime.fresh;
+}
+
+//  Every output fully on or off, so the GPIOs hold without PWM
+bool AreOutputsDigital(){
+#ifdef LIGHT_PIXEL_STRIP
+  return false;
+#else
+  for (uint i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+    if (outputValues[i] != 0 && outputValues[i] != PWM_OUTPUT_MAX) return false;
+  }
+  return true;
+#endif
+}
+
+//  Power task: goes idle when the light has been still for a while and
+//  wakes up as soon as it moves
+void PowerTask(){
+  if (!IsLightStill() || connectionState != STATE_INTERNET_CONNECTED){
+    power.quietSince = millis();
+    if (power.idle){
+      PowerExitIdle();
+      ArmLightEngineTimer();
+    }
+    return;
+  }
+
+  if (power.idle) PowerSetLightSleep(AreOutputsDigital());
+  else if (millis() - power.quietSince >= POWER_IDLE_AFTER){
+    PowerEnterIdle(AreOutputsDigital());
+    ArmLightEngineTimer();
+  }
+}
+
+//  The services of the node, in priority order (see tasks.h)
+task tasks[TASK_COUNT] = {
+  //  name, run, event flag, period (us), budget (us)
+  { "Events",         EventsTask,         NULL,                 0,                          1000 },
+  { "Realtime",       RealtimeTask,       NULL,                 0,                          2000 },
+  { "Clock",          ClockTask,          NULL,                 0,                          1000 },
+  { "Light engine",   AdjustPwm,          &needsPwmAdjustment,  0,                          3000 },
+  { "IR remote",      IrTask,             NULL,                 0,                          5000 },
+  { "Activation",     RunActivation,      &needsActivation,     0,                          20000 },
+  { "HTTP",           HttpTask,           NULL,                 0,                          50000 },
+  { "MQTT",           MqttTask,           NULL,                 0,                          20000 },
+  { "OTA",            OtaTask,            NULL,                 0,                          5000 },
+  { "Telemetry",      SendHeartbeat,      &needsHeartbeat,      0,                          20000 },
+  { "Log",            LogTask,            NULL,                 0,                          5000 },
+  { "Connectivity",   ConnectivityTask,   &wifiLinkChanged,     CONNECTIVITY_TASK_PERIOD,   20000 },
+  { "Power",          PowerTask,          NULL,                 0,                          1000 }
+};
+
 void setup() {
   delay(1); //  Needed for PlatformIO serial monitor
   Serial.begin(DEBUG_SPEED);
@@ -1356,6 +3225,10 @@ void setup() {
     Serial.println("Config loaded.");
   }
 
+  LoadPresets();
+
+  SetWhitePoint(appConfig.whiteTemperature, appConfig.whiteExtraction);
+
   WiFi.hostname(appConfig.mqttTopic);
 
   //  GPIOs
@@ -1366,8 +3239,15 @@ void setup() {
   pinMode(ACTIVITY_LED_GPIO, OUTPUT);
   digitalWrite(ACTIVITY_LED_GPIO, HIGH);
 
+#ifdef LIGHT_PIXEL_STRIP
+  if (!PixelStripBegin()) Serial.println("Error: Not enough memory for the pixel strip!");
+#else
+  analogWriteRange(PWM_OUTPUT_MAX);
+#endif
 
-  for (size_t i = 0; i < sizeof(pwmOutputs)/sizeof(pwmOutputs[0]); i++) analogWrite(pwmOutputs[i].gpio, pwmOutputs[i].value);
+  //  Nothing has been written yet, so every channel is written once
+  memset(outputValues, 0xFF, sizeof(outputValues));
+  WriteOutputs();
 
   //  OTA
   ArduinoOTA.onStart([]() {
@@ -1409,7 +3289,16 @@ void setup() {
   server.on("/programs.html", handlePrograms);
   server.on("/customcolour.html", handleCustomColour);
   server.on("/slowchanging.html", handleSlowChanging);
+  server.on("/followday.html", handleFollowDay);
+  server.on("/realtime.html", handleRealtime);
   server.on("/tools.html", handleTools);
+  server.on("/calibration.json", handleCalibration);
+  server.on("/circadian.json", handleCircadian);
+  server.on("/presets.json", handlePresets);
+  server.on("/instrumentation.json", handleInstrumentation);
+  server.on("/metrics", handleMetrics);
+  server.on("/eventlog.txt", handleEventLog);
+  server.on("/sequenceupload", HTTP_POST, handleSequenceUploadDone, handleSequenceUpload);
   server.on("/login.html", handleLogin);
 
   server.onNotFound(handleNotFound);
@@ -1426,208 +3315,30 @@ void setup() {
   //  Timers
   os_timer_setfn(&heartbeatTimer, heartbeatTimerCallback, NULL);
   os_timer_setfn(&pwmAdjustmentTimer, pwmAdjustmentTimerCallback, NULL);
-  os_timer_setfn(&pwmModifierTimer, pwmModifierTimerCallback, NULL);
+  os_timer_setfn(&activationTimer, activationTimerCallback, NULL);
   
   os_timer_arm(&heartbeatTimer, appConfig.heartbeatInterval * 1000, true);
-  os_timer_arm(&pwmAdjustmentTimer, DEFAULT_PWM_ADJUSTMENT_SPEED, true);
-
-  if ( appConfig.selectedProgram )
-    os_timer_arm(&pwmModifierTimer, DEFAULT_PWM_CHANGE_SPEED * 1000, true);
 
   //  Randomizer
   SetRandomSeed();
 
+  StartLightEngine();
+
   irrecv.enableIRIn();
   irsend.begin();
 
   // Set the initial connection state
   connectionState = STATE_CHECK_WIFI_CONNECTION;
 
+  StartTasks(tasks, TASK_COUNT);
+  PowerBegin();
+
 }
 
 void loop(){
-
-  if (isAccessPoint){
-    if (!isAccessPointCreated){
-      Serial.print("Could not connect to ");
-      Serial.print(appConfig.ssid);
-      Serial.println("\r\nReverting to Access Point mode.");
-
-      delay(500);
-
-      WiFi.mode(WiFiMode::WIFI_AP);
-      WiFi.softAP(defaultSSID, DEFAULT_PASSWORD);
-
-      IPAddress myIP;
-      myIP = WiFi.softAPIP();
-      isAccessPointCreated = true;
-
-      Serial.println("Access point created. Use the following information to connect to the ESP device, then follow the on-screen instructions to connect to a different wifi network:");
-
-      Serial.print("SSID:\t\t\t");
-      Serial.println(defaultSSID);
-
-      Serial.print("Password:\t\t");
-      Serial.println(DEFAULT_PASSWORD);
-
-      Serial.print("Access point address:\t");
-      Serial.println(myIP);
-
-      Serial.println();
-      Serial.println("Note: The device will reset in 5 minutes.");
-
-      if (MDNS.begin(appConfig.mqttTopic)) Serial.println("MDNS responder started.");
-
-      os_timer_setfn(&accessPointTimer, accessPointTimerCallback, NULL);
-      os_timer_arm(&accessPointTimer, ACCESS_POINT_TIMEOUT, true);
-      os_timer_disarm(&heartbeatTimer);
-    }
-    server.handleClient();
-  }
-  else{
-    switch (connectionState) {
-
-      // Check the WiFi connection
-      case STATE_CHECK_WIFI_CONNECTION:
-
-        // Are we connected ?
-        if (WiFi.status() != WL_CONNECTED) {
-          // Wifi is NOT connected
-          digitalWrite(CONNECTION_STATUS_LED_GPIO, HIGH);
-          connectionState = STATE_WIFI_CONNECT;
-        } else  {
-          // Wifi is connected so check Internet
-          digitalWrite(CONNECTION_STATUS_LED_GPIO, LOW);
-          connectionState = STATE_CHECK_INTERNET_CONNECTION;
-
-          server.handleClient();
-        }
-        break;
-
-      // No Wifi so attempt WiFi connection
-      case STATE_WIFI_CONNECT:
-        {
-          // Indicate NTP no yet initialized
-          ntpInitialized = false;
-
-          digitalWrite(CONNECTION_STATUS_LED_GPIO, HIGH);
-          Serial.printf("Trying to connect to WIFI network: %s", appConfig.ssid);
-
-          // Set station mode
-          WiFi.mode(WIFI_STA);
-
-          // Start connection process
-          WiFi.hostname((String)appConfig.mqttTopic);
-          WiFi.begin(appConfig.ssid, appConfig.password);
-
-          // Initialize iteration counter
-          uint8_t attempt = 0;
-
-          while ((WiFi.status() != WL_CONNECTED) && (attempt++ < WIFI_CONNECTION_TIMEOUT)) {
-            digitalWrite(CONNECTION_STATUS_LED_GPIO, LOW);
-            Serial.print(".");
-            delay(50);
-            digitalWrite(CONNECTION_STATUS_LED_GPIO, HIGH);
-            delay(950);
-          }
-          if (attempt >= WIFI_CONNECTION_TIMEOUT) {
-            Serial.println();
-            Serial.println("Could not connect to WiFi");
-            delay(100);
-
-            isAccessPoint=true;
-
-            break;
-          }
-          digitalWrite(CONNECTION_STATUS_LED_GPIO, LOW);
-          Serial.println(" Success!");
-          Serial.print("IP address: ");
-          Serial.println(WiFi.localIP());
-          if (MDNS.begin(appConfig.mqttTopic)) Serial.println("MDNS responder started.");
-          connectionState = STATE_CHECK_INTERNET_CONNECTION;
-        }
-        break;
-
-      case STATE_CHECK_INTERNET_CONNECTION:
-
-        // Do we have a connection to the Internet ?
-        if (checkInternetConnection()) {
-          // We have an Internet connection
-
-          if (!ntpInitialized) {
-            // We are connected to the Internet for the first time so set NTP provider
-            initNTP();
-
-            ntpInitialized = true;
-
-            Serial.println("Connected to the Internet.");
-          }
-
-          connectionState = STATE_INTERNET_CONNECTED;
-        } else  {
-          connectionState = STATE_CHECK_WIFI_CONNECTION;
-        }
-        break;
-
-      case STATE_INTERNET_CONNECTED:
-
-        ArduinoOTA.handle();
-
-        if (!PSclient.connected()) {
-          PSclient.setServer(appConfig.mqttServer, appConfig.mqttPort);
-          if (PSclient.connect(defaultSSID, (MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/STATE").c_str(), 0, true, "offline" )){
-            PSclient.setCallback(mqtt_callback);
-
-            PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd").c_str(), 0);
-            PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/pwm0").c_str(), 0);
-            PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/pwm1").c_str(), 0);
-            PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/pwm2").c_str(), 0);
-            PSclient.subscribe((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/cmnd/pwm3").c_str(), 0);
-
-            PSclient.publish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/STATE").c_str(), "online", true);
-            LogEvent(EVENTCATEGORIES::Conn, 1, "Node online", WiFi.localIP().toString());
-          }
-        }
-
-        if (PSclient.connected()){
-          PSclient.loop();
-        }
-
-
-
-        if (needsPwmAdjustment){
-          for (uint i = 0; i < sizeof(pwmOutputs)/sizeof(pwmOutputs[0]); i++) {
-            if ( pwmOutputs[i].desiredValue > pwmOutputs[i].value) pwmOutputs[i].value++;
-            if ( pwmOutputs[i].desiredValue < pwmOutputs[i].value) pwmOutputs[i].value--;
-            analogWrite(pwmOutputs[i].gpio, pwmOutputs[i].value);
-          }
-          needsPwmAdjustment = false;
-        }
-
-        if (needsPwmModify){
-          String msg = "";
-          for (size_t i = 0; i < sizeof(pwmOutputs)/sizeof(pwmOutputs[0]); i++){
-            pwmOutputs[i].desiredValue = rand() % 1024;
-            if (msg!="") msg += ",";
-            msg += (String)pwmOutputs[i].desiredValue;
-            if (PSclient.connected()){
-              PSclient.publish((MQTT_CUSTOMER + String("/") + MQTT_PROJECT + String("/") + appConfig.mqttTopic + "/RESULT").c_str(), ("{\"PWM" + (String)i + "\":\"" + (String)pwmOutputs[i].desiredValue + "\"}" ).c_str(), 0);
-            }
-          }
-            LogEvent(EVENTCATEGORIES::PwmAutoChange, 0, "RGB values", msg);
-
-          needsPwmModify = false;
-        }
-
-        if (needsHeartbeat){
-          SendHeartbeat();
-          needsHeartbeat = false;
-        }
-
-        // Set next connection state
-        connectionState = STATE_CHECK_WIFI_CONNECTION;
-        break;
-    }
-
-  }
+  uint32_t start = LatencyStart();
+  RunTasks(tasks, TASK_COUNT);
+  RecordLatency(loopLatency, LatencyElapsed(start));
+  UpdateHeapWatermark();
+  PowerSleep(loopEvents.head != loopEvents.tail ? 0 : TaskIdleTime(tasks, TASK_COUNT));
 }
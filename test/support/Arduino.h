@@ -0,0 +1,54 @@
+/*
+    Arduino.h - The parts of the Arduino core the headers under test use,
+    for the native test environment
+
+    PROGMEM tables are plain arrays on the host. millis() and micros()
+    are a fake clock the tests set and advance themselves.
+*/
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <type_traits>
+
+#define PROGMEM
+#define IRAM_ATTR
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define memcpy_P memcpy
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+typedef uint8_t byte;
+typedef unsigned int uint;
+
+template<typename T, typename U> inline typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template<typename T, typename U> inline typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+template<typename T, typename L, typename H> inline T constrain(T v, L lo, H hi) { return v < lo ? lo : (v > hi ? hi : v); }
+
+inline uint32_t& FakeMicros(){
+  static uint32_t us = 0;
+  return us;
+}
+
+inline uint32_t micros() { return FakeMicros(); }
+inline uint32_t millis() { return FakeMicros() / 1000; }
+inline void SetFakeMillis(uint32_t ms) { FakeMicros() = ms * 1000; }
+inline void AdvanceFakeMicros(uint32_t us) { FakeMicros() += us; }
+inline void delay(uint32_t ms) { FakeMicros() += ms * 1000; }
+inline void yield() {}
+
+inline long random(long max) { return max > 0 ? rand() % max : 0; }
+inline long random(long min, long max) { return max > min ? min + rand() % (max - min) : min; }
+
+#endif
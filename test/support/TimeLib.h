@@ -0,0 +1,65 @@
+/*
+    TimeLib.h - The parts of the Time library the headers under test use,
+    for the native test environment, over the C library in UTC
+*/
+
+#ifndef TIMELIB_H
+#define TIMELIB_H
+
+#include <time.h>
+#include <stdint.h>
+
+#define SECS_PER_MIN 60UL
+#define SECS_PER_HOUR 3600UL
+#define SECS_PER_DAY 86400UL
+#define SECS_PER_WEEK (SECS_PER_DAY * 7UL)
+
+#define tmYearToCalendar(Y) ((Y) + 1970)
+#define CalendarYrToTm(Y) ((Y) - 1970)
+#define elapsedDays(t) ((t) / SECS_PER_DAY)
+#define previousMidnight(t) (((t) / SECS_PER_DAY) * SECS_PER_DAY)
+#define numberOfSecondsSinceMidnight(t) ((t) % SECS_PER_DAY)
+#define dayOfWeek(t) ((((t) / SECS_PER_DAY + 4) % 7) + 1)
+
+typedef struct{
+  uint8_t Second;
+  uint8_t Minute;
+  uint8_t Hour;
+  uint8_t Wday;         //  Sunday is 1
+  uint8_t Day;
+  uint8_t Month;
+  uint8_t Year;         //  offset from 1970
+} tmElements_t;
+
+inline void breakTime(time_t t, tmElements_t& tm){
+  struct tm c;
+  gmtime_r(&t, &c);
+  tm.Second = c.tm_sec;
+  tm.Minute = c.tm_min;
+  tm.Hour = c.tm_hour;
+  tm.Wday = c.tm_wday + 1;
+  tm.Day = c.tm_mday;
+  tm.Month = c.tm_mon + 1;
+  tm.Year = c.tm_year - 70;
+}
+
+inline time_t makeTime(const tmElements_t& tm){
+  struct tm c = {};
+  c.tm_sec = tm.Second;
+  c.tm_min = tm.Minute;
+  c.tm_hour = tm.Hour;
+  c.tm_mday = tm.Day;
+  c.tm_mon = tm.Month - 1;
+  c.tm_year = tm.Year + 70;
+  return timegm(&c);
+}
+
+inline time_t& FakeNow(){
+  static time_t t = 0;
+  return t;
+}
+
+inline time_t now() { return FakeNow(); }
+inline void setTime(time_t t) { FakeNow() = t; }
+
+#endif
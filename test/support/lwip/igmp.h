@@ -0,0 +1,14 @@
+/*
+    lwip/igmp.h - Multicast group membership, accepted and ignored in the
+    native test environment
+*/
+
+#ifndef LWIP_IGMP_H
+#define LWIP_IGMP_H
+
+#include "udp.h"
+
+inline err_t igmp_joingroup(const ip4_addr_t* ifaddr, const ip4_addr_t* group) { return ERR_OK; }
+inline err_t igmp_leavegroup(const ip4_addr_t* ifaddr, const ip4_addr_t* group) { return ERR_OK; }
+
+#endif
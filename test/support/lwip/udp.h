@@ -0,0 +1,56 @@
+/*
+    lwip/udp.h - The raw UDP API as realtime.h uses it, for the native
+    test environment. Nothing is sent or received: the tests hand packets
+    to the receive callbacks in pbufs of their own.
+*/
+
+#ifndef LWIP_UDP_H
+#define LWIP_UDP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef int8_t err_t;
+
+#define ERR_OK 0
+
+struct ip4_addr_t{
+  uint32_t addr;
+};
+typedef ip4_addr_t ip_addr_t;
+
+#define IP4_ADDR(a, b, c, d, e) ((a)->addr = (uint32_t)(b) | ((uint32_t)(c) << 8) | ((uint32_t)(d) << 16) | ((uint32_t)(e) << 24))
+
+inline const ip_addr_t* LwipAnyAddress(){
+  static const ip_addr_t any = { 0 };
+  return &any;
+}
+
+#define IP_ADDR_ANY (LwipAnyAddress())
+#define IP4_ADDR_ANY4 (LwipAnyAddress())
+
+struct pbuf{
+  pbuf* next;
+  void* payload;
+  u16_t tot_len;
+  u16_t len;
+};
+
+struct udp_pcb;
+typedef void (*udp_recv_fn)(void* arg, udp_pcb* pcb, pbuf* p, const ip_addr_t* addr, u16_t port);
+
+struct udp_pcb{
+  u16_t port;
+  udp_recv_fn recv;
+  void* arg;
+};
+
+inline udp_pcb* udp_new() { return new udp_pcb(); }
+inline void udp_remove(udp_pcb* pcb) { delete pcb; }
+inline err_t udp_bind(udp_pcb* pcb, const ip_addr_t* addr, u16_t port) { pcb->port = port; return ERR_OK; }
+inline void udp_recv(udp_pcb* pcb, udp_recv_fn recv, void* arg) { pcb->recv = recv; pcb->arg = arg; }
+inline u8_t pbuf_free(pbuf* p) { return 1; }
+
+#endif
@@ -0,0 +1,145 @@
+/*
+    Host tests of the calibration output stage: the matrix, brightness and
+    level scaling and the dithering, and the cost of the matrix stage per
+    light engine tick
+
+    The host time is scaled by ESP8266_SLOWDOWN, a deliberately
+    pessimistic ratio between a desktop core and the 80 MHz LX106.
+
+    pio test -e native -f test_calibration
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include "board.h"
+#include "calibration.h"
+#include "rgbw.h"
+
+#define ESP8266_SLOWDOWN 100
+#define MATRIX_BUDGET_US 5
+#define ITERATIONS 200000
+
+volatile int32_t sink;
+int16_t matrix[CALIBRATION_CHANNELS][CALIBRATION_CHANNELS];
+
+void setUp(){
+  CalibrationIdentity(matrix);
+}
+
+void tearDown(){}
+
+void test_identity_passes_full_scale(){
+  uint16_t in[CALIBRATION_CHANNELS] = { 1023, 1023, 1023, 1023 };
+  int32_t out[CALIBRATION_CHANNELS];
+
+  int32_t full = min(((int32_t)1023 * CALIBRATION_UNITY) >> (12 - (PWM_OUTPUT_BITS - 10) - CALIBRATION_FRACTION_BITS), CALIBRATION_MAX_OUTPUT);
+
+  ApplyCalibration(matrix, MASTER_BRIGHTNESS_MAX, OUTPUT_LEVEL_MAX, in, out);
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS; i++) TEST_ASSERT_EQUAL(full, out[i]);
+
+  ApplyCalibration(matrix, 0, OUTPUT_LEVEL_MAX, in, out);
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS; i++) TEST_ASSERT_EQUAL(0, out[i]);
+
+  ApplyCalibration(matrix, MASTER_BRIGHTNESS_MAX, 0, in, out);
+  for (uint8_t i = 0; i < CALIBRATION_CHANNELS; i++) TEST_ASSERT_EQUAL(0, out[i]);
+}
+
+void test_cross_talk_is_clamped(){
+  //  Red takes away half of the green, which can not go below dark
+  matrix[1][0] = -CALIBRATION_UNITY / 2;
+  uint16_t in[CALIBRATION_CHANNELS] = { 1023, 200, 0, 0 };
+  int32_t out[CALIBRATION_CHANNELS];
+
+  ApplyCalibration(matrix, MASTER_BRIGHTNESS_MAX, OUTPUT_LEVEL_MAX, in, out);
+  TEST_ASSERT_EQUAL(0, out[1]);
+  TEST_ASSERT_GREATER_THAN(0, out[0]);
+}
+
+//  A value between two PWM steps averages out to it over the ticks
+void test_dither_averages_fraction(){
+  outputDither d = {};
+  int32_t in[LIGHT_CHANNEL_COUNT];
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) in[i] = (100 << CALIBRATION_FRACTION_BITS) + (1 << CALIBRATION_FRACTION_BITS) / 4;
+
+  uint32_t sum = 0;
+  for (uint16_t tick = 0; tick < 400; tick++) {
+    uint16_t out[LIGHT_CHANNEL_COUNT];
+    DitherOutputs(d, in, out);
+    TEST_ASSERT_TRUE(out[0] == 100 || out[0] == 101);
+    sum += out[0];
+  }
+  TEST_ASSERT_EQUAL(400 * 100 + 100, sum);
+}
+
+//  White extracted along a tinted white point comes back as the same colour,
+//  from the white LED or mixed from the RGB ones on a board without one
+void test_extracted_white_keeps_hue(){
+  if (!LIGHT_HAS_RGB) return;
+
+  SetWhitePoint(4000, true);
+  rgbColour c = { 1023, 512, 256 };
+  rgbwColour e = RgbToRgbw(c);
+  TEST_ASSERT_GREATER_THAN(0, e.w);
+
+  int32_t in[4] = { e.r, e.g, e.b, e.w }, channels[LIGHT_CHANNEL_COUNT], shown[4];
+  MapLightChannels(in, channels, ColdWhiteShare(4000), COLOUR_MAX);
+  UnmapLightChannels(channels, shown, COLOUR_MAX);
+
+  rgbwColour s = { clampColour(shown[0]), clampColour(shown[1]), clampColour(shown[2]), clampColour(shown[3]) };
+  rgbColour seen = RgbwToRgb(s);
+  TEST_ASSERT_INT_WITHIN(2, c.r, seen.r);
+  TEST_ASSERT_INT_WITHIN(2, c.g, seen.g);
+  TEST_ASSERT_INT_WITHIN(2, c.b, seen.b);
+}
+
+void test_matrix_stage_cost(){
+  int32_t calibrated[CALIBRATION_CHANNELS];
+  uint16_t in[CALIBRATION_CHANNELS];
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    for (uint8_t c = 0; c < CALIBRATION_CHANNELS; c++) in[c] = (i + c * 257) & 1023;
+    ApplyCalibration(matrix, 200, 40000 + (i & 0xFFF), in, calibrated);
+    sink += calibrated[i & 3];
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+
+  char line[96];
+  snprintf(line, sizeof(line), "ApplyCalibration: %.1f ns on the host, about %.2f us on the ESP8266", ns, ns * ESP8266_SLOWDOWN / 1000);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN(MATRIX_BUDGET_US * 1000.0 / ESP8266_SLOWDOWN, ns);
+}
+
+//  The whole output stage as WriteOutputs() runs it
+void test_output_stage_cost(){
+  outputDither d = {};
+  int32_t calibrated[CALIBRATION_CHANNELS], mapped[LIGHT_CHANNEL_COUNT];
+  uint16_t in[CALIBRATION_CHANNELS], out[LIGHT_CHANNEL_COUNT];
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    for (uint8_t c = 0; c < CALIBRATION_CHANNELS; c++) in[c] = (i + c * 257) & 1023;
+    ApplyCalibration(matrix, 200, 40000 + (i & 0xFFF), in, calibrated);
+    MapLightChannels(calibrated, mapped, ColdWhiteShare(4000), CALIBRATION_MAX_OUTPUT);
+    DitherOutputs(d, mapped, out);
+    sink += out[i % LIGHT_CHANNEL_COUNT];
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ITERATIONS;
+
+  char line[96];
+  snprintf(line, sizeof(line), "Output stage: %.1f ns on the host, about %.2f us on the ESP8266", ns, ns * ESP8266_SLOWDOWN / 1000);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN(2 * MATRIX_BUDGET_US * 1000.0 / ESP8266_SLOWDOWN, ns);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_identity_passes_full_scale);
+  RUN_TEST(test_cross_talk_is_clamped);
+  RUN_TEST(test_dither_averages_fraction);
+  RUN_TEST(test_extracted_white_keeps_hue);
+  RUN_TEST(test_matrix_stage_cost);
+  RUN_TEST(test_output_stage_cost);
+  return UNITY_END();
+}
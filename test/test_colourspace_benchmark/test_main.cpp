@@ -0,0 +1,117 @@
+/*
+    Host benchmark of the colour space path the light engine runs at 200 Hz
+
+    Every tick of a colour fade costs one ColourFadeStep(), and every new
+    target a ColourFadeStart() with the conversions of both end points.
+    The host times are scaled by ESP8266_SLOWDOWN, a deliberately
+    pessimistic ratio between a desktop core and the 80 MHz LX106 without
+    FPU or fast 64 bit multiply, and have to fit in the share of the 5 ms
+    tick the colour engine is allowed.
+
+    pio test -e native -f test_colourspace_benchmark
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include <chrono>
+#include "colourspace.h"
+
+#define ESP8266_SLOWDOWN 100
+#define TICK_US 5000                //  200 Hz
+#define COLOUR_BUDGET_US 250        //  5% of the tick
+#define ITERATIONS 200000
+
+volatile uint32_t sink;
+
+void setUp(){}
+void tearDown(){}
+
+rgbColour RandomColour(){
+  rgbColour c = { (uint16_t)(rand() % (COLOUR_MAX + 1)), (uint16_t)(rand() % (COLOUR_MAX + 1)), (uint16_t)(rand() % (COLOUR_MAX + 1)) };
+  return c;
+}
+
+//  Host ns per call of f, over ITERATIONS calls
+template<typename F> double NsPerCall(F f){
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++) f(i);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / ITERATIONS;
+}
+
+void Report(const char* name, double ns){
+  char line[128];
+  snprintf(line, sizeof(line), "%s: %.1f ns on the host, about %.1f us on the ESP8266", name, ns, ns * ESP8266_SLOWDOWN / 1000);
+  TEST_MESSAGE(line);
+}
+
+void test_conversions(){
+  rgbColour colours[256];
+  for (uint16_t i = 0; i < 256; i++) colours[i] = RandomColour();
+
+  double toHsv = NsPerCall([&](uint32_t i){ sink += RgbToHsv(colours[i & 0xFF]).h; });
+  double fromHsv = NsPerCall([&](uint32_t i){ hsvColour h = { (uint16_t)(i % HUE_MAX), 200, 255 }; sink += HsvToRgb(h).r; });
+  double toLab = NsPerCall([&](uint32_t i){ sink += RgbToOklab(colours[i & 0xFF]).L; });
+  double fromLab = NsPerCall([&](uint32_t i){ oklabColour o = { 2048 + (int32_t)(i & 1023), 0, 0 }; sink += OklabToRgb(o).g; });
+
+  Report("RgbToHsv", toHsv);
+  Report("HsvToRgb", fromHsv);
+  Report("RgbToOklab", toLab);
+  Report("OklabToRgb", fromLab);
+
+  TEST_ASSERT_LESS_THAN(COLOUR_BUDGET_US * 1000.0 / ESP8266_SLOWDOWN, toLab + fromLab);
+}
+
+void BenchmarkFade(uint8_t mode, const char* name){
+  rgbColour from = RandomColour(), to = RandomColour();
+  colourFade fade;
+  ColourFadeStart(fade, from, to, 0xFFFF, mode);
+
+  double step = NsPerCall([&](uint32_t){
+    rgbColour out = { 0, 0, 0 };
+    if (!ColourFadeStep(fade, out)) ColourFadeStart(fade, from, to, 0xFFFF, mode);
+    sink += out.r;
+  });
+  double start = NsPerCall([&](uint32_t i){ ColourFadeStart(fade, from, to, 1000 + (i & 0xFF), mode); sink += fade.steps; });
+
+  char label[48];
+  snprintf(label, sizeof(label), "ColourFadeStep %s", name);
+  Report(label, step);
+  snprintf(label, sizeof(label), "ColourFadeStart %s", name);
+  Report(label, start);
+
+  //  The worst tick starts a new fade and steps it
+  TEST_ASSERT_LESS_THAN(COLOUR_BUDGET_US * 1000.0 / ESP8266_SLOWDOWN, step + start);
+}
+
+void test_hue_fade(){
+  BenchmarkFade(COLOUR_INTERPOLATION_HUE, "HSV");
+}
+
+void test_oklab_fade(){
+  BenchmarkFade(COLOUR_INTERPOLATION_OKLAB, "OKLab");
+}
+
+//  A second of ticks at 200 Hz has to leave the rest of the loop most of its time
+void test_one_second_of_ticks(){
+  colourFade fade;
+  ColourFadeStart(fade, RandomColour(), RandomColour(), 200, COLOUR_INTERPOLATION_OKLAB);
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint16_t tick = 0; tick < 1000000 / TICK_US; tick++) {
+    rgbColour out = { 0, 0, 0 };
+    ColourFadeStep(fade, out);
+    sink += out.b;
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  TEST_ASSERT_LESS_THAN(1000000.0 * COLOUR_BUDGET_US / TICK_US / ESP8266_SLOWDOWN, us);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_conversions);
+  RUN_TEST(test_hue_fade);
+  RUN_TEST(test_oklab_fade);
+  RUN_TEST(test_one_second_of_ticks);
+  return UNITY_END();
+}
@@ -0,0 +1,114 @@
+/*
+    Host tests of the event log ring in eventlog.h: the boot events stay in
+    the ring through a flood of page requests, which only go live to the
+    sinks that are caught up.
+
+    pio test -e native -f test_eventlog
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "eventlog.h"
+
+bool sinkUp;
+uint32_t sinkRecords;
+logRecord sinkLast;
+
+bool SinkReady(){
+  return sinkUp;
+}
+
+bool SinkSend(const logRecord& r){
+  sinkRecords++;
+  sinkLast = r;
+  return true;
+}
+
+logSink sinks[1];
+
+void setUp(){
+  memset(&eventLogBuffer, 0, sizeof(eventLogBuffer));
+  memset(sinks, 0, sizeof(sinks));
+  sinks[0].name = "Test";
+  sinks[0].ready = SinkReady;
+  sinks[0].send = SinkSend;
+  sinkUp = false;
+  sinkRecords = 0;
+}
+
+void tearDown(){}
+
+void Log(uint8_t severity, uint8_t category, uint16_t id, const char* title, const char* data){
+  LogRecordEvent(sinks, 1, severity, category, id, 0, title, data);
+}
+
+void test_page_requests_keep_boot_events(){
+  Log(LOG_SEVERITY_NOTICE, 1, 1, "Reboot", "Power on");
+  Log(LOG_SEVERITY_NOTICE, 2, 1, "WiFi connected", "192.168.1.20");
+
+  for (uint16_t i = 0; i < 1000; i++) {
+    Log(LOG_SEVERITY_DEBUG, 3, 1, "Page requested", "status.html");
+    Log(LOG_SEVERITY_DEBUG, 3, 2, "Page served", "status.html");
+  }
+
+  TEST_ASSERT_EQUAL(2, eventLogBuffer.nextSequence);
+  TEST_ASSERT_EQUAL(0, eventLogBuffer.dropped);
+
+  logCursor c = { eventLogBuffer.firstSequence, eventLogBuffer.tail };
+  logRecord r;
+  TEST_ASSERT_TRUE(ReadLogRecord(c, r));
+  TEST_ASSERT_EQUAL(0, strcmp(r.title, "Reboot"));
+  TEST_ASSERT_TRUE(ReadLogRecord(c, r));
+  TEST_ASSERT_EQUAL(0, strcmp(r.data, "192.168.1.20"));
+  TEST_ASSERT_FALSE(ReadLogRecord(c, r));
+}
+
+void test_debug_events_sent_live(){
+  sinkUp = true;
+  Log(LOG_SEVERITY_NOTICE, 1, 1, "Reboot", "Power on");
+  TEST_ASSERT_EQUAL(1, sinkRecords);
+
+  Log(LOG_SEVERITY_DEBUG, 3, 1, "Page requested", "status.html");
+  TEST_ASSERT_EQUAL(2, sinkRecords);
+  TEST_ASSERT_EQUAL(LOG_SEVERITY_DEBUG, sinkLast.header.severity);
+  TEST_ASSERT_EQUAL(0, strcmp(sinkLast.title, "Page requested"));
+  TEST_ASSERT_EQUAL(0, strcmp(sinkLast.data, "status.html"));
+  TEST_ASSERT_EQUAL(1, sinkLast.sequence);
+  TEST_ASSERT_EQUAL(2, sinks[0].sent);
+}
+
+void test_debug_events_not_replayed(){
+  Log(LOG_SEVERITY_NOTICE, 1, 1, "Reboot", "Power on");
+  Log(LOG_SEVERITY_DEBUG, 3, 1, "Page requested", "status.html");
+
+  //  The sink comes up: the boot event is replayed, the page request is gone
+  sinkUp = true;
+  ForwardLog(sinks, 1);
+  TEST_ASSERT_EQUAL(1, sinkRecords);
+  TEST_ASSERT_EQUAL(0, strcmp(sinkLast.title, "Reboot"));
+
+  //  Not sent live ahead of the older records a sink is still replaying
+  sinks[0].next.sequence = 0;
+  sinks[0].next.offset = 0;
+  Log(LOG_SEVERITY_DEBUG, 3, 2, "Page served", "status.html");
+  TEST_ASSERT_EQUAL(1, sinkRecords);
+}
+
+void test_live_record_truncated(){
+  char data[LOG_DATA_SIZE * 2];
+  memset(data, 'x', sizeof(data) - 1);
+  data[sizeof(data) - 1] = 0;
+
+  sinkUp = true;
+  Log(LOG_SEVERITY_DEBUG, 3, 1, "Page requested", data);
+  TEST_ASSERT_EQUAL(LOG_DATA_SIZE - 1, strlen(sinkLast.data));
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_page_requests_keep_boot_events);
+  RUN_TEST(test_debug_events_sent_live);
+  RUN_TEST(test_debug_events_not_replayed);
+  RUN_TEST(test_live_record_truncated);
+  return UNITY_END();
+}
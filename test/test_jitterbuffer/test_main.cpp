@@ -0,0 +1,279 @@
+/*
+    Host tests of the playout buffer in jitterbuffer.h: frames put back in
+    order, late frames dropped, interpolation between the frames around
+    the playout time, and the underrun and overflow counters.
+
+    The streams are 50 fps, every slot of a frame holding the same value,
+    and played out 50 ms behind.
+
+    pio test -e native -f test_jitterbuffer
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "board.h"
+#include "jitterbuffer.h"
+
+#define INTERVAL 20000UL        //  us
+#define DELAY 50000UL
+#define START 1000000UL
+
+jitterBuffer jb;
+
+void setUp(){
+  memset(&jb, 0, sizeof(jb));
+  JitterReset(jb);
+}
+
+void tearDown(){}
+
+//  Frame n of the stream, sent at START + n * INTERVAL and arriving late by lag us
+void Push(uint8_t sequence, uint32_t n, uint8_t value, uint32_t lag = 0){
+  uint8_t values[LIGHT_CHANNEL_COUNT];
+  memset(values, value, sizeof(values));
+  JitterPush(jb, true, sequence, false, START + n * INTERVAL + lag, values, DELAY);
+}
+
+//  The channels at now, 0..255, all alike; -1 while nothing is due, -2 when they differ
+int32_t Play(uint32_t now){
+  int32_t out[LIGHT_CHANNEL_COUNT];
+  if (!JitterPlayout(jb, now, out, 255)) return -1;
+  for (uint8_t c = 1; c < LIGHT_CHANNEL_COUNT; c++) {
+    if (out[c] != out[0]) return -2;
+  }
+  return out[0];
+}
+
+uint32_t Due(uint32_t n){
+  return START + n * INTERVAL + DELAY;
+}
+
+void test_steady_stream(){
+  for (uint8_t n = 0; n < 4; n++) Push(n, n, n * 40);
+
+  TEST_ASSERT_EQUAL(4, jb.count);
+  TEST_ASSERT_EQUAL(INTERVAL, jb.interval);
+  for (uint8_t n = 0; n < 4; n++) TEST_ASSERT_EQUAL(Due(n), jb.frames[n].due);
+
+  //  Nothing before the playout delay
+  TEST_ASSERT_EQUAL(-1, Play(Due(0) - 1));
+  TEST_ASSERT_EQUAL(0, Play(Due(0)));
+  TEST_ASSERT_EQUAL(40, Play(Due(1)));
+  TEST_ASSERT_EQUAL(0, jb.underruns);
+}
+
+void test_interpolation(){
+  Push(0, 0, 0);
+  Push(1, 1, 200);
+  Push(2, 2, 100);
+
+  TEST_ASSERT_EQUAL(50, Play(Due(0) + INTERVAL / 4));
+  TEST_ASSERT_EQUAL(100, Play(Due(0) + INTERVAL / 2));
+  TEST_ASSERT_EQUAL(150, Play(Due(0) + INTERVAL * 3 / 4));
+  TEST_ASSERT_EQUAL(200, Play(Due(1)));
+
+  //  Down again towards the next frame
+  TEST_ASSERT_EQUAL(150, Play(Due(1) + INTERVAL / 2));
+}
+
+void test_interpolation_full_scale(){
+  int32_t out[LIGHT_CHANNEL_COUNT];
+  Push(0, 0, 0);
+  Push(1, 1, 255);
+
+  TEST_ASSERT_TRUE(JitterPlayout(jb, Due(0) + INTERVAL / 2, out, 1023));
+  TEST_ASSERT_INT_WITHIN(1, 512, out[0]);
+  TEST_ASSERT_TRUE(JitterPlayout(jb, Due(1), out, 1023));
+  TEST_ASSERT_EQUAL(1023, out[0]);
+}
+
+void test_reordered_frames(){
+  Push(0, 0, 0);
+  Push(1, 1, 10);
+  Push(2, 2, 20);
+  Push(4, 4, 40);
+  Push(3, 3, 30, 25000);        //  after 4, but before it is played
+
+  TEST_ASSERT_EQUAL(5, jb.count);
+  for (uint8_t i = 0; i < 5; i++) {
+    TEST_ASSERT_EQUAL(jb.frames[0].sequence + i, jb.frames[i].sequence);
+    TEST_ASSERT_EQUAL(Due(i), jb.frames[i].due);
+  }
+  TEST_ASSERT_EQUAL(0, jb.late);
+
+  //  The ramp plays out without going back
+  int32_t last = -1;
+  for (uint32_t t = Due(0); t <= Due(4); t += INTERVAL / 4) {
+    int32_t v = Play(t);
+    TEST_ASSERT_TRUE(v >= last);
+    last = v;
+  }
+  TEST_ASSERT_EQUAL(40, last);
+}
+
+void test_duplicate_frame(){
+  Push(0, 0, 0);
+  Push(1, 1, 10);
+  Push(1, 1, 99, 5000);
+
+  TEST_ASSERT_EQUAL(2, jb.count);
+  TEST_ASSERT_EQUAL(10, jb.frames[1].values[0]);
+}
+
+void test_late_frame(){
+  Push(0, 0, 0);
+  Push(1, 1, 10);
+  Push(2, 2, 20);
+  Push(4, 4, 40);
+
+  //  Frame 3 is still missing when 4 is played
+  TEST_ASSERT_EQUAL(40, Play(Due(4)));
+  Push(3, 3, 30, 2 * INTERVAL + DELAY);
+
+  TEST_ASSERT_EQUAL(1, jb.late);
+  TEST_ASSERT_EQUAL(1, jb.count);
+  TEST_ASSERT_EQUAL(40, jb.frames[0].values[0]);
+
+  //  A frame already played is late as well
+  Push(4, 4, 40, INTERVAL);
+  TEST_ASSERT_EQUAL(2, jb.late);
+}
+
+void test_missing_frame_interpolates_across(){
+  Push(0, 0, 0);
+  Push(1, 1, 10);
+  Push(3, 3, 30);
+
+  //  Frame 2 never comes: the gap is bridged from 1 to 3
+  TEST_ASSERT_EQUAL(20, Play(Due(2)));
+}
+
+void test_underrun(){
+  Push(0, 0, 0);
+  Push(1, 1, 100);
+
+  TEST_ASSERT_EQUAL(50, Play(Due(0) + INTERVAL / 2));
+  TEST_ASSERT_EQUAL(0, jb.underruns);
+
+  //  The last frame is held, and the underrun counted once
+  TEST_ASSERT_EQUAL(100, Play(Due(1)));
+  TEST_ASSERT_EQUAL(100, Play(Due(1) + 5 * INTERVAL));
+  TEST_ASSERT_EQUAL(1, jb.underruns);
+  TEST_ASSERT_TRUE(jb.underrun);
+
+  //  The stream comes back, a second underrun is counted when it stops again
+  Push(7, 7, 70);
+  Push(8, 8, 80);
+  TEST_ASSERT_EQUAL(75, Play(Due(7) + INTERVAL / 2));
+  TEST_ASSERT_FALSE(jb.underrun);
+  Play(Due(8));
+  TEST_ASSERT_EQUAL(2, jb.underruns);
+}
+
+void test_overflow(){
+  for (uint8_t n = 0; n < JITTER_BUFFER_SIZE + 2; n++) Push(n, n, n);
+
+  TEST_ASSERT_EQUAL(JITTER_BUFFER_SIZE, jb.count);
+  TEST_ASSERT_EQUAL(2, jb.overflows);
+  TEST_ASSERT_EQUAL(2, jb.frames[0].values[0]);
+  TEST_ASSERT_EQUAL(JITTER_BUFFER_SIZE + 1, jb.frames[JITTER_BUFFER_SIZE - 1].values[0]);
+
+  //  Older than everything in a full buffer
+  jb.played = 0;
+  Push(1, 1, 1, INTERVAL * JITTER_BUFFER_SIZE);
+  TEST_ASSERT_EQUAL(3, jb.overflows);
+  TEST_ASSERT_EQUAL(2, jb.frames[0].values[0]);
+}
+
+void test_sequence_wrap(){
+  for (uint32_t n = 0; n < 12; n++) {
+    Push((uint8_t)(250 + n), n, n * 10);
+    if (n >= 3) Play(Due(n - 3));
+  }
+
+  for (uint8_t i = 1; i < jb.count; i++) TEST_ASSERT_EQUAL(jb.frames[i - 1].sequence + 1, jb.frames[i].sequence);
+  TEST_ASSERT_EQUAL(0, jb.late);
+  TEST_ASSERT_EQUAL(0, jb.overflows);
+  TEST_ASSERT_EQUAL(INTERVAL, jb.interval);
+  TEST_ASSERT_EQUAL(105, Play(Due(10) + INTERVAL / 2));
+}
+
+//  Art-Net goes from 255 to 1, without a frame in between
+void test_artnet_sequence_wrap(){
+  uint8_t values[LIGHT_CHANNEL_COUNT];
+  uint8_t sequence = 250;
+  for (uint32_t n = 0; n < 8; n++) {
+    memset(values, n * 10, sizeof(values));
+    JitterPush(jb, true, sequence, true, START + n * INTERVAL, values, DELAY);
+    sequence = sequence == 255 ? 1 : sequence + 1;
+  }
+
+  TEST_ASSERT_EQUAL(8, jb.count);
+  for (uint8_t i = 0; i < jb.count; i++) {
+    TEST_ASSERT_EQUAL(jb.frames[0].sequence + i, jb.frames[i].sequence);
+    TEST_ASSERT_EQUAL(Due(i), jb.frames[i].due);
+  }
+  TEST_ASSERT_EQUAL(INTERVAL, jb.interval);
+  TEST_ASSERT_EQUAL(55, Play(Due(5) + INTERVAL / 2));
+}
+
+void test_sequence_distance(){
+  TEST_ASSERT_EQUAL(1, SequenceDistance(255, 0, false));
+  TEST_ASSERT_EQUAL(2, SequenceDistance(255, 1, false));
+  TEST_ASSERT_EQUAL(-1, SequenceDistance(0, 255, false));
+  TEST_ASSERT_EQUAL(1, SequenceDistance(255, 1, true));
+  TEST_ASSERT_EQUAL(-1, SequenceDistance(1, 255, true));
+  TEST_ASSERT_EQUAL(3, SequenceDistance(254, 2, true));
+  TEST_ASSERT_EQUAL(1, SequenceDistance(7, 8, true));
+  TEST_ASSERT_EQUAL(-19, SequenceDistance(10, 246, true));
+}
+
+void test_unsequenced_frames(){
+  uint8_t values[LIGHT_CHANNEL_COUNT];
+  for (uint32_t n = 0; n < 4; n++) {
+    memset(values, n * 10, sizeof(values));
+    JitterPush(jb, false, 0, false, START + n * INTERVAL, values, DELAY);
+  }
+
+  TEST_ASSERT_EQUAL(4, jb.count);
+  TEST_ASSERT_EQUAL(15, Play(Due(1) + INTERVAL / 2));
+}
+
+//  Arrivals up to 15 ms late are smoothed out by the 50 ms delay
+void test_jittered_arrivals(){
+  static const uint32_t lag[] = { 0, 12000, 3000, 15000, 1000, 9000, 0, 14000, 6000, 2000, 11000, 4000 };
+  uint8_t count = sizeof(lag) / sizeof(lag[0]);
+
+  int32_t last = -1;
+  for (uint8_t n = 0; n < count; n++) {
+    Push(n, n, n * 20, lag[n]);
+    if (n >= 2) {
+      for (uint32_t t = Due(n - 2); t < Due(n - 1); t += INTERVAL / 4) {
+        int32_t v = Play(t);
+        TEST_ASSERT_TRUE(v >= last);
+        last = v;
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL(0, jb.underruns);
+  TEST_ASSERT_EQUAL(0, jb.late);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_stream);
+  RUN_TEST(test_interpolation);
+  RUN_TEST(test_interpolation_full_scale);
+  RUN_TEST(test_reordered_frames);
+  RUN_TEST(test_duplicate_frame);
+  RUN_TEST(test_late_frame);
+  RUN_TEST(test_missing_frame_interpolates_across);
+  RUN_TEST(test_underrun);
+  RUN_TEST(test_overflow);
+  RUN_TEST(test_sequence_wrap);
+  RUN_TEST(test_artnet_sequence_wrap);
+  RUN_TEST(test_sequence_distance);
+  RUN_TEST(test_unsequenced_frames);
+  RUN_TEST(test_jittered_arrivals);
+  return UNITY_END();
+}
@@ -0,0 +1,78 @@
+/*
+    Host tests of the WS2812/SK6812 bit stream encoder in pixelencoder.h
+
+    pio test -e native -f test_pixelencoder
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "board.h"
+#include "pixelencoder.h"
+
+#define I2S_ONE 0b1110
+#define I2S_ZERO 0b1000
+
+void setUp(){}
+void tearDown(){}
+
+//  The data byte of a DMA word, -1 if any four bit group is not a valid data bit
+int DecodePixelWord(uint32_t word){
+  int b = 0;
+  for (int8_t shift = 28; shift >= 0; shift -= 4) {
+    uint8_t bits = (word >> shift) & 0x0F;
+    if (bits != I2S_ONE && bits != I2S_ZERO) return -1;
+    b = (b << 1) | (bits == I2S_ONE);
+  }
+  return b;
+}
+
+void test_known_bytes(){
+  TEST_ASSERT_EQUAL_HEX32(0x88888888, EncodePixelByte(0x00));
+  TEST_ASSERT_EQUAL_HEX32(0xEEEEEEEE, EncodePixelByte(0xFF));
+  TEST_ASSERT_EQUAL_HEX32(0xE8888888, EncodePixelByte(0x80));    //  most significant bit first
+  TEST_ASSERT_EQUAL_HEX32(0x8888888E, EncodePixelByte(0x01));
+  TEST_ASSERT_EQUAL_HEX32(0xE8E8E8E8, EncodePixelByte(0xAA));
+}
+
+//  Every byte encodes to four I2S bits per data bit and back to itself
+void test_every_byte_round_trips(){
+  for (uint16_t b = 0; b < 256; b++) TEST_ASSERT_EQUAL(b, DecodePixelWord(EncodePixelByte(b)));
+}
+
+//  A one is high for three quarters of the bit, a zero for one quarter, always starting high
+void test_duty_cycle(){
+  for (uint16_t b = 0; b < 256; b++) {
+    uint32_t word = EncodePixelByte(b);
+    TEST_ASSERT_EQUAL(8 + 2 * __builtin_popcount(b), __builtin_popcount(word));
+    for (int8_t shift = 28; shift >= 0; shift -= 4) TEST_ASSERT_TRUE((word >> shift) & 0x08);
+  }
+}
+
+void test_strip_channel_order(){
+  uint8_t pixels[3][LIGHT_CHANNEL_COUNT];
+  for (uint8_t i = 0; i < 3; i++)
+    for (uint8_t c = 0; c < LIGHT_CHANNEL_COUNT; c++) pixels[i][c] = 0x10 * (i + 1) + c;
+
+  uint32_t out[3 * LIGHT_CHANNEL_COUNT + 1];
+  out[3 * LIGHT_CHANNEL_COUNT] = 0x12345678;
+  EncodePixels(pixels, 3, out);
+
+  for (uint8_t i = 0; i < 3; i++) {
+    const uint32_t* p = out + i * LIGHT_CHANNEL_COUNT;
+    TEST_ASSERT_EQUAL(pixels[i][1], DecodePixelWord(p[0]));    //  green first
+    TEST_ASSERT_EQUAL(pixels[i][0], DecodePixelWord(p[1]));
+    for (uint8_t c = 2; c < LIGHT_CHANNEL_COUNT; c++) TEST_ASSERT_EQUAL(pixels[i][c], DecodePixelWord(p[c]));
+  }
+
+  //  Nothing is written past the last pixel
+  TEST_ASSERT_EQUAL_HEX32(0x12345678, out[3 * LIGHT_CHANNEL_COUNT]);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_known_bytes);
+  RUN_TEST(test_every_byte_round_trips);
+  RUN_TEST(test_duty_cycle);
+  RUN_TEST(test_strip_channel_order);
+  return UNITY_END();
+}
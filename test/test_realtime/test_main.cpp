@@ -0,0 +1,348 @@
+/*
+    Host tests of the E1.31 and Art-Net parsers and the receive path in
+    realtime.h. The packets are built here byte by byte after the
+    standards (ANSI E1.31-2018 section 4.1, Art-Net 4 ArtDmx) and handed
+    to the receive callback in a pbuf, as lwIP would.
+
+    tools/realtime_sender.py sends the same packets to a node over the
+    network.
+
+    pio test -e native -f test_realtime
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "board.h"
+#include "realtime.h"
+
+uint8_t packet[E131_DATA_OFFSET + DMX_SLOTS + 16];
+
+void setUp(){
+  memset(&realtime, 0, sizeof(realtime));
+  RealtimeBegin(1, 1, 0);
+}
+
+void tearDown(){
+  RealtimeEnd();
+}
+
+void WriteBigEndian16(uint8_t* p, uint16_t v){
+  p[0] = v >> 8;
+  p[1] = v & 0xFF;
+}
+
+//  An E1.31 data packet with slots DMX slots, slot n holding n & 0xFF. Returns its length.
+uint16_t BuildE131(uint16_t universe, uint8_t sequence, uint16_t slots, uint8_t options = 0){
+  static const uint8_t identifier[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+  uint16_t length = E131_DATA_OFFSET + slots;
+  memset(packet, 0, sizeof(packet));
+
+  WriteBigEndian16(packet, 0x0010);                        //  preamble size
+  memcpy(packet + 4, identifier, sizeof(identifier));
+  WriteBigEndian16(packet + 16, 0x7000 | (length - 16));   //  root layer
+  packet[21] = 0x04;
+  WriteBigEndian16(packet + 38, 0x7000 | (length - 38));   //  framing layer
+  packet[43] = 0x02;
+  strcpy((char*)packet + 44, "test_realtime");
+  packet[108] = 100;                                       //  priority
+  packet[111] = sequence;
+  packet[112] = options;
+  WriteBigEndian16(packet + 113, universe);
+  WriteBigEndian16(packet + 115, 0x7000 | (length - 115)); //  DMP layer
+  packet[117] = 0x02;
+  packet[118] = 0xA1;
+  WriteBigEndian16(packet + 121, 1);                       //  address increment
+  WriteBigEndian16(packet + 123, slots + 1);               //  property count, with the start code
+  packet[125] = 0;                                         //  start code
+  for (uint16_t i = 0; i < slots; i++) packet[E131_DATA_OFFSET + i] = (i + 1) & 0xFF;
+  return length;
+}
+
+//  An ArtDmx packet for the 15 bit port address, slot n holding n & 0xFF. Returns its length.
+uint16_t BuildArtNet(uint16_t portAddress, uint8_t sequence, uint16_t slots){
+  memset(packet, 0, sizeof(packet));
+
+  memcpy(packet, "Art-Net", 8);
+  packet[8] = ARTNET_OPCODE_DMX & 0xFF;                    //  opcode, little endian
+  packet[9] = ARTNET_OPCODE_DMX >> 8;
+  WriteBigEndian16(packet + 10, 14);                       //  protocol version
+  packet[12] = sequence;
+  packet[14] = portAddress & 0xFF;                         //  Sub-Net and Universe
+  packet[15] = portAddress >> 8;                           //  Net
+  WriteBigEndian16(packet + 16, slots);
+  for (uint16_t i = 0; i < slots; i++) packet[ARTNET_DATA_OFFSET + i] = (i + 1) & 0xFF;
+  return ARTNET_DATA_OFFSET + slots;
+}
+
+//  Hands the packet to the receive callback of a port as lwIP would
+void Receive(udp_pcb* pcb, uint16_t length, bool chained = false){
+  pbuf next = { NULL, packet + length / 2, (u16_t)(length - length / 2), (u16_t)(length - length / 2) };
+  pbuf p = { chained ? &next : NULL, packet, length, (u16_t)(chained ? length / 2 : length) };
+  pcb->recv(pcb->arg, pcb, &p, IP_ADDR_ANY, pcb->port);
+}
+
+void test_e131_full_universe(){
+  dmxFrame frame;
+  uint16_t length = BuildE131(7, 42, DMX_SLOTS);
+
+  TEST_ASSERT_TRUE(ParseE131(packet, length, frame));
+  TEST_ASSERT_EQUAL(7, frame.universe);
+  TEST_ASSERT_TRUE(frame.sequenced);
+  TEST_ASSERT_EQUAL(42, frame.sequence);
+  TEST_ASSERT_FALSE(frame.terminated);
+  TEST_ASSERT_EQUAL(DMX_SLOTS, frame.length);
+  TEST_ASSERT_TRUE(frame.data == packet + E131_DATA_OFFSET);     //  in place, not copied
+  TEST_ASSERT_EQUAL(1, frame.data[0]);
+}
+
+void test_e131_short_frame(){
+  dmxFrame frame;
+  uint16_t length = BuildE131(1, 0, 3);
+  TEST_ASSERT_TRUE(ParseE131(packet, length, frame));
+  TEST_ASSERT_EQUAL(3, frame.length);
+}
+
+void test_e131_truncated(){
+  dmxFrame frame;
+  uint16_t length = BuildE131(1, 0, DMX_SLOTS);
+
+  //  Cut anywhere: in the headers, or short of the slots it announces
+  for (uint16_t cut = 0; cut < length; cut++) TEST_ASSERT_FALSE(ParseE131(packet, cut, frame));
+}
+
+void test_e131_zero_slots(){
+  dmxFrame frame;
+
+  //  Only the start code
+  uint16_t length = BuildE131(1, 0, 0);
+  TEST_ASSERT_FALSE(ParseE131(packet, length, frame));
+
+  //  Not even that, the count must not wrap around to 65535 slots
+  WriteBigEndian16(packet + 123, 0);
+  TEST_ASSERT_FALSE(ParseE131(packet, length, frame));
+}
+
+void test_e131_too_many_slots(){
+  dmxFrame frame;
+  uint16_t length = BuildE131(1, 0, DMX_SLOTS);
+  WriteBigEndian16(packet + 123, DMX_SLOTS + 2);
+  TEST_ASSERT_FALSE(ParseE131(packet, length + 1, frame));
+}
+
+void test_e131_rejects_foreign_packets(){
+  dmxFrame frame;
+  uint16_t length;
+
+  length = BuildE131(1, 0, 16);
+  packet[4] = 'X';
+  TEST_ASSERT_FALSE(ParseE131(packet, length, frame));
+
+  length = BuildE131(1, 0, 16);
+  packet[21] = 0x08;                    //  extended (sync or discovery) packet
+  TEST_ASSERT_FALSE(ParseE131(packet, length, frame));
+
+  length = BuildE131(1, 0, 16);
+  packet[125] = 0xDD;                   //  not DMX levels
+  TEST_ASSERT_FALSE(ParseE131(packet, length, frame));
+
+  length = BuildE131(1, 0, 16, E131_OPTION_PREVIEW);
+  TEST_ASSERT_FALSE(ParseE131(packet, length, frame));
+}
+
+void test_e131_terminated(){
+  dmxFrame frame;
+  uint16_t length = BuildE131(1, 0, 16, E131_OPTION_TERMINATED);
+  TEST_ASSERT_TRUE(ParseE131(packet, length, frame));
+  TEST_ASSERT_TRUE(frame.terminated);
+}
+
+void test_artnet_frame(){
+  dmxFrame frame;
+  uint16_t length = BuildArtNet(0, 9, DMX_SLOTS);
+
+  TEST_ASSERT_TRUE(ParseArtNet(packet, length, frame));
+  TEST_ASSERT_EQUAL(1, frame.universe);           //  port address 0 is universe 1
+  TEST_ASSERT_TRUE(frame.sequenced);
+  TEST_ASSERT_EQUAL(9, frame.sequence);
+  TEST_ASSERT_EQUAL(DMX_SLOTS, frame.length);
+  TEST_ASSERT_TRUE(frame.data == packet + ARTNET_DATA_OFFSET);
+}
+
+void test_artnet_port_address(){
+  dmxFrame frame;
+
+  //  Net 1, Sub-Net 2, Universe 3
+  uint16_t length = BuildArtNet(0x0123, 1, 8);
+  TEST_ASSERT_TRUE(ParseArtNet(packet, length, frame));
+  TEST_ASSERT_EQUAL(0x0124, frame.universe);
+
+  //  The highest port address
+  length = BuildArtNet(0x7FFF, 1, 8);
+  TEST_ASSERT_TRUE(ParseArtNet(packet, length, frame));
+  TEST_ASSERT_EQUAL(0x8000, frame.universe);
+
+  //  The top bit of Net is not part of the port address
+  length = BuildArtNet(0x0005, 1, 8);
+  packet[15] = 0x80;
+  TEST_ASSERT_TRUE(ParseArtNet(packet, length, frame));
+  TEST_ASSERT_EQUAL(6, frame.universe);
+}
+
+void test_artnet_unsequenced(){
+  dmxFrame frame;
+  uint16_t length = BuildArtNet(0, 0, 8);
+  TEST_ASSERT_TRUE(ParseArtNet(packet, length, frame));
+  TEST_ASSERT_FALSE(frame.sequenced);
+}
+
+void test_artnet_truncated(){
+  dmxFrame frame;
+  uint16_t length = BuildArtNet(0, 1, DMX_SLOTS);
+  for (uint16_t cut = 0; cut < length; cut++) TEST_ASSERT_FALSE(ParseArtNet(packet, cut, frame));
+}
+
+void test_artnet_zero_slots(){
+  dmxFrame frame;
+  uint16_t length = BuildArtNet(0, 1, 0);
+  TEST_ASSERT_FALSE(ParseArtNet(packet, length, frame));
+  TEST_ASSERT_FALSE(ParseArtNet(packet, length + 8, frame));
+}
+
+void test_artnet_rejects_other_packets(){
+  dmxFrame frame;
+  uint16_t length;
+
+  length = BuildArtNet(0, 1, 8);
+  packet[9] = 0x20;                     //  ArtPoll
+  TEST_ASSERT_FALSE(ParseArtNet(packet, length, frame));
+
+  length = BuildArtNet(0, 1, 8);
+  WriteBigEndian16(packet + 10, 13);    //  protocol version
+  TEST_ASSERT_FALSE(ParseArtNet(packet, length, frame));
+
+  length = BuildArtNet(0, 1, 8);
+  packet[7] = 'x';
+  TEST_ASSERT_FALSE(ParseArtNet(packet, length, frame));
+}
+
+//  The channels of the board come from the slots at the start address on
+void test_receive_maps_start_address(){
+  RealtimeBegin(3, 10, 0);
+
+  Receive(realtime.e131, BuildE131(3, 1, DMX_SLOTS));
+  TEST_ASSERT_TRUE(realtime.fresh);
+  TEST_ASSERT_EQUAL(1, realtime.stats.frames);
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) TEST_ASSERT_EQUAL(10 + i, realtime.values[i]);
+
+  //  Slots past the end of a short frame are dark
+  RealtimeBegin(3, 2, 0);
+  Receive(realtime.artnet, BuildArtNet(2, 1, 2));
+  TEST_ASSERT_EQUAL(2, realtime.values[0]);
+  for (uint8_t i = 1; i < LIGHT_CHANNEL_COUNT; i++) TEST_ASSERT_EQUAL(0, realtime.values[i]);
+}
+
+void test_receive_other_universe(){
+  Receive(realtime.e131, BuildE131(2, 1, 16));
+  TEST_ASSERT_FALSE(realtime.fresh);
+  TEST_ASSERT_EQUAL(0, realtime.stats.frames);
+  TEST_ASSERT_EQUAL(0, realtime.stats.discarded);
+}
+
+void test_receive_discards_malformed(){
+  Receive(realtime.e131, BuildE131(1, 1, 16) - 1);
+  Receive(realtime.artnet, BuildArtNet(0, 1, 0));
+  Receive(realtime.e131, BuildE131(1, 1, 16), true);    //  chained pbuf
+  TEST_ASSERT_EQUAL(3, realtime.stats.discarded);
+  TEST_ASSERT_EQUAL(0, realtime.stats.frames);
+
+  //  An Art-Net packet on the E1.31 port is not E1.31
+  Receive(realtime.e131, BuildArtNet(0, 1, 16));
+  TEST_ASSERT_EQUAL(4, realtime.stats.discarded);
+}
+
+void test_receive_sequence(){
+  uint8_t sequences[] = { 250, 251, 253, 252, 254, 255, 0, 1 };
+  for (uint8_t i = 0; i < sizeof(sequences); i++) Receive(realtime.e131, BuildE131(1, sequences[i], 16));
+
+  //  253 skipped one and 252 came after it, out of order and discarded.
+  //  254 follows 253, the last one accepted.
+  TEST_ASSERT_EQUAL(7, realtime.stats.frames);
+  TEST_ASSERT_EQUAL(1, realtime.stats.discarded);
+  TEST_ASSERT_EQUAL(2, realtime.stats.sequenceErrors);
+  TEST_ASSERT_EQUAL(1, realtime.sequence);
+}
+
+//  Art-Net skips 0, which means unsequenced, when it wraps
+void test_receive_artnet_wrap(){
+  uint8_t sequences[] = { 253, 254, 255, 1, 2 };
+  for (uint8_t i = 0; i < sizeof(sequences); i++) Receive(realtime.artnet, BuildArtNet(0, sequences[i], 16));
+
+  TEST_ASSERT_EQUAL(5, realtime.stats.frames);
+  TEST_ASSERT_EQUAL(0, realtime.stats.sequenceErrors);
+
+  //  Behind across the wrap is still out of order
+  Receive(realtime.artnet, BuildArtNet(0, 255, 16));
+  TEST_ASSERT_EQUAL(1, realtime.stats.discarded);
+  TEST_ASSERT_EQUAL(2, realtime.sequence);
+}
+
+void test_receive_terminated(){
+  Receive(realtime.e131, BuildE131(1, 1, 16));
+  Receive(realtime.e131, BuildE131(1, 2, 16, E131_OPTION_TERMINATED));
+  TEST_ASSERT_TRUE(realtime.terminated);
+  TEST_ASSERT_EQUAL(1, realtime.stats.frames);
+}
+
+//  With a playout delay the latency of a frame is taken when it is played
+void test_playout_latency(){
+  int32_t out[LIGHT_CHANNEL_COUNT];
+  RealtimeBegin(1, 1, 50);
+  SetFakeMillis(1000);
+
+  for (uint8_t n = 0; n < 3; n++) {
+    Receive(realtime.e131, BuildE131(1, n, 16));
+    AdvanceFakeMicros(20000);
+  }
+  TEST_ASSERT_EQUAL(0, realtime.stats.latency);
+
+  //  Frame 0 came in at 1 s and is due 50 ms later
+  SetFakeMillis(1050);
+  TEST_ASSERT_TRUE(RealtimePlayout(micros(), out, 255));
+  TEST_ASSERT_EQUAL(50000, realtime.stats.latency);
+
+  //  Between two frames nothing new is shown
+  AdvanceFakeMicros(10000);
+  TEST_ASSERT_TRUE(RealtimePlayout(micros(), out, 255));
+  TEST_ASSERT_EQUAL(50000, realtime.stats.latency);
+
+  //  Frame 1 is played 5 ms late
+  AdvanceFakeMicros(15000);
+  TEST_ASSERT_TRUE(RealtimePlayout(micros(), out, 255));
+  TEST_ASSERT_EQUAL(55000, realtime.stats.latency);
+  TEST_ASSERT_EQUAL(55000, realtime.stats.latencyMax);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_e131_full_universe);
+  RUN_TEST(test_e131_short_frame);
+  RUN_TEST(test_e131_truncated);
+  RUN_TEST(test_e131_zero_slots);
+  RUN_TEST(test_e131_too_many_slots);
+  RUN_TEST(test_e131_rejects_foreign_packets);
+  RUN_TEST(test_e131_terminated);
+  RUN_TEST(test_artnet_frame);
+  RUN_TEST(test_artnet_port_address);
+  RUN_TEST(test_artnet_unsequenced);
+  RUN_TEST(test_artnet_truncated);
+  RUN_TEST(test_artnet_zero_slots);
+  RUN_TEST(test_artnet_rejects_other_packets);
+  RUN_TEST(test_receive_maps_start_address);
+  RUN_TEST(test_receive_other_universe);
+  RUN_TEST(test_receive_discards_malformed);
+  RUN_TEST(test_receive_sequence);
+  RUN_TEST(test_receive_artnet_wrap);
+  RUN_TEST(test_receive_terminated);
+  RUN_TEST(test_playout_latency);
+  return UNITY_END();
+}
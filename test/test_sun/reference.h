@@ -0,0 +1,375 @@
+//  Generated by tools/sun_reference.py 2026 37.9908997 23.70332, do not edit
+//  Seconds from UTC midnight: civil dawn, sunrise, solar noon, sunset, civil dusk
+
+#define SUN_REFERENCE_FIRST_DAY 1767225600L     //  2026-01-01, unix time
+#define SUN_REFERENCE_LATITUDE 37.9908997
+#define SUN_REFERENCE_LONGITUDE 23.70332
+#define SUN_REFERENCE_DAYS 365
+
+const int32_t SunReference[SUN_REFERENCE_DAYS][5] = {
+  {  18710,  20473,  37723,  54982,  56745 },
+  {  18720,  20481,  37751,  55030,  56791 },
+  {  18728,  20487,  37779,  55080,  56839 },
+  {  18734,  20491,  37806,  55131,  56889 },
+  {  18738,  20493,  37833,  55184,  56939 },
+  {  18741,  20493,  37860,  55237,  56990 },
+  {  18741,  20491,  37886,  55292,  57043 },
+  {  18739,  20487,  37911,  55348,  57096 },
+  {  18736,  20481,  37936,  55405,  57150 },
+  {  18730,  20472,  37961,  55463,  57206 },
+  {  18722,  20462,  37985,  55522,  57262 },
+  {  18713,  20449,  38008,  55582,  57318 },
+  {  18701,  20434,  38031,  55643,  57376 },
+  {  18688,  20418,  38053,  55704,  57434 },
+  {  18672,  20399,  38074,  55766,  57493 },
+  {  18655,  20378,  38095,  55829,  57553 },
+  {  18636,  20356,  38115,  55893,  57613 },
+  {  18614,  20331,  38135,  55957,  57674 },
+  {  18591,  20304,  38153,  56022,  57735 },
+  {  18566,  20275,  38171,  56087,  57796 },
+  {  18539,  20245,  38188,  56152,  57858 },
+  {  18510,  20212,  38205,  56218,  57921 },
+  {  18479,  20178,  38221,  56285,  57983 },
+  {  18447,  20141,  38235,  56351,  58046 },
+  {  18412,  20103,  38250,  56418,  58109 },
+  {  18376,  20063,  38263,  56485,  58173 },
+  {  18338,  20021,  38275,  56552,  58236 },
+  {  18298,  19978,  38287,  56620,  58300 },
+  {  18257,  19932,  38298,  56687,  58364 },
+  {  18213,  19885,  38308,  56755,  58428 },
+  {  18168,  19837,  38317,  56823,  58492 },
+  {  18122,  19786,  38326,  56890,  58556 },
+  {  18073,  19734,  38333,  56958,  58620 },
+  {  18023,  19680,  38340,  57026,  58684 },
+  {  17972,  19625,  38346,  57093,  58748 },
+  {  17918,  19568,  38351,  57161,  58811 },
+  {  17864,  19510,  38355,  57228,  58875 },
+  {  17807,  19450,  38359,  57295,  58939 },
+  {  17750,  19389,  38361,  57362,  59002 },
+  {  17690,  19326,  38363,  57429,  59066 },
+  {  17630,  19262,  38364,  57496,  59129 },
+  {  17568,  19197,  38365,  57562,  59192 },
+  {  17504,  19130,  38364,  57628,  59255 },
+  {  17440,  19062,  38363,  57694,  59318 },
+  {  17373,  18993,  38361,  57759,  59380 },
+  {  17306,  18923,  38358,  57825,  59443 },
+  {  17237,  18851,  38355,  57890,  59505 },
+  {  17168,  18779,  38351,  57954,  59567 },
+  {  17096,  18705,  38346,  58019,  59628 },
+  {  17024,  18630,  38340,  58083,  59690 },
+  {  16951,  18554,  38334,  58147,  59751 },
+  {  16876,  18477,  38327,  58210,  59812 },
+  {  16801,  18399,  38320,  58273,  59873 },
+  {  16724,  18320,  38312,  58336,  59933 },
+  {  16647,  18240,  38303,  58399,  59994 },
+  {  16568,  18160,  38294,  58461,  60054 },
+  {  16489,  18078,  38284,  58523,  60114 },
+  {  16409,  17996,  38273,  58584,  60173 },
+  {  16327,  17913,  38262,  58645,  60233 },
+  {  16245,  17829,  38251,  58706,  60292 },
+  {  16162,  17745,  38239,  58767,  60351 },
+  {  16079,  17660,  38226,  58827,  60410 },
+  {  15994,  17574,  38213,  58887,  60469 },
+  {  15909,  17487,  38200,  58947,  60527 },
+  {  15823,  17400,  38186,  59006,  60586 },
+  {  15737,  17313,  38171,  59066,  60644 },
+  {  15650,  17225,  38157,  59124,  60702 },
+  {  15562,  17136,  38142,  59183,  60760 },
+  {  15474,  17047,  38126,  59241,  60818 },
+  {  15385,  16958,  38111,  59300,  60875 },
+  {  15296,  16868,  38095,  59357,  60933 },
+  {  15206,  16778,  38078,  59415,  60990 },
+  {  15116,  16688,  38062,  59473,  61047 },
+  {  15025,  16597,  38045,  59530,  61105 },
+  {  14934,  16506,  38028,  59587,  61162 },
+  {  14843,  16415,  38011,  59644,  61219 },
+  {  14751,  16324,  37993,  59701,  61276 },
+  {  14659,  16232,  37976,  59757,  61333 },
+  {  14567,  16140,  37958,  59814,  61390 },
+  {  14474,  16049,  37940,  59870,  61447 },
+  {  14382,  15957,  37923,  59926,  61504 },
+  {  14289,  15865,  37905,  59982,  61561 },
+  {  14196,  15773,  37887,  60038,  61618 },
+  {  14103,  15681,  37868,  60094,  61675 },
+  {  14010,  15589,  37850,  60150,  61732 },
+  {  13917,  15497,  37832,  60205,  61790 },
+  {  13823,  15406,  37814,  60261,  61847 },
+  {  13730,  15314,  37796,  60316,  61904 },
+  {  13637,  15223,  37778,  60372,  61961 },
+  {  13544,  15131,  37760,  60427,  62019 },
+  {  13451,  15040,  37742,  60483,  62076 },
+  {  13358,  14950,  37725,  60538,  62134 },
+  {  13265,  14859,  37707,  60594,  62191 },
+  {  13173,  14769,  37690,  60649,  62249 },
+  {  13081,  14679,  37673,  60704,  62307 },
+  {  12989,  14590,  37656,  60760,  62365 },
+  {  12897,  14501,  37639,  60815,  62423 },
+  {  12805,  14412,  37622,  60871,  62482 },
+  {  12714,  14324,  37606,  60926,  62540 },
+  {  12624,  14236,  37590,  60982,  62599 },
+  {  12533,  14149,  37574,  61037,  62657 },
+  {  12443,  14062,  37558,  61093,  62716 },
+  {  12354,  13976,  37543,  61148,  62775 },
+  {  12265,  13891,  37528,  61204,  62834 },
+  {  12177,  13806,  37514,  61260,  62894 },
+  {  12089,  13722,  37499,  61315,  62953 },
+  {  12002,  13638,  37486,  61371,  63013 },
+  {  11915,  13555,  37472,  61427,  63072 },
+  {  11829,  13473,  37459,  61483,  63132 },
+  {  11744,  13392,  37446,  61539,  63192 },
+  {  11659,  13312,  37434,  61594,  63252 },
+  {  11575,  13232,  37422,  61650,  63312 },
+  {  11492,  13153,  37411,  61706,  63373 },
+  {  11410,  13076,  37400,  61762,  63433 },
+  {  11329,  12999,  37390,  61818,  63493 },
+  {  11248,  12923,  37380,  61874,  63554 },
+  {  11169,  12848,  37370,  61930,  63614 },
+  {  11090,  12774,  37362,  61986,  63675 },
+  {  11013,  12701,  37353,  62042,  63735 },
+  {  10936,  12629,  37345,  62097,  63796 },
+  {  10861,  12559,  37338,  62153,  63857 },
+  {  10786,  12489,  37331,  62209,  63917 },
+  {  10713,  12421,  37325,  62264,  63978 },
+  {  10641,  12354,  37319,  62320,  64038 },
+  {  10570,  12288,  37314,  62375,  64098 },
+  {  10500,  12223,  37309,  62430,  64159 },
+  {  10432,  12160,  37305,  62485,  64219 },
+  {  10364,  12098,  37302,  62540,  64278 },
+  {  10298,  12037,  37299,  62594,  64338 },
+  {  10234,  11977,  37296,  62648,  64398 },
+  {  10171,  11919,  37295,  62702,  64457 },
+  {  10109,  11863,  37293,  62756,  64516 },
+  {  10049,  11808,  37293,  62810,  64574 },
+  {   9990,  11754,  37293,  62863,  64632 },
+  {   9933,  11702,  37293,  62915,  64690 },
+  {   9877,  11651,  37294,  62967,  64747 },
+  {   9823,  11602,  37296,  63019,  64804 },
+  {   9770,  11555,  37298,  63071,  64860 },
+  {   9719,  11509,  37301,  63121,  64916 },
+  {   9670,  11465,  37304,  63172,  64971 },
+  {   9622,  11422,  37308,  63221,  65026 },
+  {   9577,  11381,  37312,  63270,  65080 },
+  {   9532,  11342,  37317,  63319,  65133 },
+  {   9490,  11304,  37323,  63367,  65185 },
+  {   9450,  11268,  37328,  63414,  65237 },
+  {   9411,  11234,  37335,  63460,  65287 },
+  {   9374,  11201,  37342,  63505,  65337 },
+  {   9339,  11171,  37349,  63550,  65386 },
+  {   9306,  11142,  37357,  63594,  65434 },
+  {   9274,  11114,  37365,  63636,  65481 },
+  {   9245,  11089,  37374,  63678,  65526 },
+  {   9217,  11065,  37383,  63719,  65571 },
+  {   9192,  11044,  37392,  63759,  65614 },
+  {   9168,  11024,  37402,  63798,  65656 },
+  {   9147,  11005,  37412,  63835,  65697 },
+  {   9127,  10989,  37423,  63872,  65737 },
+  {   9109,  10974,  37433,  63907,  65775 },
+  {   9094,  10962,  37444,  63941,  65812 },
+  {   9080,  10951,  37456,  63974,  65847 },
+  {   9068,  10942,  37468,  64005,  65881 },
+  {   9059,  10934,  37479,  64035,  65913 },
+  {   9051,  10929,  37492,  64064,  65944 },
+  {   9045,  10925,  37504,  64091,  65973 },
+  {   9041,  10923,  37516,  64117,  66001 },
+  {   9040,  10923,  37529,  64142,  66027 },
+  {   9040,  10925,  37542,  64165,  66051 },
+  {   9042,  10928,  37555,  64186,  66073 },
+  {   9046,  10933,  37568,  64206,  66094 },
+  {   9052,  10940,  37581,  64224,  66113 },
+  {   9060,  10949,  37594,  64241,  66130 },
+  {   9070,  10959,  37607,  64255,  66145 },
+  {   9082,  10971,  37620,  64269,  66158 },
+  {   9095,  10984,  37633,  64280,  66169 },
+  {   9110,  10999,  37646,  64290,  66179 },
+  {   9128,  11016,  37659,  64298,  66186 },
+  {   9146,  11034,  37671,  64304,  66192 },
+  {   9167,  11054,  37684,  64309,  66195 },
+  {   9189,  11076,  37697,  64312,  66196 },
+  {   9213,  11098,  37709,  64313,  66196 },
+  {   9239,  11122,  37721,  64312,  66193 },
+  {   9266,  11148,  37733,  64309,  66189 },
+  {   9295,  11175,  37745,  64304,  66182 },
+  {   9326,  11203,  37756,  64298,  66173 },
+  {   9357,  11233,  37767,  64290,  66163 },
+  {   9391,  11264,  37778,  64280,  66150 },
+  {   9425,  11296,  37789,  64268,  66135 },
+  {   9461,  11329,  37799,  64254,  66118 },
+  {   9499,  11363,  37809,  64238,  66100 },
+  {   9537,  11399,  37818,  64221,  66079 },
+  {   9577,  11435,  37827,  64201,  66056 },
+  {   9618,  11473,  37836,  64180,  66031 },
+  {   9660,  11512,  37844,  64157,  66004 },
+  {   9704,  11551,  37851,  64132,  65975 },
+  {   9748,  11592,  37859,  64105,  65945 },
+  {   9793,  11633,  37866,  64076,  65912 },
+  {   9840,  11675,  37872,  64046,  65877 },
+  {   9887,  11718,  37878,  64014,  65841 },
+  {   9935,  11762,  37883,  63980,  65803 },
+  {   9984,  11806,  37888,  63944,  65762 },
+  {  10033,  11851,  37892,  63907,  65720 },
+  {  10084,  11897,  37895,  63868,  65676 },
+  {  10135,  11944,  37898,  63827,  65631 },
+  {  10186,  11991,  37901,  63784,  65583 },
+  {  10239,  12038,  37903,  63740,  65534 },
+  {  10292,  12086,  37904,  63694,  65483 },
+  {  10345,  12134,  37905,  63646,  65431 },
+  {  10399,  12183,  37905,  63597,  65377 },
+  {  10453,  12233,  37905,  63546,  65321 },
+  {  10508,  12282,  37903,  63494,  65263 },
+  {  10563,  12332,  37902,  63440,  65204 },
+  {  10618,  12383,  37900,  63385,  65144 },
+  {  10674,  12433,  37897,  63328,  65082 },
+  {  10730,  12484,  37893,  63270,  65019 },
+  {  10786,  12535,  37889,  63210,  64954 },
+  {  10843,  12587,  37884,  63149,  64888 },
+  {  10899,  12638,  37879,  63087,  64820 },
+  {  10956,  12690,  37873,  63023,  64751 },
+  {  11013,  12742,  37867,  62958,  64681 },
+  {  11070,  12794,  37860,  62891,  64610 },
+  {  11127,  12846,  37852,  62823,  64537 },
+  {  11184,  12898,  37844,  62754,  64463 },
+  {  11241,  12950,  37835,  62684,  64388 },
+  {  11298,  13002,  37825,  62613,  64312 },
+  {  11355,  13054,  37815,  62540,  64234 },
+  {  11412,  13107,  37805,  62467,  64156 },
+  {  11469,  13159,  37794,  62392,  64077 },
+  {  11526,  13211,  37782,  62317,  63996 },
+  {  11583,  13263,  37770,  62240,  63915 },
+  {  11639,  13316,  37757,  62162,  63833 },
+  {  11696,  13368,  37744,  62083,  63750 },
+  {  11753,  13420,  37730,  62004,  63666 },
+  {  11809,  13472,  37716,  61923,  63581 },
+  {  11865,  13524,  37702,  61842,  63495 },
+  {  11921,  13576,  37687,  61759,  63409 },
+  {  11977,  13628,  37671,  61676,  63322 },
+  {  12033,  13680,  37655,  61592,  63234 },
+  {  12089,  13732,  37639,  61508,  63146 },
+  {  12145,  13783,  37622,  61422,  63057 },
+  {  12200,  13835,  37605,  61336,  62967 },
+  {  12255,  13887,  37587,  61250,  62877 },
+  {  12310,  13938,  37569,  61162,  62786 },
+  {  12365,  13990,  37551,  61074,  62695 },
+  {  12420,  14041,  37533,  60986,  62603 },
+  {  12474,  14093,  37514,  60897,  62510 },
+  {  12529,  14144,  37494,  60807,  62418 },
+  {  12583,  14195,  37475,  60717,  62325 },
+  {  12637,  14246,  37455,  60626,  62231 },
+  {  12691,  14297,  37435,  60535,  62138 },
+  {  12745,  14349,  37415,  60444,  62044 },
+  {  12798,  14400,  37395,  60352,  61949 },
+  {  12852,  14451,  37374,  60260,  61855 },
+  {  12905,  14502,  37354,  60167,  61760 },
+  {  12958,  14553,  37333,  60075,  61665 },
+  {  13011,  14604,  37312,  59982,  61570 },
+  {  13065,  14655,  37291,  59888,  61475 },
+  {  13117,  14706,  37269,  59795,  61380 },
+  {  13170,  14757,  37248,  59701,  61284 },
+  {  13223,  14808,  37227,  59607,  61189 },
+  {  13276,  14859,  37205,  59514,  61094 },
+  {  13328,  14911,  37184,  59420,  60998 },
+  {  13381,  14962,  37162,  59325,  60903 },
+  {  13434,  15013,  37141,  59231,  60808 },
+  {  13486,  15065,  37120,  59137,  60713 },
+  {  13539,  15116,  37098,  59043,  60618 },
+  {  13591,  15168,  37077,  58949,  60523 },
+  {  13644,  15220,  37056,  58855,  60428 },
+  {  13696,  15272,  37035,  58761,  60334 },
+  {  13749,  15324,  37014,  58667,  60240 },
+  {  13801,  15376,  36993,  58574,  60146 },
+  {  13854,  15429,  36973,  58481,  60053 },
+  {  13907,  15481,  36952,  58387,  59960 },
+  {  13959,  15534,  36932,  58295,  59867 },
+  {  14012,  15587,  36913,  58202,  59774 },
+  {  14065,  15640,  36893,  58110,  59682 },
+  {  14118,  15694,  36874,  58018,  59591 },
+  {  14171,  15747,  36855,  57926,  59500 },
+  {  14225,  15801,  36836,  57835,  59409 },
+  {  14278,  15856,  36818,  57744,  59320 },
+  {  14332,  15910,  36800,  57654,  59230 },
+  {  14385,  15965,  36782,  57564,  59142 },
+  {  14439,  16020,  36765,  57475,  59053 },
+  {  14494,  16075,  36748,  57387,  58966 },
+  {  14548,  16131,  36732,  57298,  58879 },
+  {  14602,  16187,  36716,  57211,  58793 },
+  {  14657,  16243,  36700,  57124,  58708 },
+  {  14712,  16299,  36686,  57038,  58624 },
+  {  14767,  16356,  36671,  56953,  58540 },
+  {  14823,  16413,  36658,  56868,  58458 },
+  {  14878,  16471,  36644,  56785,  58376 },
+  {  14934,  16529,  36632,  56702,  58295 },
+  {  14990,  16587,  36620,  56620,  58215 },
+  {  15047,  16646,  36608,  56538,  58136 },
+  {  15103,  16705,  36597,  56458,  58058 },
+  {  15160,  16764,  36587,  56379,  57981 },
+  {  15217,  16824,  36578,  56300,  57906 },
+  {  15275,  16884,  36569,  56223,  57831 },
+  {  15332,  16944,  36561,  56147,  57757 },
+  {  15390,  17005,  36554,  56072,  57685 },
+  {  15448,  17066,  36547,  55998,  57614 },
+  {  15507,  17127,  36541,  55925,  57544 },
+  {  15565,  17189,  36536,  55853,  57476 },
+  {  15624,  17251,  36532,  55783,  57408 },
+  {  15684,  17313,  36528,  55714,  57342 },
+  {  15743,  17375,  36525,  55646,  57278 },
+  {  15803,  17438,  36523,  55580,  57215 },
+  {  15862,  17501,  36522,  55514,  57153 },
+  {  15922,  17565,  36522,  55451,  57092 },
+  {  15982,  17628,  36522,  55388,  57034 },
+  {  16043,  17692,  36523,  55328,  56976 },
+  {  16103,  17756,  36526,  55268,  56921 },
+  {  16164,  17820,  36529,  55211,  56866 },
+  {  16225,  17885,  36533,  55154,  56814 },
+  {  16286,  17949,  36537,  55100,  56763 },
+  {  16346,  18014,  36543,  55047,  56714 },
+  {  16407,  18078,  36549,  54995,  56666 },
+  {  16468,  18143,  36557,  54946,  56620 },
+  {  16529,  18208,  36565,  54898,  56576 },
+  {  16590,  18272,  36574,  54852,  56534 },
+  {  16651,  18337,  36584,  54807,  56493 },
+  {  16712,  18401,  36594,  54765,  56454 },
+  {  16773,  18466,  36606,  54724,  56417 },
+  {  16833,  18530,  36618,  54685,  56382 },
+  {  16893,  18594,  36632,  54648,  56349 },
+  {  16954,  18658,  36646,  54613,  56317 },
+  {  17013,  18721,  36661,  54580,  56288 },
+  {  17073,  18784,  36676,  54549,  56260 },
+  {  17132,  18847,  36693,  54520,  56234 },
+  {  17191,  18909,  36710,  54492,  56211 },
+  {  17249,  18971,  36728,  54467,  56189 },
+  {  17307,  19032,  36747,  54444,  56169 },
+  {  17365,  19093,  36766,  54423,  56151 },
+  {  17422,  19153,  36786,  54404,  56135 },
+  {  17478,  19212,  36807,  54387,  56121 },
+  {  17533,  19271,  36829,  54372,  56110 },
+  {  17588,  19329,  36851,  54359,  56100 },
+  {  17643,  19386,  36874,  54349,  56092 },
+  {  17696,  19442,  36898,  54340,  56086 },
+  {  17749,  19498,  36922,  54333,  56082 },
+  {  17800,  19552,  36946,  54329,  56080 },
+  {  17851,  19605,  36971,  54327,  56080 },
+  {  17901,  19657,  36997,  54327,  56083 },
+  {  17950,  19708,  37023,  54329,  56087 },
+  {  17998,  19758,  37050,  54333,  56093 },
+  {  18045,  19807,  37077,  54339,  56101 },
+  {  18090,  19854,  37104,  54347,  56111 },
+  {  18134,  19900,  37132,  54358,  56123 },
+  {  18177,  19944,  37160,  54370,  56137 },
+  {  18219,  19987,  37189,  54385,  56153 },
+  {  18260,  20029,  37217,  54401,  56171 },
+  {  18299,  20069,  37246,  54420,  56190 },
+  {  18336,  20107,  37276,  54441,  56212 },
+  {  18373,  20144,  37305,  54463,  56235 },
+  {  18407,  20179,  37334,  54488,  56260 },
+  {  18441,  20213,  37364,  54514,  56287 },
+  {  18472,  20245,  37394,  54543,  56315 },
+  {  18502,  20275,  37424,  54573,  56345 },
+  {  18531,  20303,  37453,  54605,  56377 },
+  {  18557,  20329,  37483,  54639,  56411 },
+  {  18582,  20354,  37513,  54674,  56446 },
+  {  18605,  20376,  37542,  54712,  56483 },
+  {  18627,  20397,  37572,  54751,  56521 },
+  {  18647,  20416,  37601,  54792,  56561 },
+  {  18665,  20432,  37630,  54834,  56602 },
+  {  18681,  20447,  37659,  54878,  56644 },
+  {  18695,  20460,  37688,  54923,  56688 },
+};
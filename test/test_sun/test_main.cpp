@@ -0,0 +1,87 @@
+/*
+    Host test of the sun times in include/suntimes.h against reference
+    times of the full NOAA algorithm for every day of a year, see
+    tools/sun_reference.py
+
+    pio test -e native -f test_sun
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "defines.h"
+#include "board.h"
+#include "calibration.h"
+#include "structs.h"
+#include "suntimes.h"
+#include "reference.h"
+
+#define SUN_TOLERANCE 60          //  s
+
+const char* const EventNames[5] = { "civil dawn", "sunrise", "solar noon", "sunset", "civil dusk" };
+
+void setUp(){}
+void tearDown(){}
+
+void test_reference_is_for_the_configured_location(){
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, LATITUDE, SUN_REFERENCE_LATITUDE);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, LONGITUDE, SUN_REFERENCE_LONGITUDE);
+}
+
+void test_full_year(){
+  int32_t worst[5] = { 0 };
+
+  for (uint16_t day = 0; day < SUN_REFERENCE_DAYS; day++) {
+    time_t midnight = SUN_REFERENCE_FIRST_DAY + (time_t)day * SECS_PER_DAY;
+    sunData_t sun;
+
+    //  Any time of the day gives the times of that day
+    ComputeSunData(midnight + 12345, LATITUDE, LONGITUDE, sun);
+    TEST_ASSERT_EQUAL(elapsedDays(midnight), sun.Day);
+
+    time_t times[5] = { sun.CivilDawn, sun.Sunrise, sun.SolarNoon, sun.Sunset, sun.CivilDusk };
+    for (uint8_t e = 0; e < 5; e++) {
+      int32_t error = (int32_t)(times[e] - midnight) - SunReference[day][e];
+      if (abs(error) > abs(worst[e])) worst[e] = error;
+
+      char message[64];
+      snprintf(message, sizeof(message), "%s of day %u", EventNames[e], day + 1);
+      TEST_ASSERT_INT_WITHIN_MESSAGE(SUN_TOLERANCE, SunReference[day][e], times[e] - midnight, message);
+    }
+  }
+
+  for (uint8_t e = 0; e < 5; e++) {
+    char line[64];
+    snprintf(line, sizeof(line), "%s: worst error %ld s", EventNames[e], (long)worst[e]);
+    TEST_MESSAGE(line);
+  }
+}
+
+void test_events_in_order(){
+  for (uint16_t day = 0; day < SUN_REFERENCE_DAYS; day++) {
+    sunData_t sun;
+    ComputeSunData(SUN_REFERENCE_FIRST_DAY + (time_t)day * SECS_PER_DAY, LATITUDE, LONGITUDE, sun);
+    TEST_ASSERT_TRUE(sun.CivilDawn < sun.Sunrise && sun.Sunrise < sun.SolarNoon && sun.SolarNoon < sun.Sunset && sun.Sunset < sun.CivilDusk);
+  }
+}
+
+//  Polar night clamps the crossings to noon, the midnight sun to noon -/+ 12 h,
+//  give or take the sun moving in the meantime
+void test_polar_clamps(){
+  sunData_t winter, summer;
+  ComputeSunData(SUN_REFERENCE_FIRST_DAY + 355 * SECS_PER_DAY, 78.0, 15.0, winter);
+  ComputeSunData(SUN_REFERENCE_FIRST_DAY + 171 * SECS_PER_DAY, 78.0, 15.0, summer);
+
+  TEST_ASSERT_INT_WITHIN(SUN_TOLERANCE, winter.SolarNoon, winter.Sunrise);
+  TEST_ASSERT_INT_WITHIN(SUN_TOLERANCE, winter.SolarNoon, winter.Sunset);
+  TEST_ASSERT_INT_WITHIN(SUN_TOLERANCE, 12 * SECS_PER_HOUR, summer.SolarNoon - summer.Sunrise);
+  TEST_ASSERT_INT_WITHIN(SUN_TOLERANCE, 12 * SECS_PER_HOUR, summer.Sunset - summer.SolarNoon);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_reference_is_for_the_configured_location);
+  RUN_TEST(test_full_year);
+  RUN_TEST(test_events_in_order);
+  RUN_TEST(test_polar_clamps);
+  return UNITY_END();
+}
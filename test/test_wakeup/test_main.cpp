@@ -0,0 +1,160 @@
+/*
+    Host trace of the wake-up ramp through the output stage
+
+    Runs the ramp with the default wake-up settings tick by tick through
+    ApplyCalibration, MapLightChannels and DitherOutputs, as WriteOutputs()
+    does, and checks the PWM sequence for visible steps: averaged over
+    the time the eye integrates, every channel has to follow the exact
+    value of the ramp to a fraction of a PWM step and never go back down.
+
+    With WAKEUP_TRACE set to a file name the trace is written there as
+    CSV, one row per TRACE_STEP ms with the mean of every channel of the
+    board, for tools/plot_wakeup_trace.py:
+
+    WAKEUP_TRACE=wakeup.csv pio test -e native -f test_wakeup
+    python3 tools/plot_wakeup_trace.py wakeup.csv
+*/
+
+#include <Arduino.h>
+#include <unity.h>
+#include "defines.h"
+#include "board.h"
+#include "calibration.h"
+#include "colourspace.h"
+#include "rgbw.h"
+#include "ledgamma.h"
+#include "wakeup.h"
+
+#define TICK_MS DEFAULT_PWM_ADJUSTMENT_SPEED
+#define WINDOW_MS 100             //  about what the eye averages flicker over
+#define TRACE_STEP 1000           //  ms per row of the CSV trace
+#define MAX_WINDOW_ERROR 0.1      //  PWM steps
+
+struct traceChannel{
+  char gpio;
+  const char* name;
+  uint desiredValue;
+};
+
+const traceChannel channels[LIGHT_CHANNEL_COUNT] = LIGHT_CHANNELS;
+
+struct wakeUpTrace{
+  uint32_t windows;
+  double worstError;          //  PWM steps, mean output against the exact ramp over a window
+  uint32_t worstErrorAt;      //  ms
+  uint32_t reversals;         //  windows visibly darker than the one before
+  uint16_t last[LIGHT_CHANNEL_COUNT];
+  uint16_t full[LIGHT_CHANNEL_COUNT];
+};
+
+void setUp(){
+  SetWhitePoint(DEFAULT_WHITE_TEMPERATURE, true);
+}
+
+void tearDown(){}
+
+void RunWakeUp(uint16_t kelvin, uint8_t brightness, uint32_t duration, wakeUpTrace& trace, FILE* csv){
+  int16_t matrix[CALIBRATION_CHANNELS][CALIBRATION_CHANNELS];
+  CalibrationIdentity(matrix);
+
+  rgbwColour colour = KelvinToRgbw(kelvin, LedPwmValues[brightness]);
+  uint16_t in[CALIBRATION_CHANNELS] = { colour.r, colour.g, colour.b, colour.w };
+  uint16_t coldShare = ColdWhiteShare(DEFAULT_WHITE_TEMPERATURE);
+  int32_t calibrated[CALIBRATION_CHANNELS], mapped[LIGHT_CHANNEL_COUNT];
+  uint16_t out[LIGHT_CHANNEL_COUNT];
+  outputDither dither = {};
+  wakeUpRamp ramp;
+  WakeUpStart(ramp, 0, duration);
+
+  memset(&trace, 0, sizeof(trace));
+  double exact[LIGHT_CHANNEL_COUNT] = { 0 }, actual[LIGHT_CHANNEL_COUNT] = { 0 }, previous[LIGHT_CHANNEL_COUNT] = { 0 };
+  double rows[LIGHT_CHANNEL_COUNT] = { 0 };
+  uint32_t windowTicks = 0, rowTicks = 0;
+
+  if (csv){
+    fprintf(csv, "ms,level");
+    for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) fprintf(csv, ",%s", channels[i].name);
+    fprintf(csv, "\n");
+  }
+
+  for (uint32_t t = 0; t <= duration; t += TICK_MS) {
+    uint16_t level = WakeUpLevel(ramp, t);
+    ApplyCalibration(matrix, MASTER_BRIGHTNESS_MAX, level, in, calibrated);
+    MapLightChannels(calibrated, mapped, coldShare, CALIBRATION_MAX_OUTPUT);
+    DitherOutputs(dither, mapped, out);
+
+    for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+      exact[i] += (double)mapped[i] / (1 << CALIBRATION_FRACTION_BITS);
+      actual[i] += out[i];
+      rows[i] += out[i];
+    }
+    memcpy(trace.last, out, sizeof(out));
+    windowTicks++;
+    rowTicks++;
+
+    if ((t + TICK_MS) % WINDOW_MS < TICK_MS){
+      for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+        double error = fabs(actual[i] - exact[i]) / windowTicks;
+        if (error > trace.worstError){
+          trace.worstError = error;
+          trace.worstErrorAt = t;
+        }
+        if (trace.windows && actual[i] / windowTicks < previous[i] - MAX_WINDOW_ERROR) trace.reversals++;
+        previous[i] = actual[i] / windowTicks;
+        exact[i] = actual[i] = 0;
+      }
+      trace.windows++;
+      windowTicks = 0;
+    }
+
+    if (csv && ((t + TICK_MS) % TRACE_STEP < TICK_MS || t + TICK_MS > duration)){
+      fprintf(csv, "%u,%u", t, level);
+      for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) {
+        fprintf(csv, ",%.3f", rows[i] / rowTicks);
+        rows[i] = 0;
+      }
+      fprintf(csv, "\n");
+      rowTicks = 0;
+    }
+  }
+
+  //  What the channels show once the ramp is over
+  ApplyCalibration(matrix, MASTER_BRIGHTNESS_MAX, OUTPUT_LEVEL_MAX, in, calibrated);
+  MapLightChannels(calibrated, mapped, coldShare, CALIBRATION_MAX_OUTPUT);
+  RoundOutputs(mapped, trace.full);
+}
+
+void CheckTrace(const wakeUpTrace& trace){
+  char line[96];
+  snprintf(line, sizeof(line), "%u windows, worst error %.4f PWM steps at %u ms", trace.windows, trace.worstError, trace.worstErrorAt);
+  TEST_MESSAGE(line);
+
+  TEST_ASSERT_LESS_THAN(MAX_WINDOW_ERROR, trace.worstError);
+  TEST_ASSERT_EQUAL(0, trace.reversals);
+  for (uint8_t i = 0; i < LIGHT_CHANNEL_COUNT; i++) TEST_ASSERT_INT_WITHIN(1, trace.full[i], trace.last[i]);
+}
+
+void test_default_wake_up(){
+  const char* path = getenv("WAKEUP_TRACE");
+  FILE* csv = path ? fopen(path, "w") : NULL;
+
+  wakeUpTrace trace;
+  RunWakeUp(DEFAULT_WAKEUP_TEMPERATURE, DEFAULT_WAKEUP_BRIGHTNESS, DEFAULT_WAKEUP_DURATION * 60000UL, trace, csv);
+  if (csv) fclose(csv);
+
+  CheckTrace(trace);
+}
+
+//  The longest ramp at the lowest brightness has the slowest steps
+void test_long_dim_wake_up(){
+  wakeUpTrace trace;
+  RunWakeUp(2200, 64, 60 * 60000UL, trace, NULL);
+  CheckTrace(trace);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_default_wake_up);
+  RUN_TEST(test_long_dim_wake_up);
+  return UNITY_END();
+}
@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+"""Plots a wake-up trace written by test/test_wakeup.
+
+Every channel is drawn as its mean PWM value per row of the trace, on
+a linear and a logarithmic axis: the log axis shows the start of the
+ramp, where a step of the output would be seen first.
+
+    WAKEUP_TRACE=wakeup.csv pio test -e native -f test_wakeup
+    python3 tools/plot_wakeup_trace.py wakeup.csv [plot.png]
+"""
+
+import csv
+import sys
+
+try:
+    import matplotlib
+    if len(sys.argv) > 2:
+        matplotlib.use("Agg")
+    import matplotlib.pyplot as plt
+except ImportError:
+    sys.exit("matplotlib is needed: pip install matplotlib")
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+
+    with open(sys.argv[1], newline="") as f:
+        rows = list(csv.reader(f))
+
+    header, rows = rows[0], rows[1:]
+    minutes = [int(r[0]) / 60000 for r in rows]
+
+    fig, (linear, log) = plt.subplots(2, 1, sharex=True, figsize=(10, 8))
+    for column in range(2, len(header)):
+        values = [float(r[column]) for r in rows]
+        linear.plot(minutes, values, label=header[column])
+        log.plot(minutes, values, label=header[column])
+
+    linear.set_ylabel("PWM steps")
+    linear.legend()
+    log.set_yscale("symlog", linthresh=1)
+    log.set_ylabel("PWM steps (log)")
+    log.set_xlabel("minutes")
+    fig.suptitle("Wake-up ramp, mean output per %d ms" % (int(rows[1][0]) - int(rows[0][0])))
+
+    if len(sys.argv) > 2:
+        fig.savefig(sys.argv[2])
+    else:
+        plt.show()
+
+
+if __name__ == "__main__":
+    main()
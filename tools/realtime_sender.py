@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Sends E1.31 (sACN) or Art-Net DMX frames to a node, for testing realtime.h.
+
+The frames can be sent late, out of order or not at all, to exercise
+the sequence checks and the jitter buffer of the node. The packets are
+built the same way as in test/test_realtime.
+
+    python3 tools/realtime_sender.py HOST [--protocol e131|artnet]
+        [--universe 1] [--fps 44] [--count 0]
+        [--values 255,128,0 | --pattern fade|chase|rainbow] [--slots 512]
+        [--jitter MS] [--reorder P] [--drop P] [--multicast]
+
+A count of 0 sends until interrupted. --reorder and --drop are the
+chances, 0 to 1, that a frame is swapped with the next one or left out.
+With --multicast, E1.31 goes to the group of the universe rather than
+to HOST.
+"""
+
+import argparse
+import colorsys
+import math
+import random
+import socket
+import struct
+import sys
+import time
+import uuid
+
+E131_PORT = 5568
+ARTNET_PORT = 6454
+DMX_SLOTS = 512
+
+
+def e131_packet(cid, universe, sequence, data, options=0, priority=100):
+    slots = len(data)
+    length = 126 + slots
+    root = struct.pack("!HH12sHI16s", 0x0010, 0, b"ASC-E1.17\0\0\0",
+                       0x7000 | (length - 16), 0x00000004, cid)
+    framing = struct.pack("!HI64sBHBBH", 0x7000 | (length - 38), 0x00000002,
+                          b"realtime_sender", priority, 0, sequence, options, universe)
+    dmp = struct.pack("!HBBHHHB", 0x7000 | (length - 115), 0x02, 0xA1, 0, 1, slots + 1, 0)
+    return root + framing + dmp + bytes(data)
+
+
+def artnet_packet(universe, sequence, data):
+    if len(data) % 2:
+        data = list(data) + [0]
+    port_address = (universe - 1) & 0x7FFF
+    return (b"Art-Net\0" + struct.pack("<H", 0x5000)
+            + struct.pack("!HBBBBH", 14, sequence, 0, port_address & 0xFF, port_address >> 8, len(data))
+            + bytes(data))
+
+
+def frame_values(args, n):
+    t = n / args.fps
+    if args.values is not None:
+        values = args.values
+    elif args.pattern == "fade":
+        level = int(127.5 * (1 - math.cos(2 * math.pi * t / 4)))
+        values = [level] * args.slots
+    elif args.pattern == "chase":
+        values = [255 if i == n % args.slots else 0 for i in range(args.slots)]
+    else:
+        r, g, b = colorsys.hsv_to_rgb((t / 8) % 1, 1, 1)
+        values = [int(r * 255), int(g * 255), int(b * 255)]
+    values = [values[i % len(values)] for i in range(args.slots)]
+    return values
+
+
+def parse_values(text):
+    values = [int(v, 0) for v in text.split(",")]
+    if any(v < 0 or v > 255 for v in values):
+        raise argparse.ArgumentTypeError("the values are from 0 to 255")
+    return values
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("host")
+    parser.add_argument("--protocol", choices=("e131", "artnet"), default="e131")
+    parser.add_argument("--universe", type=int, default=1)
+    parser.add_argument("--fps", type=float, default=44)
+    parser.add_argument("--count", type=int, default=0)
+    parser.add_argument("--values", type=parse_values)
+    parser.add_argument("--pattern", choices=("fade", "chase", "rainbow"), default="rainbow")
+    parser.add_argument("--slots", type=int, default=DMX_SLOTS)
+    parser.add_argument("--jitter", type=float, default=0, help="ms, at most, added to each frame")
+    parser.add_argument("--reorder", type=float, default=0)
+    parser.add_argument("--drop", type=float, default=0)
+    parser.add_argument("--multicast", action="store_true")
+    args = parser.parse_args()
+
+    if not 1 <= args.slots <= DMX_SLOTS:
+        sys.exit("--slots is from 1 to %d" % DMX_SLOTS)
+    if not 1 <= args.universe <= (63999 if args.protocol == "e131" else 0x8000):
+        sys.exit("universe out of range")
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    if args.protocol == "e131":
+        port = E131_PORT
+        host = args.host
+        if args.multicast:
+            host = "239.255.%d.%d" % (args.universe >> 8, args.universe & 0xFF)
+            sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    else:
+        port = ARTNET_PORT
+        host = args.host
+
+    cid = uuid.uuid4().bytes
+    sequence = 0
+    held = None
+    sent = dropped = swapped = 0
+    start = time.monotonic()
+    n = 0
+    try:
+        while not args.count or n < args.count:
+            data = frame_values(args, n)
+            if args.protocol == "e131":
+                packet = e131_packet(cid, args.universe, sequence, data)
+                sequence = (sequence + 1) & 0xFF
+            else:
+                sequence = sequence % 255 + 1       # 0 means unsequenced in Art-Net
+                packet = artnet_packet(args.universe, sequence, data)
+
+            due = start + n / args.fps + random.uniform(0, args.jitter) / 1000
+            delay = due - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+
+            if random.random() < args.drop:
+                dropped += 1
+            elif held is None and random.random() < args.reorder:
+                held = packet
+                swapped += 1
+            else:
+                sock.sendto(packet, (host, port))
+                sent += 1
+                if held is not None:
+                    sock.sendto(held, (host, port))
+                    sent += 1
+                    held = None
+            n += 1
+    except KeyboardInterrupt:
+        pass
+
+    print("%d frames sent, %d dropped, %d out of order" % (sent, dropped, swapped))
+
+
+if __name__ == "__main__":
+    main()
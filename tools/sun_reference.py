@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Writes the reference sun times test/test_sun checks include/suntimes.h against.
+
+The times come from the full NOAA solar calculator algorithm (the one
+of the NOAA spreadsheets, after Meeus, Astronomical Algorithms), not
+from the simplified equations the firmware uses: the position of the
+sun is taken at the time of each event rather than at noon, and the
+event time is iterated until it settles.
+
+    python3 tools/sun_reference.py [year] [latitude] [longitude] > test/test_sun/reference.h
+"""
+
+import calendar
+import math
+import sys
+
+ZENITH_SUNRISE = 90.833
+ZENITH_CIVIL = 96.0
+
+
+def sun_position(t):
+    """Declination (rad) and equation of time (min) at unix time t."""
+    T = (t / 86400.0 + 2440587.5 - 2451545.0) / 36525.0
+
+    L0 = math.radians((280.46646 + T * (36000.76983 + T * 0.0003032)) % 360)
+    M = math.radians(357.52911 + T * (35999.05029 - 0.0001537 * T))
+    e = 0.016708634 - T * (0.000042037 + 0.0000001267 * T)
+
+    C = (math.sin(M) * (1.914602 - T * (0.004817 + 0.000014 * T))
+         + math.sin(2 * M) * (0.019993 - 0.000101 * T)
+         + math.sin(3 * M) * 0.000289)
+    omega = math.radians(125.04 - 1934.136 * T)
+    apparent = math.radians(math.degrees(L0) + C - 0.00569 - 0.00478 * math.sin(omega))
+
+    mean_obliquity = 23 + (26 + (21.448 - T * (46.815 + T * (0.00059 - T * 0.001813))) / 60) / 60
+    obliquity = math.radians(mean_obliquity + 0.00256 * math.cos(omega))
+
+    declination = math.asin(math.sin(obliquity) * math.sin(apparent))
+
+    y = math.tan(obliquity / 2) ** 2
+    eot = 4 * math.degrees(y * math.sin(2 * L0) - 2 * e * math.sin(M)
+                           + 4 * e * y * math.sin(M) * math.cos(2 * L0)
+                           - 0.5 * y * y * math.sin(4 * L0) - 1.25 * e * e * math.sin(2 * M))
+    return declination, eot
+
+
+def solar_noon(midnight, longitude):
+    """Seconds from UTC midnight to solar noon."""
+    minutes = 720 - 4 * longitude
+    for _ in range(4):
+        _, eot = sun_position(midnight + minutes * 60)
+        minutes = 720 - 4 * longitude - eot
+    return minutes * 60
+
+
+def crossing(midnight, latitude, longitude, zenith, rising):
+    """Seconds from UTC midnight to the sun crossing zenith, None if it does not."""
+    lat = math.radians(latitude)
+    minutes = 720 - 4 * longitude
+    for _ in range(6):
+        declination, eot = sun_position(midnight + minutes * 60)
+        c = math.cos(math.radians(zenith)) / (math.cos(lat) * math.cos(declination)) - math.tan(lat) * math.tan(declination)
+        if abs(c) > 1:
+            return None
+        hour_angle = math.degrees(math.acos(c))
+        noon = 720 - 4 * longitude - eot
+        minutes = noon - 4 * hour_angle if rising else noon + 4 * hour_angle
+    return minutes * 60
+
+
+def main():
+    year = int(sys.argv[1]) if len(sys.argv) > 1 else 2026
+    latitude = float(sys.argv[2]) if len(sys.argv) > 2 else 37.9908997
+    longitude = float(sys.argv[3]) if len(sys.argv) > 3 else 23.70332
+
+    first = calendar.timegm((year, 1, 1, 0, 0, 0))
+    days = 366 if calendar.isleap(year) else 365
+
+    print("//  Generated by tools/sun_reference.py %d %s %s, do not edit" % (year, latitude, longitude))
+    print("//  Seconds from UTC midnight: civil dawn, sunrise, solar noon, sunset, civil dusk")
+    print()
+    print("#define SUN_REFERENCE_FIRST_DAY %dL     //  %d-01-01, unix time" % (first, year))
+    print("#define SUN_REFERENCE_LATITUDE %s" % latitude)
+    print("#define SUN_REFERENCE_LONGITUDE %s" % longitude)
+    print("#define SUN_REFERENCE_DAYS %d" % days)
+    print()
+    print("const int32_t SunReference[SUN_REFERENCE_DAYS][5] = {")
+    for day in range(days):
+        midnight = first + day * 86400
+        row = (
+            crossing(midnight, latitude, longitude, ZENITH_CIVIL, True),
+            crossing(midnight, latitude, longitude, ZENITH_SUNRISE, True),
+            solar_noon(midnight, longitude),
+            crossing(midnight, latitude, longitude, ZENITH_SUNRISE, False),
+            crossing(midnight, latitude, longitude, ZENITH_CIVIL, False),
+        )
+        if None in row:
+            sys.exit("The sun does not rise or set every day at this latitude")
+        print("  { %s }," % ", ".join("%6d" % round(v) for v in row))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()